@@ -0,0 +1,40 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace bench {
+
+std::vector<Case> &cases()
+{
+    static std::vector<Case> registered;
+    return registered;
+}
+
+void report(const char *benchmark, const char *variant, uint64_t operations, double nanoseconds)
+{
+    double perOperation = operations ? nanoseconds / operations : 0;
+    std::printf("%-32s %-24s %10llu ops %12.1f ns/op %14.0f ops/s\n",
+                benchmark, variant, (unsigned long long)operations, perOperation,
+                perOperation > 0 ? 1e9 / perOperation : 0);
+    std::fflush(stdout);
+}
+
+void reportValue(const char *benchmark, const char *variant, double value, const char *unit)
+{
+    std::printf("%-32s %-24s %14.2f %s\n", benchmark, variant, value, unit);
+    std::fflush(stdout);
+}
+
+void reportPercentiles(const char *benchmark, const char *variant, std::vector<double> samples, const char *unit)
+{
+    if (samples.empty()) {
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    std::printf("%-32s %-24s p50 %10.2f  p99 %10.2f  max %10.2f %s\n", benchmark, variant,
+                samples[samples.size() / 2], samples[samples.size() * 99 / 100], samples.back(), unit);
+    std::fflush(stdout);
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+namespace bench {
+
+struct Case {
+    const char *name;
+    void (*run)();
+};
+
+std::vector<Case> &cases();
+
+struct Registrar {
+    Registrar(const char *name, void (*run)()) {
+        cases().push_back({name, run});
+    }
+};
+
+class Stopwatch {
+public:
+    Stopwatch() : started(std::chrono::steady_clock::now()) {}
+    void restart() {
+        started = std::chrono::steady_clock::now();
+    }
+    double elapsedNs() const {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+    }
+private:
+    std::chrono::steady_clock::time_point started;
+};
+
+// measures cpu time, so that time spent blocked in the poller does not count
+class CpuStopwatch {
+public:
+    CpuStopwatch() : started(std::clock()) {}
+    void restart() {
+        started = std::clock();
+    }
+    double elapsedNs() const {
+        return double(std::clock() - started) * 1e9 / CLOCKS_PER_SEC;
+    }
+private:
+    std::clock_t started;
+};
+
+void report(const char *benchmark, const char *variant, uint64_t operations, double nanoseconds);
+void reportValue(const char *benchmark, const char *variant, double value, const char *unit);
+// p50, p99 and max of the samples
+void reportPercentiles(const char *benchmark, const char *variant, std::vector<double> samples, const char *unit);
+
+}
+
+#define BENCHMARK_CASE(function, name) \
+    static void function(); \
+    static bench::Registrar function##Registrar(name, &function); \
+    static void function()
@@ -0,0 +1,139 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv_p.h"
+
+#include <atomic>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <dlfcn.h>
+#include <sys/epoll.h>
+#endif
+
+// A bulk writer in the way of QAbstractSocket: the write notifier is on while data is buffered,
+// it goes off once the buffer is flushed, and the next message queued from the flush turns it
+// back on. Notifier changes are committed to libuv once per iteration, or after each change as
+// they used to be. libuv 1.45 and later may batch epoll_ctl through io_uring, run with
+// UV_USE_IO_URING=0 to see every call.
+
+#ifdef __linux__
+namespace {
+std::atomic<uint64_t> epollCtlCalls(0);
+}
+
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    typedef int (*EpollCtl)(int, int, int, struct epoll_event *);
+    static EpollCtl next = (EpollCtl)dlsym(RTLD_NEXT, "epoll_ctl");
+    epollCtlCalls.fetch_add(1, std::memory_order_relaxed);
+    return next(epfd, op, fd, event);
+}
+#endif
+
+namespace {
+
+const int messages = 200000;
+const size_t messageSize = 512;
+
+uint64_t epollCtlCount()
+{
+#ifdef __linux__
+    return epollCtlCalls.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+struct BulkWriter {
+    qtjs::EventDispatcherLibUvSocketNotifier &notifier;
+    bool commitEachChange;
+    int writeFd;
+    int readFd;
+    int sent;
+    int received;
+    std::vector<char> message;
+    std::vector<char> buffer;
+
+    BulkWriter(qtjs::EventDispatcherLibUvSocketNotifier &notifier, bool commitEachChange, int writeFd, int readFd)
+        : notifier(notifier), commitEachChange(commitEachChange), writeFd(writeFd), readFd(readFd),
+          sent(0), received(0), message(messageSize, 'x'), buffer(64 * 1024)
+    {
+    }
+
+    void change()
+    {
+        if (commitEachChange) {
+            notifier.commitPendingChanges();
+        }
+    }
+
+    void write()
+    {
+        notifier.registerSocketNotifier(writeFd, QSocketNotifier::Write, [this] { flush(); });
+        change();
+    }
+
+    void flush()
+    {
+        if (::write(writeFd, message.data(), message.size()) != (ssize_t)message.size()) {
+            return;
+        }
+        notifier.unregisterSocketNotifier(writeFd, QSocketNotifier::Write);
+        change();
+        if (++sent < messages) {
+            write();
+        }
+    }
+
+    void read()
+    {
+        ssize_t size = ::read(readFd, buffer.data(), buffer.size());
+        if (size > 0) {
+            received += size / messageSize;
+        }
+    }
+};
+
+void runBulkWrite(const char *variant, bool commitEachChange)
+{
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+        return;
+    }
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    {
+        qtjs::EventDispatcherLibUvSocketNotifier notifier(&loop);
+        BulkWriter writer(notifier, commitEachChange, pair[0], pair[1]);
+        notifier.registerSocketNotifier(pair[1], QSocketNotifier::Read, [&writer] { writer.read(); });
+        writer.write();
+
+        uint64_t epollCtlBefore = epollCtlCount();
+        bench::Stopwatch elapsed;
+        while (writer.sent < messages) {
+            notifier.commitPendingChanges();
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+        bench::report("sockets/bulk write", variant, messages, elapsed.elapsedNs());
+        bench::reportValue("sockets/bulk write uv_poll calls", variant,
+                           double(notifier.pollStarts() + notifier.pollStops()) / messages, "per message");
+#ifdef __linux__
+        bench::reportValue("sockets/bulk write epoll_ctl", variant,
+                           double(epollCtlCount() - epollCtlBefore) / messages, "per message");
+#endif
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+}
+
+BENCHMARK_CASE(bulkWrite, "socket notifier toggling: bulk write with per-iteration commits")
+{
+    runBulkWrite("commit each change", true);
+    runBulkWrite("commit per iteration", false);
+}
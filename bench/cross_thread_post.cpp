@@ -0,0 +1,103 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv.h"
+
+#include <QMetaObject>
+#include <QThread>
+
+#include <functional>
+#include <future>
+
+namespace {
+
+const int roundTrips = 100000;
+const int burstTasks = 1000000;
+
+// a QThread running a libuv dispatcher on a private loop, with an object living on it
+struct Worker {
+    QThread thread;
+    qtjs::EventDispatcherLibUv *dispatcher;
+    QObject *receiver;
+
+    Worker()
+        : dispatcher(new qtjs::EventDispatcherLibUv(qtjs::EventDispatcherLibUv::CreatePrivateLoop)),
+          receiver(new QObject())
+    {
+        thread.setEventDispatcher(dispatcher);
+        receiver->moveToThread(&thread);
+        QObject::connect(&thread, &QThread::finished, receiver, &QObject::deleteLater);
+        thread.start();
+    }
+
+    ~Worker()
+    {
+        thread.quit();
+        thread.wait();
+    }
+};
+
+void postTask(Worker &to, std::function<void()> task)
+{
+    to.dispatcher->post(std::move(task));
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+void invokeTask(Worker &to, std::function<void()> task)
+{
+    QMetaObject::invokeMethod(to.receiver, std::move(task), Qt::QueuedConnection);
+}
+#endif
+
+// bounces a task between two dispatcher threads, one hop waits for the previous one
+template <typename Send>
+void runPingPong(const char *variant, Send send)
+{
+    Worker ping, pong;
+    std::promise<void> finished;
+    int remaining = roundTrips;
+    std::function<void()> serve;
+    serve = [&] {
+        if (!--remaining) {
+            finished.set_value();
+            return;
+        }
+        send(pong, [&] { send(ping, serve); });
+    };
+
+    bench::Stopwatch elapsed;
+    send(ping, [&] { send(pong, [&] { send(ping, serve); }); });
+    finished.get_future().wait();
+    bench::report("post/round trip", variant, roundTrips, elapsed.elapsedNs());
+}
+
+// one producer thread floods a dispatcher thread with tasks
+template <typename Send>
+void runBurst(const char *variant, Send send)
+{
+    Worker consumer;
+    std::promise<void> finished;
+    int remaining = burstTasks;
+
+    bench::Stopwatch elapsed;
+    for (int task = 0; task < burstTasks; ++task) {
+        send(consumer, [&] {
+            if (!--remaining) {
+                finished.set_value();
+            }
+        });
+    }
+    finished.get_future().wait();
+    bench::report("post/burst", variant, burstTasks, elapsed.elapsedNs());
+}
+
+}
+
+BENCHMARK_CASE(crossThreadPost, "cross-thread tasks: post vs queued invokeMethod")
+{
+    runPingPong("post", &postTask);
+    runBurst("post", &postTask);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    runPingPong("queued invokeMethod", &invokeTask);
+    runBurst("queued invokeMethod", &invokeTask);
+#endif
+}
@@ -0,0 +1,142 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv.h"
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QSocketNotifier>
+#include <QThread>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Latency of posted events on a thread whose sockets are all readable all the time, each
+// dispatch costing some work. Without a budget a posted event waits for the whole pass.
+
+namespace {
+
+const int busySockets = 100;
+const int workUs = 20;
+const int probes = 500;
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class BusyNotifier : public QSocketNotifier {
+public:
+    explicit BusyNotifier(int fd) : QSocketNotifier(fd, QSocketNotifier::Read) {}
+
+protected:
+    bool event(QEvent *event) override
+    {
+        if (event->type() != QEvent::SockAct) {
+            return QSocketNotifier::event(event);
+        }
+        // leaves the data unread, so that the socket stays ready
+        int64_t until = nowNs() + workUs * 1000;
+        while (nowNs() < until) {
+        }
+        return true;
+    }
+};
+
+class ProbeReceiver : public QObject {
+public:
+    std::atomic<int> handled;
+    std::atomic<int64_t> handledAt;
+
+    ProbeReceiver() : handled(0), handledAt(0) {}
+
+protected:
+    bool event(QEvent *event) override
+    {
+        if (event->type() != QEvent::User) {
+            return QObject::event(event);
+        }
+        handledAt.store(nowNs());
+        handled.fetch_add(1);
+        return true;
+    }
+};
+
+class FloodedThread : public QThread {
+public:
+    qtjs::EventDispatcherLibUv *dispatcher;
+    ProbeReceiver receiver;
+    std::atomic<bool> flooding;
+
+    FloodedThread() : dispatcher(new qtjs::EventDispatcherLibUv(qtjs::EventDispatcherLibUv::CreatePrivateLoop)), flooding(false)
+    {
+        setEventDispatcher(dispatcher);
+        receiver.moveToThread(this);
+    }
+
+protected:
+    void run() override
+    {
+        std::vector<int> fds;
+        std::vector<BusyNotifier *> notifiers;
+        for (int i = 0; i < busySockets; ++i) {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+                break;
+            }
+            fds.push_back(pair[0]);
+            fds.push_back(pair[1]);
+            if (write(pair[1], "x", 1) != 1) {
+                break;
+            }
+            notifiers.push_back(new BusyNotifier(pair[0]));
+        }
+        flooding.store(true);
+        exec();
+        for (BusyNotifier *notifier : notifiers) {
+            delete notifier;
+        }
+        for (int fd : fds) {
+            close(fd);
+        }
+    }
+};
+
+void runProbes(const char *variant, int maxDispatches, qint64 maxUs)
+{
+    FloodedThread thread;
+    thread.dispatcher->setDispatchBudget(maxDispatches, maxUs);
+    thread.start();
+    while (!thread.flooding.load()) {
+        std::this_thread::yield();
+    }
+
+    std::vector<double> latencies;
+    for (int probe = 0; probe < probes; ++probe) {
+        int before = thread.receiver.handled.load();
+        int64_t sent = nowNs();
+        QCoreApplication::postEvent(&thread.receiver, new QEvent(QEvent::User));
+        while (thread.receiver.handled.load() == before) {
+            std::this_thread::yield();
+        }
+        latencies.push_back((thread.receiver.handledAt.load() - sent) / 1000.0);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    bench::reportPercentiles("budget/posted event under socket flood", variant, latencies, "us");
+
+    thread.quit();
+    thread.wait();
+}
+
+}
+
+BENCHMARK_CASE(dispatchBudget, "dispatch budget: posted event latency under a socket flood")
+{
+    runProbes("no budget", 0, 0);
+    runProbes("16 dispatches", 16, 0);
+    runProbes("500 us", 0, 500);
+}
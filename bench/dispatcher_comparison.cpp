@@ -0,0 +1,250 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv.h"
+
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QEvent>
+#include <QEventLoop>
+#include <QSocketNotifier>
+#include <QThread>
+#include <QTimerEvent>
+
+#include <functional>
+#include <future>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// The same workloads through Qt's public api on worker threads, once per dispatcher: libuv and
+// the stock UNIX and Glib ones, which Qt picks for a thread by QT_NO_GLIB. Qt builds without
+// glib have the UNIX dispatcher only, it is measured once then.
+
+namespace {
+
+const int churnTimers = 1000;
+const int churnRounds = 100;
+const int firingTimers = 1000;
+const int firingMs = 1000;
+const int notifierCount = 500;
+const int toggleRounds = 200;
+const int roundTrips = 20000;
+const int emptyIterations = 1000000;
+
+enum DispatcherKind {
+    LibUvDispatcher,
+    UnixDispatcher,
+    GlibDispatcher
+};
+
+// runs functions on the thread it lives in
+class Runner : public QObject {
+public:
+    struct Task : QEvent {
+        explicit Task(std::function<void()> run) : QEvent(QEvent::User), run(std::move(run)) {}
+        std::function<void()> run;
+    };
+
+protected:
+    bool event(QEvent *event) override
+    {
+        if (event->type() == QEvent::User) {
+            static_cast<Task *>(event)->run();
+            return true;
+        }
+        return QObject::event(event);
+    }
+};
+
+class DispatcherThread {
+public:
+    QByteArray name;
+
+    explicit DispatcherThread(DispatcherKind kind) : runner(new Runner())
+    {
+        QByteArray noGlib = qgetenv("QT_NO_GLIB");
+        if (kind == LibUvDispatcher) {
+            thread.setEventDispatcher(new qtjs::EventDispatcherLibUv(qtjs::EventDispatcherLibUv::CreatePrivateLoop));
+        } else if (kind == UnixDispatcher) {
+            qputenv("QT_NO_GLIB", "1");
+        } else {
+            qunsetenv("QT_NO_GLIB");
+        }
+        runner->moveToThread(&thread);
+        QObject::connect(&thread, &QThread::finished, runner, &QObject::deleteLater);
+        thread.start();
+        run([this] { name = QThread::currentThread()->eventDispatcher()->metaObject()->className(); });
+        // the thread has made its dispatcher by now
+        if (noGlib.isNull()) {
+            qunsetenv("QT_NO_GLIB");
+        } else {
+            qputenv("QT_NO_GLIB", noGlib);
+        }
+    }
+
+    ~DispatcherThread()
+    {
+        thread.quit();
+        thread.wait();
+    }
+
+    // runs the function on the thread and waits for it
+    void run(std::function<void()> function)
+    {
+        std::promise<void> done;
+        QCoreApplication::postEvent(runner, new Runner::Task([&] {
+            function();
+            done.set_value();
+        }));
+        done.get_future().wait();
+    }
+
+private:
+    QThread thread;
+    Runner *runner;
+};
+
+class TimerCounter : public QObject {
+public:
+    quint64 fired;
+    int deadlineTimer;
+    QEventLoop *loop;
+
+    TimerCounter() : fired(0), deadlineTimer(0), loop(nullptr) {}
+
+protected:
+    void timerEvent(QTimerEvent *event) override
+    {
+        if (event->timerId() == deadlineTimer) {
+            loop->quit();
+            return;
+        }
+        ++fired;
+    }
+};
+
+void runTimerChurn(DispatcherThread &worker)
+{
+    worker.run([&] {
+        QObject owner;
+        std::vector<int> timerIds(churnTimers);
+        bench::Stopwatch elapsed;
+        for (int round = 0; round < churnRounds; ++round) {
+            for (int timer = 0; timer < churnTimers; ++timer) {
+                timerIds[timer] = owner.startTimer(1000 + timer);
+            }
+            for (int timer = 0; timer < churnTimers; ++timer) {
+                owner.killTimer(timerIds[timer]);
+            }
+        }
+        bench::report("compare/timer register+unregister", worker.name.constData(), uint64_t(churnTimers) * churnRounds, elapsed.elapsedNs());
+    });
+}
+
+// every timer is due every millisecond, more than any of the dispatchers keeps up with
+void runTimerFiring(DispatcherThread &worker)
+{
+    worker.run([&] {
+        TimerCounter counter;
+        QEventLoop loop;
+        counter.loop = &loop;
+        std::vector<int> timerIds;
+        for (int timer = 0; timer < firingTimers; ++timer) {
+            timerIds.push_back(counter.startTimer(1));
+        }
+        counter.deadlineTimer = counter.startTimer(firingMs, Qt::PreciseTimer);
+        bench::Stopwatch elapsed;
+        loop.exec();
+        bench::report("compare/timer fire", worker.name.constData(), counter.fired, elapsed.elapsedNs());
+        for (int timerId : timerIds) {
+            counter.killTimer(timerId);
+        }
+        counter.killTimer(counter.deadlineTimer);
+    });
+}
+
+void runSocketNotifiers(DispatcherThread &worker)
+{
+    worker.run([&] {
+        std::vector<int> fds;
+        for (int i = 0; i < notifierCount; ++i) {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+                break;
+            }
+            fds.push_back(pair[0]);
+            fds.push_back(pair[1]);
+        }
+        std::vector<QSocketNotifier *> notifiers;
+        bench::Stopwatch registration;
+        for (size_t pair = 0; pair < fds.size(); pair += 2) {
+            notifiers.push_back(new QSocketNotifier(fds[pair], QSocketNotifier::Read));
+        }
+        bench::report("compare/socket register", worker.name.constData(), notifiers.size(), registration.elapsedNs());
+
+        bench::Stopwatch toggling;
+        for (int round = 0; round < toggleRounds; ++round) {
+            for (QSocketNotifier *notifier : notifiers) {
+                notifier->setEnabled(false);
+                notifier->setEnabled(true);
+            }
+        }
+        bench::report("compare/socket toggle", worker.name.constData(), uint64_t(notifiers.size()) * toggleRounds * 2, toggling.elapsedNs());
+
+        for (QSocketNotifier *notifier : notifiers) {
+            delete notifier;
+        }
+        for (int fd : fds) {
+            close(fd);
+        }
+    });
+}
+
+// the main thread posts an event and waits for the worker to run it, the worker has to be
+// woken up from its blocking wait each time
+void runWakeUpRoundTrips(DispatcherThread &worker)
+{
+    bench::Stopwatch elapsed;
+    for (int trip = 0; trip < roundTrips; ++trip) {
+        worker.run([] {});
+    }
+    bench::report("compare/wakeUp round trip", worker.name.constData(), roundTrips, elapsed.elapsedNs());
+}
+
+void runEmptyIterations(DispatcherThread &worker)
+{
+    worker.run([&] {
+        QAbstractEventDispatcher *dispatcher = QThread::currentThread()->eventDispatcher();
+        bench::Stopwatch elapsed;
+        for (int iteration = 0; iteration < emptyIterations; ++iteration) {
+            dispatcher->processEvents(QEventLoop::AllEvents);
+        }
+        bench::report("compare/empty processEvents", worker.name.constData(), emptyIterations, elapsed.elapsedNs());
+    });
+}
+
+void runOnEachDispatcher(void (*workload)(DispatcherThread &))
+{
+    QByteArray unixName;
+    for (DispatcherKind kind : {LibUvDispatcher, UnixDispatcher, GlibDispatcher}) {
+        DispatcherThread worker(kind);
+        if (kind == UnixDispatcher) {
+            unixName = worker.name;
+        } else if (kind == GlibDispatcher && worker.name == unixName) {
+            continue;
+        }
+        workload(worker);
+    }
+}
+
+}
+
+BENCHMARK_CASE(dispatcherComparison, "dispatchers: libuv vs stock UNIX and Glib")
+{
+    runOnEachDispatcher(&runEmptyIterations);
+    runOnEachDispatcher(&runTimerChurn);
+    runOnEachDispatcher(&runTimerFiring);
+    runOnEachDispatcher(&runSocketNotifiers);
+    runOnEachDispatcher(&runWakeUpRoundTrips);
+}
@@ -0,0 +1,140 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuvgroup.h"
+
+#include <QSocketNotifier>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Round trips of small messages through an echo server on a dispatcher group of 1 to N threads,
+// with SO_REUSEPORT shards and with a shared listener. Each client connection is a blocking
+// thread that sends a message and waits for it to come back. The clients connect in one burst,
+// the connections each thread accepted of it show how evenly the listeners spread them.
+
+namespace {
+
+const int clients = 32;
+const int roundTrips = 2000;
+const size_t messageSize = 64;
+
+std::atomic<int> openConnections(0);
+
+void serve(int, int fd)
+{
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    QSocketNotifier *notifier = new QSocketNotifier(fd, QSocketNotifier::Read);
+    QObject::connect(notifier, &QSocketNotifier::activated, [notifier, fd] {
+        char buffer[4096];
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        // a message this small fits the socket buffer
+        if (size > 0 && write(fd, buffer, size) == size) {
+            return;
+        }
+        if (size < 0 && EAGAIN == errno) {
+            return;
+        }
+        // end of stream, or an error
+        notifier->setEnabled(false);
+        notifier->deleteLater();
+        close(fd);
+        openConnections.fetch_sub(1);
+    });
+    openConnections.fetch_add(1);
+}
+
+void runClient(quint16 port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr *)&address, sizeof(address))) {
+        close(fd);
+        return;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    char message[messageSize] = {};
+    for (int trip = 0; trip < roundTrips; ++trip) {
+        if (write(fd, message, sizeof(message)) != (ssize_t)sizeof(message)) {
+            break;
+        }
+        size_t received = 0;
+        while (received < sizeof(message)) {
+            ssize_t size = read(fd, message + received, sizeof(message) - received);
+            if (size <= 0) {
+                close(fd);
+                return;
+            }
+            received += size;
+        }
+    }
+    close(fd);
+}
+
+void runEcho(int threads, qtjs::EventDispatcherLibUvGroup::ListenMode mode)
+{
+    char variant[64];
+    std::snprintf(variant, sizeof(variant), "%d thread%s, %s", threads, threads > 1 ? "s" : "",
+                  qtjs::EventDispatcherLibUvGroup::ReusePortShards == mode ? "shards" : "shared listener");
+
+    qtjs::EventDispatcherLibUvGroup group(threads);
+    if (!group.listen("127.0.0.1", 0, mode, &serve, clients)) {
+        return;
+    }
+    bench::Stopwatch elapsed;
+    std::vector<std::thread> running;
+    for (int client = 0; client < clients; ++client) {
+        running.emplace_back(&runClient, group.serverPort());
+    }
+    for (std::thread &client : running) {
+        client.join();
+    }
+    bench::report("group/echo round trips", variant, uint64_t(clients) * roundTrips, elapsed.elapsedNs());
+
+    quint64 busiest = 0;
+    quint64 accepted = 0;
+    for (int index = 0; index < group.size(); ++index) {
+        busiest = std::max(busiest, group.acceptedConnections(index));
+        accepted += group.acceptedConnections(index);
+    }
+    if (accepted) {
+        bench::reportValue("group/connections on the busiest thread", variant, 100.0 * busiest / accepted, "%");
+    }
+    for (int index = 0; index < group.size(); ++index) {
+        char thread[96];
+        std::snprintf(thread, sizeof(thread), "%s, thread %d", variant, index);
+        bench::reportValue("group/connections accepted per thread", thread, group.acceptedConnections(index), "connections");
+    }
+
+    // the connections go away on their threads, which have to be around for it
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (openConnections.load() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+}
+
+BENCHMARK_CASE(echoServer, "dispatcher group: echo server from 1 to N threads")
+{
+    int maxThreads = std::max(2, QThread::idealThreadCount());
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        runEcho(threads, qtjs::EventDispatcherLibUvGroup::ReusePortShards);
+        runEcho(threads, qtjs::EventDispatcherLibUvGroup::SharedListener);
+    }
+}
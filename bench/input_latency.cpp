@@ -0,0 +1,85 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv.h"
+
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QWindow>
+#include <QtGui/qpa/qwindowsysteminterface.h>
+
+#include "uv.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Input-to-slot latency of window system events on the gui thread, run on the offscreen
+// platform. libuv holds an hour long timer meanwhile, so the only thing waking the thread
+// is the input itself.
+
+namespace {
+
+const int samples = 2000;
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class LatencyWindow : public QWindow {
+public:
+    std::atomic<int> received;
+    std::atomic<int64_t> receivedAt;
+
+    LatencyWindow() : received(0), receivedAt(0) {}
+
+protected:
+    void keyPressEvent(QKeyEvent *) override
+    {
+        receivedAt.store(nowNs());
+        received.fetch_add(1);
+    }
+};
+
+}
+
+int main(int argc, char **argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QCoreApplication::setEventDispatcher(new qtjs::EventDispatcherLibUv());
+    QGuiApplication app(argc, argv);
+    uv_loop_t *loop = static_cast<qtjs::EventDispatcherLibUv *>(app.eventDispatcher())->uvLoop();
+
+    uv_timer_t idle;
+    uv_timer_init(loop, &idle);
+    uv_timer_start(&idle, [](uv_timer_t *) {}, 3600 * 1000, 0);
+
+    LatencyWindow window;
+    window.create();
+
+    std::vector<double> latencies;
+    std::thread feeder([&] {
+        for (int sample = 0; sample < samples; ++sample) {
+            int before = window.received.load();
+            int64_t sent = nowNs();
+            QWindowSystemInterface::handleKeyEvent(&window, QEvent::KeyPress, Qt::Key_A, Qt::NoModifier);
+            while (window.received.load() == before) {
+                std::this_thread::yield();
+            }
+            latencies.push_back((window.receivedAt.load() - sent) / 1000.0);
+            // give the gui thread time to block again
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+        QMetaObject::invokeMethod(&app, "quit", Qt::QueuedConnection);
+    });
+    app.exec();
+    feeder.join();
+
+    bench::reportPercentiles("input/key to slot", app.platformName().toLatin1().constData(), latencies, "us");
+
+    uv_close((uv_handle_t *)&idle, nullptr);
+    uv_run(loop, UV_RUN_NOWAIT);
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv_p.h"
+
+namespace {
+
+const int callCount = 1000000;
+
+// the same hot paths built once on the virtual, mockable API and once on direct libuv calls
+template <typename Api>
+void runApiCalls(const char *variant)
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    qtjs::EventDispatcherLibUvHandlePools pools;
+    {
+        qtjs::EventDispatcherLibUvBasicTimerNotifier<Api> notifier(&loop, nullptr, &pools.timerWatchers);
+        const int timerCount = 1000;
+        bench::Stopwatch registration;
+        for (int round = 0; round < callCount / timerCount; ++round) {
+            for (int timerId = 1; timerId <= timerCount; ++timerId) {
+                notifier.registerTimer(timerId, 1000 + timerId, []{});
+            }
+        }
+        bench::report("api/timer register", variant, callCount, registration.elapsedNs());
+
+        bench::Stopwatch remaining;
+        for (int round = 0; round < callCount / timerCount; ++round) {
+            for (int timerId = 1; timerId <= timerCount; ++timerId) {
+                notifier.remainingTime(timerId);
+            }
+        }
+        bench::report("api/timer remaining", variant, callCount, remaining.elapsedNs());
+
+        qtjs::EventDispatcherLibUvBasicAsyncChannel<Api> channel(&loop);
+        bench::Stopwatch wakeups;
+        for (int call = 0; call < callCount; ++call) {
+            channel.send();
+        }
+        bench::report("api/wakeup", variant, callCount, wakeups.elapsedNs());
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+}
+
+}
+
+BENCHMARK_CASE(libuvApi, "libuv api: virtual vs direct calls")
+{
+    runApiCalls<qtjs::LibuvApi>("virtual");
+    runApiCalls<qtjs::LibuvDirectApi>("direct");
+}
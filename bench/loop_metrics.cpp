@@ -0,0 +1,36 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv.h"
+
+#include "uv.h"
+
+namespace {
+
+const int iterations = 1000000;
+
+// cost of an empty loop iteration, an idle handle keeps libuv from blocking
+void runIterations(const char *variant, bool timing)
+{
+    qtjs::EventDispatcherLibUv dispatcher(qtjs::EventDispatcherLibUv::CreatePrivateLoop);
+    dispatcher.setLoopMetricsEnabled(timing);
+    uv_idle_t idle;
+    uv_idle_init(dispatcher.uvLoop(), &idle);
+    uv_idle_start(&idle, [](uv_idle_t *) {});
+
+    bench::Stopwatch elapsed;
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        dispatcher.processEvents(QEventLoop::AllEvents);
+    }
+    bench::report("metrics/loop iteration", variant, iterations, elapsed.elapsedNs());
+
+    uv_close((uv_handle_t *)&idle, nullptr);
+    uv_run(dispatcher.uvLoop(), UV_RUN_NOWAIT);
+}
+
+}
+
+BENCHMARK_CASE(loopMetrics, "loop metrics: iteration cost with and without phase timing")
+{
+    runIterations("counters only", false);
+    runIterations("phase timing", true);
+}
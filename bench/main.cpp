@@ -0,0 +1,20 @@
+#include "benchmark.h"
+
+#include <QCoreApplication>
+
+#include <cstdio>
+#include <cstring>
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    const char *filter = argc > 1 ? argv[1] : nullptr;
+    for (const auto &benchmark : bench::cases()) {
+        if (filter && !std::strstr(benchmark.name, filter)) {
+            continue;
+        }
+        std::printf("# %s\n", benchmark.name);
+        benchmark.run();
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv_p.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Time to tear down the engines of a dispatcher with many handles registered, until the last
+// close callback ran. The libuv timers are also closed the way they used to be, stopped first
+// and in id order, which takes each out of the middle of libuv's timer heap.
+
+namespace {
+
+const int timerCounts[] = {100000, 1000000};
+const int maxSocketPairs = 50000;
+
+template <typename Engine>
+void finish(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &pools, std::unique_ptr<Engine> &engine,
+            const char *variant, int handles)
+{
+    bench::Stopwatch elapsed;
+    engine.reset();
+    do {
+        uv_run(loop, UV_RUN_NOWAIT);
+    } while (pools.pollWatchers.counters().inUse || pools.timerWatchers.counters().inUse);
+    bench::report("shutdown/teardown", variant, handles, elapsed.elapsedNs());
+}
+
+void runLibuvTimers(int count)
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    {
+        qtjs::EventDispatcherLibUvHandlePools pools;
+        std::unique_ptr<qtjs::EventDispatcherLibUvTimerNotifier> engine(
+            new qtjs::EventDispatcherLibUvTimerNotifier(&loop, nullptr, &pools.timerWatchers));
+        for (int i = 1; i <= count; ++i) {
+            engine->registerTimer(i, 1000 + i % 5000, [] {});
+        }
+        finish(&loop, pools, engine, count < 1000000 ? "libuv timers, 100k" : "libuv timers, 1M", count);
+    }
+    uv_loop_close(&loop);
+}
+
+void runStoppedLibuvTimers(int count)
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    std::vector<uv_timer_t> timers(count);
+    for (int i = 0; i < count; ++i) {
+        uv_timer_init(&loop, &timers[i]);
+        uv_timer_start(&timers[i], [](uv_timer_t *) {}, 1000 + (i + 1) % 5000, 0);
+    }
+    bench::Stopwatch elapsed;
+    for (uv_timer_t &timer : timers) {
+        uv_timer_stop(&timer);
+        uv_close((uv_handle_t *)&timer, nullptr);
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    bench::report("shutdown/teardown", count < 1000000 ? "stop and close in id order, 100k" : "stop and close in id order, 1M",
+                  count, elapsed.elapsedNs());
+    uv_loop_close(&loop);
+}
+
+void runTimerWheel(int count)
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    {
+        qtjs::EventDispatcherLibUvHandlePools pools;
+        std::unique_ptr<qtjs::EventDispatcherLibUvTimerWheel> engine(new qtjs::EventDispatcherLibUvTimerWheel(&loop));
+        for (int i = 1; i <= count; ++i) {
+            engine->registerTimer(i, 1000 + i % 5000, Qt::CoarseTimer, [] {});
+        }
+        finish(&loop, pools, engine, count < 1000000 ? "timer wheel, 100k" : "timer wheel, 1M", count);
+    }
+    uv_loop_close(&loop);
+}
+
+#ifdef Q_OS_LINUX
+void runTimerFd(int count)
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    {
+        qtjs::EventDispatcherLibUvHandlePools pools;
+        std::unique_ptr<qtjs::EventDispatcherLibUvTimerFdNotifier> engine(new qtjs::EventDispatcherLibUvTimerFdNotifier(&loop));
+        for (int i = 1; i <= count; ++i) {
+            engine->registerTimer(i, 1000 + i % 5000, [] {});
+        }
+        finish(&loop, pools, engine, count < 1000000 ? "timerfd, 100k" : "timerfd, 1M", count);
+    }
+    uv_loop_close(&loop);
+}
+#endif
+
+// as many descriptors as the process may open, leaving some for everything else
+int socketPairs()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) || RLIM_INFINITY == limit.rlim_cur) {
+        return maxSocketPairs;
+    }
+    return std::max(0, std::min<int>(maxSocketPairs, (int(limit.rlim_cur) - 256) / 2));
+}
+
+void runSocketWatchers()
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    std::vector<int> fds;
+    {
+        qtjs::EventDispatcherLibUvHandlePools pools;
+        std::unique_ptr<qtjs::EventDispatcherLibUvSocketNotifier> engine(
+            new qtjs::EventDispatcherLibUvSocketNotifier(&loop, nullptr, &pools.pollWatchers));
+        for (int i = socketPairs(); i > 0; --i) {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+                break;
+            }
+            fds.push_back(pair[0]);
+            fds.push_back(pair[1]);
+            engine->registerSocketNotifier(pair[0], QSocketNotifier::Read, [] {});
+        }
+        engine->commitPendingChanges();
+        uv_run(&loop, UV_RUN_NOWAIT);
+        finish(&loop, pools, engine, "socket watchers", fds.size() / 2);
+    }
+    uv_loop_close(&loop);
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+}
+
+BENCHMARK_CASE(shutdown, "shutdown: engine teardown with many handles")
+{
+    for (int count : timerCounts) {
+        runStoppedLibuvTimers(count);
+        runLibuvTimers(count);
+        runTimerWheel(count);
+#ifdef Q_OS_LINUX
+        runTimerFd(count);
+#endif
+    }
+    runSocketWatchers();
+}
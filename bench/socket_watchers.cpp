@@ -0,0 +1,97 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv_p.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// descriptors left over for the loop itself and the rest of the process
+const rlim_t reservedDescriptors = 64;
+
+rlim_t raiseDescriptorLimit()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit)) {
+        return 0;
+    }
+    if (limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return limit.rlim_cur > reservedDescriptors ? limit.rlim_cur - reservedDescriptors : 0;
+}
+
+// registers read notifiers on count socketpair ends, toggles write interest on and off and
+// unregisters them again, the cost per operation should not depend on the descriptor count.
+// Every toggle is committed on its own, as if it happened in an iteration of its own.
+void runSocketWatchers(int count)
+{
+    std::vector<int> fds;
+    for (int i = 0; i < count / 2; ++i) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+            break;
+        }
+        fds.push_back(pair[0]);
+        fds.push_back(pair[1]);
+    }
+    std::string label = std::to_string(fds.size()) + " fds";
+    const char *variant = label.c_str();
+
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    qtjs::EventDispatcherLibUvHandlePools pools;
+    {
+        qtjs::EventDispatcherLibUvSocketNotifier notifier(&loop, nullptr, &pools.pollWatchers);
+
+        bench::Stopwatch registration;
+        for (int fd : fds) {
+            notifier.registerSocketNotifier(fd, QSocketNotifier::Read, []{});
+        }
+        notifier.commitPendingChanges();
+        bench::report("sockets/register", variant, fds.size(), registration.elapsedNs());
+        uv_run(&loop, UV_RUN_NOWAIT);
+
+        bench::Stopwatch toggling;
+        for (int fd : fds) {
+            notifier.registerSocketNotifier(fd, QSocketNotifier::Write, []{});
+            notifier.commitPendingChanges();
+            notifier.unregisterSocketNotifier(fd, QSocketNotifier::Write);
+            notifier.commitPendingChanges();
+        }
+        bench::report("sockets/toggle write", variant, fds.size(), toggling.elapsedNs());
+
+        bench::Stopwatch unregistration;
+        for (int fd : fds) {
+            notifier.unregisterSocketNotifier(fd, QSocketNotifier::Read);
+        }
+        notifier.commitPendingChanges();
+        bench::report("sockets/unregister", variant, fds.size(), unregistration.elapsedNs());
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+}
+
+BENCHMARK_CASE(socketWatchers, "socket watchers: register/unregister as descriptors grow")
+{
+    rlim_t available = raiseDescriptorLimit();
+    for (rlim_t count : {1000, 10000, 50000}) {
+        runSocketWatchers(std::min(count, available));
+        if (count >= available) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,236 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv.h"
+#include "eventdispatcherlibuvtcpsocket.h"
+
+#include <QEventLoop>
+#include <QTcpSocket>
+#include <QThread>
+
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// EventDispatcherLibUvTcpSocket against QTcpSocket over loopback, both on a thread running an
+// EventDispatcherLibUv: bulk transfer, small messages written in bursts, and ping-pong round
+// trips. Both ends of a connection are sockets of the kind measured, on the same thread.
+
+namespace {
+
+const qint64 bulkBytes = qint64(256) * 1024 * 1024;
+const int bulkWriteSize = 64 * 1024;
+const qint64 bulkQueued = 1024 * 1024;
+const int messageSize = 64;
+const int messages = 200000;
+const int messagesPerBurst = 64;
+const int roundTrips = 20000;
+
+// a connected pair of descriptors, or false
+bool connectedPair(int fds[2])
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) || listen(listener, 1)
+            || getsockname(listener, (sockaddr *)&address, &length)) {
+        close(listener);
+        return false;
+    }
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fds[0], (sockaddr *)&address, sizeof(address))) {
+        close(fds[0]);
+        close(listener);
+        return false;
+    }
+    fds[1] = accept(listener, nullptr, nullptr);
+    close(listener);
+    int on = 1;
+    for (int index = 0; index < 2; ++index) {
+        setsockopt(fds[index], IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fds[1] >= 0;
+}
+
+void adopt(qtjs::EventDispatcherLibUvTcpSocket &socket, int fd)
+{
+    socket.setSocketDescriptor(fd);
+}
+
+void adopt(QTcpSocket &socket, int fd)
+{
+    socket.setSocketDescriptor(fd);
+}
+
+template <typename Socket>
+qint64 readAvailable(Socket &socket, std::vector<char> &buffer, bool)
+{
+    qint64 total = 0;
+    qint64 size;
+    while ((size = socket.read(buffer.data(), buffer.size())) > 0) {
+        total += size;
+    }
+    return total;
+}
+
+qint64 readAvailable(qtjs::EventDispatcherLibUvTcpSocket &socket, std::vector<char> &buffer, bool chunks)
+{
+    if (!chunks) {
+        return readAvailable<qtjs::EventDispatcherLibUvTcpSocket>(socket, buffer, false);
+    }
+    qint64 total = 0;
+    for (qtjs::EventDispatcherLibUvTcpSocket::Chunk chunk = socket.readChunk(); !chunk.isEmpty(); chunk = socket.readChunk()) {
+        total += chunk.size();
+    }
+    return total;
+}
+
+// the sender keeps up to bulkQueued bytes queued, the receiver reads whatever arrives
+template <typename Socket>
+void runBulk(const char *variant, bool chunks)
+{
+    int fds[2];
+    if (!connectedPair(fds)) {
+        return;
+    }
+    Socket sender;
+    Socket receiver;
+    adopt(sender, fds[0]);
+    adopt(receiver, fds[1]);
+    std::vector<char> block(bulkWriteSize, 'x');
+    std::vector<char> buffer(bulkWriteSize);
+    qint64 sent = 0;
+    qint64 received = 0;
+    QEventLoop loop;
+    auto fill = [&] {
+        while (sent < bulkBytes && sender.bytesToWrite() < bulkQueued) {
+            sender.write(block.data(), block.size());
+            sent += block.size();
+        }
+    };
+    QObject::connect(&sender, &QIODevice::bytesWritten, fill);
+    QObject::connect(&receiver, &QIODevice::readyRead, [&] {
+        received += readAvailable(receiver, buffer, chunks);
+        if (received >= bulkBytes) {
+            loop.quit();
+        }
+    });
+    bench::Stopwatch elapsed;
+    fill();
+    loop.exec();
+    bench::reportValue("tcp/bulk transfer", variant, bulkBytes / 1024.0 / 1024.0 * 1e9 / elapsed.elapsedNs(), "MB/s");
+}
+
+// bursts of small writes from one event each, the next burst once the previous one arrived
+template <typename Socket>
+void runBursts(const char *variant)
+{
+    int fds[2];
+    if (!connectedPair(fds)) {
+        return;
+    }
+    Socket sender;
+    Socket receiver;
+    adopt(sender, fds[0]);
+    adopt(receiver, fds[1]);
+    char message[messageSize] = {};
+    std::vector<char> buffer(64 * 1024);
+    int sent = 0;
+    qint64 received = 0;
+    QEventLoop loop;
+    auto burst = [&] {
+        for (int index = 0; index < messagesPerBurst && sent < messages; ++index, ++sent) {
+            sender.write(message, sizeof(message));
+        }
+    };
+    QObject::connect(&receiver, &QIODevice::readyRead, [&] {
+        received += readAvailable(receiver, buffer, false);
+        if (received == qint64(messages) * messageSize) {
+            loop.quit();
+        } else if (received == qint64(sent) * messageSize) {
+            burst();
+        }
+    });
+    bench::Stopwatch elapsed;
+    burst();
+    loop.exec();
+    bench::report("tcp/small messages in bursts", variant, messages, elapsed.elapsedNs());
+}
+
+// one message at a time, each echoed back before the next
+template <typename Socket>
+void runPingPong(const char *variant)
+{
+    int fds[2];
+    if (!connectedPair(fds)) {
+        return;
+    }
+    Socket client;
+    Socket server;
+    adopt(client, fds[0]);
+    adopt(server, fds[1]);
+    char message[messageSize] = {};
+    std::vector<char> buffer(64 * 1024);
+    qint64 pending = 0;
+    int trips = 0;
+    std::vector<double> latencies;
+    latencies.reserve(roundTrips);
+    QEventLoop loop;
+    bench::Stopwatch elapsed;
+    bench::Stopwatch trip;
+    QObject::connect(&server, &QIODevice::readyRead, [&] {
+        qint64 size = readAvailable(server, buffer, false);
+        server.write(buffer.data(), size);
+    });
+    QObject::connect(&client, &QIODevice::readyRead, [&] {
+        pending -= readAvailable(client, buffer, false);
+        if (pending) {
+            return;
+        }
+        latencies.push_back(trip.elapsedNs() / 1000.0);
+        if (++trips == roundTrips) {
+            loop.quit();
+            return;
+        }
+        trip.restart();
+        pending = client.write(message, sizeof(message));
+    });
+    pending = client.write(message, sizeof(message));
+    loop.exec();
+    bench::report("tcp/ping-pong round trips", variant, roundTrips, elapsed.elapsedNs());
+    bench::reportPercentiles("tcp/ping-pong round trip", variant, latencies, "us");
+}
+
+class SocketThread : public QThread {
+public:
+    SocketThread()
+    {
+        setEventDispatcher(new qtjs::EventDispatcherLibUv(qtjs::EventDispatcherLibUv::CreatePrivateLoop));
+    }
+
+protected:
+    void run() override
+    {
+        runBulk<qtjs::EventDispatcherLibUvTcpSocket>("EventDispatcherLibUvTcpSocket read()", false);
+        runBulk<qtjs::EventDispatcherLibUvTcpSocket>("EventDispatcherLibUvTcpSocket readChunk()", true);
+        runBulk<QTcpSocket>("QTcpSocket read()", false);
+        runBursts<qtjs::EventDispatcherLibUvTcpSocket>("EventDispatcherLibUvTcpSocket");
+        runBursts<QTcpSocket>("QTcpSocket");
+        runPingPong<qtjs::EventDispatcherLibUvTcpSocket>("EventDispatcherLibUvTcpSocket");
+        runPingPong<QTcpSocket>("QTcpSocket");
+    }
+};
+
+}
+
+BENCHMARK_CASE(tcpSocket, "tcp: EventDispatcherLibUvTcpSocket against QTcpSocket on loopback")
+{
+    SocketThread thread;
+    thread.start();
+    thread.wait();
+}
@@ -0,0 +1,121 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv.h"
+
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <vector>
+
+// Blocking work handed to a threadpool from a dispatcher thread, with the result delivered back
+// to that thread: through uv_queue_work and its after-work callback, and through
+// QtConcurrent::run with a QFutureWatcher, the way Qt code does it. libuv runs 4 threadpool
+// threads unless UV_THREADPOOL_SIZE says otherwise, QThreadPool one per core.
+
+namespace {
+
+const int tasks = 20000;
+const int inFlight = 64;
+const int sequentialTasks = 2000;
+const int workUs = 5;
+
+int work()
+{
+    bench::Stopwatch elapsed;
+    int spins = 0;
+    while (elapsed.elapsedNs() < workUs * 1000) {
+        ++spins;
+    }
+    return spins;
+}
+
+class WorkThread : public QThread {
+public:
+    WorkThread() : dispatcher(new qtjs::EventDispatcherLibUv(qtjs::EventDispatcherLibUv::CreatePrivateLoop))
+    {
+        setEventDispatcher(dispatcher);
+    }
+
+protected:
+    void run() override
+    {
+        runThroughput("uv_queue_work", [this](QObject *receiver, std::function<void()> finished) {
+            dispatcher->queueWork(receiver, &work, [finished](int) { finished(); });
+        });
+        runThroughput("QtConcurrent + QFutureWatcher", &runConcurrent);
+        runLatency("uv_queue_work", [this](QObject *receiver, std::function<void()> finished) {
+            dispatcher->queueWork(receiver, &work, [finished](int) { finished(); });
+        });
+        runLatency("QtConcurrent + QFutureWatcher", &runConcurrent);
+    }
+
+private:
+    typedef std::function<void(QObject *, std::function<void()>)> Submit;
+
+    static void runConcurrent(QObject *receiver, std::function<void()> finished)
+    {
+        QFutureWatcher<int> *watcher = new QFutureWatcher<int>(receiver);
+        QObject::connect(watcher, &QFutureWatcher<int>::finished, receiver, [watcher, finished] {
+            watcher->deleteLater();
+            finished();
+        });
+        watcher->setFuture(QtConcurrent::run(&work));
+    }
+
+    // keeps inFlight tasks going, each finished one starts the next
+    void runThroughput(const char *variant, Submit submit)
+    {
+        QObject receiver;
+        QEventLoop loop;
+        int submitted = 0;
+        int finished = 0;
+        std::function<void()> next = [&] {
+            if (++finished == tasks) {
+                loop.quit();
+            } else if (submitted < tasks) {
+                ++submitted;
+                submit(&receiver, next);
+            }
+        };
+        bench::Stopwatch elapsed;
+        for (; submitted < inFlight; ++submitted) {
+            submit(&receiver, next);
+        }
+        loop.exec();
+        bench::report("threadpool/work with results", variant, tasks, elapsed.elapsedNs());
+    }
+
+    // one task at a time, from submitting it to its result on this thread
+    void runLatency(const char *variant, Submit submit)
+    {
+        QObject receiver;
+        QEventLoop loop;
+        std::vector<double> latencies;
+        bench::Stopwatch elapsed;
+        std::function<void()> next = [&] {
+            latencies.push_back(elapsed.elapsedNs() / 1000.0 - workUs);
+            if (latencies.size() == sequentialTasks) {
+                loop.quit();
+                return;
+            }
+            elapsed.restart();
+            submit(&receiver, next);
+        };
+        submit(&receiver, next);
+        loop.exec();
+        bench::reportPercentiles("threadpool/round trip overhead", variant, latencies, "us");
+    }
+
+    qtjs::EventDispatcherLibUv *dispatcher;
+};
+
+}
+
+BENCHMARK_CASE(threadpoolWork, "threadpool work: uv_queue_work against QtConcurrent with QFutureWatcher")
+{
+    WorkThread thread;
+    thread.start();
+    thread.wait();
+}
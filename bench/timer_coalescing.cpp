@@ -0,0 +1,45 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv_p.h"
+
+#include <random>
+
+namespace {
+
+// idle-heavy server: many timers of a few seconds, loop wakeups counted for a fixed period
+void runCoalescing(const char *variant, Qt::TimerType timerType)
+{
+    const int count = 10000;
+    const double period = 3e9;
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    {
+        qtjs::EventDispatcherLibUvTimerWheel wheel(&loop);
+        std::mt19937 random(count);
+        std::uniform_int_distribution<int> intervals(1000, 10000);
+        for (int timerId = 0; timerId < count; ++timerId) {
+            wheel.registerTimer(timerId, intervals(random), timerType, []{});
+        }
+
+        uint64_t iterations = 0;
+        bench::Stopwatch elapsed;
+        while (elapsed.elapsedNs() < period) {
+            uv_run(&loop, UV_RUN_ONCE);
+            ++iterations;
+        }
+        bench::reportValue("timers/loop wakeups", variant, iterations * 1e9 / elapsed.elapsedNs(), "wakeups/s");
+        bench::reportValue("timers/expirations per wakeup", variant,
+                           wheel.wakeups() ? double(wheel.expirations()) / wheel.wakeups() : 0, "timers");
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+}
+
+}
+
+BENCHMARK_CASE(timerCoalescing, "timer coalescing by Qt::TimerType")
+{
+    runCoalescing("precise", Qt::PreciseTimer);
+    runCoalescing("coarse", Qt::CoarseTimer);
+    runCoalescing("very coarse", Qt::VeryCoarseTimer);
+}
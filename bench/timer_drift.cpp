@@ -0,0 +1,96 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv_p.h"
+
+#include <cmath>
+#include <memory>
+
+// How far a repeating timer is off its period after a while, with callbacks that take part of
+// the period each. Re-arming relative to the callback adds up, the engines keep the phase.
+
+namespace {
+
+const int interval = 5;
+const int periods = 400;
+
+struct Drift {
+    uint64_t started;
+    uint64_t lastFired;
+    int fired;
+};
+
+void registerTimer(qtjs::EventDispatcherLibUvTimerNotifier &engine, int timerId, qtjs::EventDispatcherLibUvCallback callback)
+{
+    engine.registerTimer(timerId, interval, callback);
+}
+
+void registerTimer(qtjs::EventDispatcherLibUvTimerWheel &engine, int timerId, qtjs::EventDispatcherLibUvCallback callback)
+{
+    engine.registerTimer(timerId, interval, Qt::PreciseTimer, callback);
+}
+
+qtjs::EventDispatcherLibUvTimerNotifier *createEngine(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &pools, qtjs::EventDispatcherLibUvTimerNotifier *)
+{
+    return new qtjs::EventDispatcherLibUvTimerNotifier(loop, nullptr, &pools.timerWatchers);
+}
+
+qtjs::EventDispatcherLibUvTimerWheel *createEngine(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &, qtjs::EventDispatcherLibUvTimerWheel *)
+{
+    return new qtjs::EventDispatcherLibUvTimerWheel(loop);
+}
+
+#ifdef Q_OS_LINUX
+void registerTimer(qtjs::EventDispatcherLibUvTimerFdNotifier &engine, int timerId, qtjs::EventDispatcherLibUvCallback callback)
+{
+    engine.registerTimer(timerId, interval, callback);
+}
+
+qtjs::EventDispatcherLibUvTimerFdNotifier *createEngine(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &, qtjs::EventDispatcherLibUvTimerFdNotifier *)
+{
+    return new qtjs::EventDispatcherLibUvTimerFdNotifier(loop);
+}
+#endif
+
+template <typename Engine>
+void runDrift(const char *variant)
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    qtjs::EventDispatcherLibUvHandlePools pools;
+    {
+        std::unique_ptr<Engine> engine(createEngine(&loop, pools, static_cast<Engine *>(nullptr)));
+        Drift drift = {uv_hrtime(), 0, 0};
+        registerTimer(*engine, 1, [&drift] {
+            drift.lastFired = uv_hrtime();
+            // 0.5 to 2.5ms of work
+            uint64_t busyUntil = drift.lastFired + (500 + (drift.fired % 5) * 500) * 1000;
+            while (uv_hrtime() < busyUntil) {
+            }
+            ++drift.fired;
+        });
+        while (drift.fired < periods) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+        engine->unregisterTimer(1);
+        // a machine too busy to run the loop makes a timer skip whole periods, which puts it
+        // behind without taking it off its phase
+        double period = interval * 1e6;
+        double behind = double(drift.lastFired - drift.started) - periods * period;
+        double offPhase = behind - std::round(behind / period) * period;
+        bench::reportValue("timers/behind after 400 periods", variant, behind / 1e6, "ms");
+        bench::reportValue("timers/off phase after 400", variant, offPhase / 1e6, "ms");
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+}
+
+}
+
+BENCHMARK_CASE(timerDrift, "repeating timers: drift off the period")
+{
+    runDrift<qtjs::EventDispatcherLibUvTimerNotifier>("libuv timer");
+    runDrift<qtjs::EventDispatcherLibUvTimerWheel>("wheel");
+#ifdef Q_OS_LINUX
+    runDrift<qtjs::EventDispatcherLibUvTimerFdNotifier>("timerfd");
+#endif
+}
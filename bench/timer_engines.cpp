@@ -0,0 +1,85 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv_p.h"
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// the per-handle pool has to outlive the engine until the loop ran its close callbacks
+qtjs::EventDispatcherLibUvTimerNotifier *createEngine(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &pools, qtjs::EventDispatcherLibUvTimerNotifier *)
+{
+    return new qtjs::EventDispatcherLibUvTimerNotifier(loop, nullptr, &pools.timerWatchers);
+}
+
+qtjs::EventDispatcherLibUvTimerWheel *createEngine(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &, qtjs::EventDispatcherLibUvTimerWheel *)
+{
+    return new qtjs::EventDispatcherLibUvTimerWheel(loop);
+}
+
+void registerTimer(qtjs::EventDispatcherLibUvTimerNotifier &engine, int timerId, int interval, qtjs::EventDispatcherLibUvCallback callback)
+{
+    engine.registerTimer(timerId, interval, callback);
+}
+
+void registerTimer(qtjs::EventDispatcherLibUvTimerWheel &engine, int timerId, int interval, qtjs::EventDispatcherLibUvCallback callback)
+{
+    engine.registerTimer(timerId, interval, Qt::PreciseTimer, callback);
+}
+
+// registers count timers spread over [500, 1000) ms, lets each of them fire once and unregisters them again
+template <typename Engine>
+void runTimerEngine(const char *engineName, int count)
+{
+    std::string label = std::string(engineName) + " " + std::to_string(count);
+    const char *variant = label.c_str();
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    qtjs::EventDispatcherLibUvHandlePools pools;
+    {
+        std::unique_ptr<Engine> enginePtr(createEngine(&loop, pools, static_cast<Engine *>(nullptr)));
+        Engine &engine = *enginePtr;
+        std::mt19937 random(count);
+        std::uniform_int_distribution<int> intervals(500, 999);
+        std::vector<char> fired(count, 0);
+        int firedCount = 0;
+
+        bench::Stopwatch registration;
+        for (int timerId = 0; timerId < count; ++timerId) {
+            registerTimer(engine, timerId, intervals(random), [timerId, &fired, &firedCount] {
+                if (!fired[timerId]) {
+                    fired[timerId] = 1;
+                    ++firedCount;
+                }
+            });
+        }
+        bench::report("timers/register", variant, count, registration.elapsedNs());
+
+        bench::CpuStopwatch expiry;
+        while (firedCount < count) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+        bench::report("timers/fire (cpu)", variant, count, expiry.elapsedNs());
+
+        bench::Stopwatch unregistration;
+        for (int timerId = 0; timerId < count; ++timerId) {
+            engine.unregisterTimer(timerId);
+        }
+        bench::report("timers/unregister", variant, count, unregistration.elapsedNs());
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+}
+
+}
+
+BENCHMARK_CASE(timerEngines, "timer engines: per-handle vs wheel")
+{
+    for (int count : {10000, 100000, 1000000}) {
+        runTimerEngine<qtjs::EventDispatcherLibUvTimerNotifier>("per-handle", count);
+        runTimerEngine<qtjs::EventDispatcherLibUvTimerWheel>("wheel", count);
+    }
+}
@@ -0,0 +1,90 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv_p.h"
+
+#include <memory>
+#include <vector>
+
+// Lateness of precise timers, from the deadline to the callback, with a libuv timer per timer
+// and with the timerfd; negative values are early. Timers are started from a callback as in a
+// running application, where libuv's cached loop time is already behind.
+
+namespace {
+
+const int samples = 2000;
+
+struct Probe {
+    uint64_t firedAt;
+    bool fired;
+};
+
+void registerTimer(qtjs::EventDispatcherLibUvTimerNotifier &engine, int timerId, int interval, qtjs::EventDispatcherLibUvCallback callback)
+{
+    engine.registerTimer(timerId, interval, callback);
+}
+
+qtjs::EventDispatcherLibUvTimerNotifier *createEngine(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &pools, qtjs::EventDispatcherLibUvTimerNotifier *)
+{
+    return new qtjs::EventDispatcherLibUvTimerNotifier(loop, nullptr, &pools.timerWatchers);
+}
+
+#ifdef Q_OS_LINUX
+void registerTimer(qtjs::EventDispatcherLibUvTimerFdNotifier &engine, int timerId, int interval, qtjs::EventDispatcherLibUvCallback callback)
+{
+    engine.registerTimer(timerId, interval, callback);
+}
+
+qtjs::EventDispatcherLibUvTimerFdNotifier *createEngine(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &, qtjs::EventDispatcherLibUvTimerFdNotifier *)
+{
+    return new qtjs::EventDispatcherLibUvTimerFdNotifier(loop);
+}
+#endif
+
+template <typename Engine>
+void runJitter(const char *variant)
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    qtjs::EventDispatcherLibUvHandlePools pools;
+    {
+        std::unique_ptr<Engine> engine(createEngine(&loop, pools, static_cast<Engine *>(nullptr)));
+        std::vector<double> lateness;
+        int early = 0;
+        Probe probe;
+        for (int sample = 0; sample < samples; ++sample) {
+            int interval = 1 + sample % 5;
+            probe.fired = false;
+            // spend part of a millisecond in "a callback" first
+            uint64_t busyUntil = uv_hrtime() + (sample % 7) * 100000;
+            while (uv_hrtime() < busyUntil) {
+            }
+            uint64_t deadline = uv_hrtime() + uint64_t(interval) * 1000000;
+            registerTimer(*engine, sample, interval, [&probe] {
+                probe.firedAt = uv_hrtime();
+                probe.fired = true;
+            });
+            while (!probe.fired) {
+                uv_run(&loop, UV_RUN_ONCE);
+            }
+            engine->unregisterTimer(sample);
+            lateness.push_back((double(probe.firedAt) - double(deadline)) / 1000.0);
+            if (probe.firedAt < deadline) {
+                ++early;
+            }
+        }
+        bench::reportPercentiles("timers/precise lateness", variant, lateness, "us");
+        bench::reportValue("timers/precise fired early", variant, 100.0 * early / samples, "%");
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+}
+
+}
+
+BENCHMARK_CASE(timerJitter, "precise timers: lateness of libuv timers vs timerfd")
+{
+    runJitter<qtjs::EventDispatcherLibUvTimerNotifier>("libuv timer");
+#ifdef Q_OS_LINUX
+    runJitter<qtjs::EventDispatcherLibUvTimerFdNotifier>("timerfd");
+#endif
+}
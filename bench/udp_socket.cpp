@@ -0,0 +1,206 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv.h"
+#include "eventdispatcherlibuvudpsocket.h"
+
+#include <QEventLoop>
+#include <QHostAddress>
+#include <QThread>
+#include <QTimer>
+#include <QUdpSocket>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Datagrams per second through EventDispatcherLibUvUdpSocket, with batches of 64 and of 1, and
+// through QUdpSocket, all on a thread running an EventDispatcherLibUv over loopback. Received:
+// a plain thread floods the socket for a second, with sendmmsg on Linux, and what does not fit
+// the socket buffer in time is lost. Sent: bursts of writes from posted tasks to a socket nobody
+// reads.
+
+namespace {
+
+const int datagramSize = 64;
+const int floodBatch = 64;
+const int floodMs = 1000;
+const int sentDatagrams = 500000;
+const int burst = 64;
+
+sockaddr_in loopback(quint16 port)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return address;
+}
+
+// sends until stopped, returns how many datagrams went out
+quint64 flood(quint16 port, const std::atomic<bool> &stop)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = loopback(port);
+    if (connect(fd, (sockaddr *)&address, sizeof(address))) {
+        close(fd);
+        return 0;
+    }
+    char payload[datagramSize] = {};
+    quint64 sent = 0;
+#ifdef Q_OS_LINUX
+    std::vector<iovec> vectors(floodBatch, iovec{payload, sizeof(payload)});
+    std::vector<mmsghdr> headers(floodBatch);
+    for (int index = 0; index < floodBatch; ++index) {
+        memset(&headers[index], 0, sizeof(mmsghdr));
+        headers[index].msg_hdr.msg_iov = &vectors[index];
+        headers[index].msg_hdr.msg_iovlen = 1;
+    }
+    while (!stop.load(std::memory_order_relaxed)) {
+        int count = sendmmsg(fd, headers.data(), floodBatch, 0);
+        if (count > 0) {
+            sent += count;
+        }
+    }
+#else
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (send(fd, payload, sizeof(payload), 0) > 0) {
+            ++sent;
+        }
+    }
+#endif
+    close(fd);
+    return sent;
+}
+
+template <typename Receive>
+void runReceive(const char *variant, quint16 port, Receive &&received)
+{
+    std::atomic<bool> stop(false);
+    quint64 sent = 0;
+    QEventLoop loop;
+    QTimer::singleShot(floodMs, &loop, &QEventLoop::quit);
+    std::thread sender([&] { sent = flood(port, stop); });
+    bench::Stopwatch elapsed;
+    loop.exec();
+    double ns = elapsed.elapsedNs();
+    stop = true;
+    sender.join();
+    quint64 count = received();
+    bench::reportValue("udp/received", variant, count * 1e9 / ns, "datagrams/s");
+    if (sent) {
+        bench::reportValue("udp/lost", variant, 100.0 * (sent - std::min(sent, count)) / sent, "%");
+    }
+}
+
+void runLibuvReceive(const char *variant, int batchSize)
+{
+    qtjs::EventDispatcherLibUvUdpSocket socket(batchSize, datagramSize);
+    if (!socket.bind("127.0.0.1", 0)) {
+        return;
+    }
+    quint64 count = 0;
+    std::vector<qtjs::EventDispatcherLibUvUdpSocket::Datagram> datagrams(batchSize);
+    QObject::connect(&socket, &qtjs::EventDispatcherLibUvUdpSocket::readyRead, [&] {
+        count += socket.readDatagrams(datagrams.data(), batchSize);
+    });
+    runReceive(variant, socket.localPort(), [&count] { return count; });
+}
+
+void runQtReceive()
+{
+    QUdpSocket socket;
+    if (!socket.bind(QHostAddress::LocalHost, 0)) {
+        return;
+    }
+    quint64 count = 0;
+    char buffer[datagramSize];
+    QObject::connect(&socket, &QUdpSocket::readyRead, [&] {
+        while (socket.hasPendingDatagrams()) {
+            socket.readDatagram(buffer, sizeof(buffer));
+            ++count;
+        }
+    });
+    runReceive("QUdpSocket", socket.localPort(), [&count] { return count; });
+}
+
+// a burst per posted task, until all datagrams are written
+void runSend(const char *variant, qtjs::EventDispatcherLibUv *dispatcher, std::function<void()> write, std::function<void()> flush)
+{
+    QEventLoop loop;
+    int written = 0;
+    std::function<void()> next = [&] {
+        for (int index = 0; index < burst; ++index) {
+            write();
+        }
+        written += burst;
+        if (written < sentDatagrams) {
+            dispatcher->post(next);
+        } else {
+            flush();
+            loop.quit();
+        }
+    };
+    bench::Stopwatch elapsed;
+    dispatcher->post(next);
+    loop.exec();
+    bench::report("udp/sent", variant, written, elapsed.elapsedNs());
+}
+
+class UdpThread : public QThread {
+public:
+    UdpThread() : dispatcher(new qtjs::EventDispatcherLibUv(qtjs::EventDispatcherLibUv::CreatePrivateLoop))
+    {
+        setEventDispatcher(dispatcher);
+    }
+
+protected:
+    void run() override
+    {
+        runLibuvReceive("EventDispatcherLibUvUdpSocket, batches of 64", 64);
+        runLibuvReceive("EventDispatcherLibUvUdpSocket, batches of 1", 1);
+        runQtReceive();
+
+        int sink = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in address = loopback(0);
+        socklen_t size = sizeof(address);
+        if (bind(sink, (sockaddr *)&address, sizeof(address)) || getsockname(sink, (sockaddr *)&address, &size)) {
+            close(sink);
+            return;
+        }
+        char payload[datagramSize] = {};
+        {
+            qtjs::EventDispatcherLibUvUdpSocket socket(burst, datagramSize);
+            runSend("EventDispatcherLibUvUdpSocket", dispatcher, [&] {
+                socket.writeDatagram(payload, sizeof(payload), (const sockaddr *)&address);
+            }, [&] {
+                socket.flush();
+            });
+        }
+        {
+            QUdpSocket socket;
+            quint16 port = ntohs(address.sin_port);
+            runSend("QUdpSocket", dispatcher, [&] {
+                socket.writeDatagram(payload, sizeof(payload), QHostAddress::LocalHost, port);
+            }, [] {});
+        }
+        close(sink);
+    }
+
+private:
+    qtjs::EventDispatcherLibUv *dispatcher;
+};
+
+}
+
+BENCHMARK_CASE(udpSocket, "udp: batched EventDispatcherLibUvUdpSocket against QUdpSocket on loopback")
+{
+    UdpThread thread;
+    thread.start();
+    thread.wait();
+}
@@ -0,0 +1,110 @@
+#include "benchmark.h"
+
+#include "eventdispatcherlibuv_p.h"
+
+#include <memory>
+
+// QTimer::singleShot(0, ...) in a loop: each timer unregisters itself when it fires and starts
+// the next one, once with a libuv timer per 0 ms timer and once through the ready queue. libuv
+// runs a timer started from a timer callback with timeout 0 in the same pass, so the per-handle
+// chain never leaves uv_run and starves everything else; the queue fires one link per iteration.
+// A burst of timers started together is measured as well.
+
+namespace {
+
+const int chainLength = 200000;
+const int burstSize = 10000;
+const int bursts = 20;
+
+void registerTimer(qtjs::EventDispatcherLibUvTimerNotifier &engine, int timerId, qtjs::EventDispatcherLibUvCallback callback)
+{
+    engine.registerTimer(timerId, 0, callback);
+}
+
+void registerTimer(qtjs::EventDispatcherLibUvZeroTimerQueue &engine, int timerId, qtjs::EventDispatcherLibUvCallback callback)
+{
+    engine.registerTimer(timerId, callback);
+}
+
+qtjs::EventDispatcherLibUvTimerNotifier *createEngine(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &pools, qtjs::EventDispatcherLibUvTimerNotifier *)
+{
+    return new qtjs::EventDispatcherLibUvTimerNotifier(loop, nullptr, &pools.timerWatchers);
+}
+
+qtjs::EventDispatcherLibUvZeroTimerQueue *createEngine(uv_loop_t *loop, qtjs::EventDispatcherLibUvHandlePools &, qtjs::EventDispatcherLibUvZeroTimerQueue *)
+{
+    return new qtjs::EventDispatcherLibUvZeroTimerQueue(loop);
+}
+
+template <typename Engine>
+struct SingleShot {
+    Engine *engine;
+    int timerId;
+    int *fired;
+    void operator()() const
+    {
+        engine->unregisterTimer(timerId);
+        ++*fired;
+    }
+};
+
+template <typename Engine>
+struct Chain {
+    Engine *engine;
+    int *timerId;
+    int *fired;
+    void operator()() const
+    {
+        engine->unregisterTimer(*timerId);
+        if (++*fired < chainLength) {
+            ++*timerId;
+            registerTimer(*engine, *timerId, *this);
+        }
+    }
+};
+
+template <typename Engine>
+void runZeroTimers(const char *variant)
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    qtjs::EventDispatcherLibUvHandlePools pools;
+    {
+        std::unique_ptr<Engine> engine(createEngine(&loop, pools, static_cast<Engine *>(nullptr)));
+
+        int timerId = 0;
+        int fired = 0;
+        registerTimer(*engine, timerId, Chain<Engine>{engine.get(), &timerId, &fired});
+        int iterations = 0;
+        bench::Stopwatch chain;
+        while (fired < chainLength) {
+            uv_run(&loop, UV_RUN_ONCE);
+            ++iterations;
+        }
+        bench::report("timers/0 ms single shot chain", variant, chainLength, chain.elapsedNs());
+        bench::reportValue("timers/0 ms chain per iteration", variant, double(chainLength) / iterations, "timers");
+
+        fired = 0;
+        bench::Stopwatch burst;
+        for (int round = 0; round < bursts; ++round) {
+            for (int timer = 0; timer < burstSize; ++timer) {
+                int id = chainLength + round * burstSize + timer;
+                registerTimer(*engine, id, SingleShot<Engine>{engine.get(), id, &fired});
+            }
+            while (fired < (round + 1) * burstSize) {
+                uv_run(&loop, UV_RUN_ONCE);
+            }
+        }
+        bench::report("timers/0 ms single shot burst", variant, uint64_t(burstSize) * bursts, burst.elapsedNs());
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+}
+
+}
+
+BENCHMARK_CASE(zeroTimers, "zero-interval timers: per-handle vs ready queue")
+{
+    runZeroTimers<qtjs::EventDispatcherLibUvTimerNotifier>("per-handle");
+    runZeroTimers<qtjs::EventDispatcherLibUvZeroTimerQueue>("ready queue");
+}
@@ -1,14 +1,26 @@
 
 #include <catch.hpp>
 
+#include "eventdispatcherlibuvgroup.h"
+#include "eventdispatcherlibuvtcpsocket.h"
+#include "eventdispatcherlibuvudpsocket.h"
+
+#include <QHostAddress>
+#include <QSocketNotifier>
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QThread>
 #include <QTimer>
 
+#include <atomic>
 #include <chrono>
+#include <cstring>
 #include <functional>
 #include <thread>
 
+#include <sys/socket.h>
+#include <uv.h>
+
 
 namespace {
 
@@ -76,6 +88,20 @@ TEST_CASE("libuv based event dispatcher") {
         REQUIRE ( count == 1 );
     }
 
+    SECTION("it keeps other timers running beside a repeating 0 ms timer") {
+        uint64_t zeroCount = 0;
+        bool processed = false;
+        QTimer zeroTimer;
+        QObject::connect(&zeroTimer, &QTimer::timeout, [&zeroCount]{ ++zeroCount; });
+        zeroTimer.start(0);
+        QTimer::singleShot(5, [&processed]{ processed = true; });
+        processAppEvents(*global.app, processed, 1);
+        zeroTimer.stop();
+
+        REQUIRE ( processed );
+        REQUIRE ( zeroCount > 1 );
+    }
+
     SECTION("it supports disconnect by QObject") {
         TimerTestObject obj;
         obj.startTimer(1);
@@ -125,6 +151,172 @@ TEST_CASE("libuv based event dispatcher") {
         alarm.join();
     }
 
+    SECTION("it runs a private libuv loop on a worker thread") {
+        QThread worker;
+        auto *dispatcher = new qtjs::EventDispatcherLibUv(qtjs::EventDispatcherLibUv::CreatePrivateLoop);
+        worker.setEventDispatcher(dispatcher);
+        REQUIRE( dispatcher->uvLoop() != global.ev_dispatcher->uvLoop() );
+
+        std::atomic<bool> fired(false);
+        QTimer timer;
+        timer.setSingleShot(true);
+        timer.moveToThread(&worker);
+        QObject::connect(&timer, &QTimer::timeout, [&fired]{ fired = true; });
+        QObject::connect(&worker, &QThread::started, &timer, [&timer]{ timer.start(1); });
+        worker.start();
+
+        processAppEvents(*global.app, [&fired]{ return fired.load(); }, 1);
+        worker.quit();
+        REQUIRE( worker.wait(1000) );
+    }
+
+    SECTION("it blocks an idle worker thread on its private loop") {
+        QThread worker;
+        auto *dispatcher = new qtjs::EventDispatcherLibUv(qtjs::EventDispatcherLibUv::CreatePrivateLoop);
+        worker.setEventDispatcher(dispatcher);
+
+        std::atomic<int> iterations(0);
+        QObject::connect(dispatcher, &QAbstractEventDispatcher::awake, [&iterations]{ ++iterations; });
+        worker.start();
+        usleep(100000);
+        worker.quit();
+        REQUIRE( worker.wait(1000) );
+
+        // a loop returning right away would have gone round many thousands of times
+        REQUIRE( iterations < 10 );
+    }
+
+    SECTION("it dispatches exception notifiers for urgent tcp data") {
+        QTcpServer server;
+        REQUIRE( server.listen(QHostAddress::LocalHost) );
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, server.serverPort());
+        REQUIRE( client.waitForConnected(1000) );
+        REQUIRE( server.waitForNewConnection(1000) );
+        QTcpSocket *accepted = server.nextPendingConnection();
+
+        bool processed = false;
+        QSocketNotifier urgent(accepted->socketDescriptor(), QSocketNotifier::Exception);
+        QObject::connect(&urgent, &QSocketNotifier::activated, [&processed, &urgent]{
+            processed = true;
+            urgent.setEnabled(false);
+        });
+        REQUIRE( send(client.socketDescriptor(), "!", 1, MSG_OOB) == 1 );
+        processAppEvents(*global.app, processed, 1);
+
+        REQUIRE( processed );
+    }
+
+    SECTION("it accepts connections on the threads of a dispatcher group") {
+        qtjs::EventDispatcherLibUvGroup group(2);
+        std::atomic<QThread *> acceptedOn(nullptr);
+        REQUIRE( group.listen("127.0.0.1", 0, qtjs::EventDispatcherLibUvGroup::ReusePortShards, [&acceptedOn](int, int fd) {
+            close(fd);
+            acceptedOn = QThread::currentThread();
+        }) );
+
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, group.serverPort());
+        REQUIRE( client.waitForConnected(1000) );
+        processAppEvents(*global.app, [&acceptedOn]{ return acceptedOn.load() != nullptr; }, 1);
+
+        REQUIRE( (acceptedOn == group.thread(0) || acceptedOn == group.thread(1)) );
+    }
+
+    SECTION("it hands descriptors over to a thread of a dispatcher group") {
+        qtjs::EventDispatcherLibUvGroup group(2);
+        std::atomic<QThread *> ranOn(nullptr);
+        std::atomic<int> handedOver(-1);
+        group.handOver(1, 42, [&ranOn, &handedOver](int fd) {
+            handedOver = fd;
+            ranOn = QThread::currentThread();
+        });
+        processAppEvents(*global.app, [&ranOn]{ return ranOn.load() != nullptr; }, 1);
+
+        REQUIRE( ranOn == group.thread(1) );
+        REQUIRE( handedOver == 42 );
+    }
+
+    SECTION("it talks to a QTcpServer through a libuv tcp socket") {
+        QTcpServer server;
+        launchServer(server);
+
+        bool processed = false;
+        QByteArray result;
+        qtjs::EventDispatcherLibUvTcpSocket client;
+        REQUIRE( client.isValid() );
+        QObject::connect(&client, &qtjs::EventDispatcherLibUvTcpSocket::connected, [&client]{
+            client.write("test", 4);
+        });
+        QObject::connect(&client, &QIODevice::readyRead, [&client, &result, &processed]{
+            result += client.readAll();
+            processed = result.size() == 4;
+        });
+        client.connectToHost("127.0.0.1", server.serverPort());
+        processAppEvents(*global.app, processed, 1);
+
+        REQUIRE_THAT( result.constData(), Equals("test") );
+        REQUIRE( global.ev_dispatcher->poolStatistics().readBuffers.inUse == 1 );
+    }
+
+    SECTION("it leaves a libuv tcp socket closed when its connect fails right away") {
+        qtjs::EventDispatcherLibUvTcpSocket client;
+        int error = 0;
+        QObject::connect(&client, &qtjs::EventDispatcherLibUvTcpSocket::errorOccurred, [&error](int code){
+            error = code;
+        });
+        client.connectToHost("not an address", 80);
+
+        REQUIRE( error == UV_EINVAL );
+        REQUIRE_FALSE( client.isOpen() );
+        REQUIRE( client.state() == qtjs::EventDispatcherLibUvTcpSocket::UnconnectedState );
+    }
+
+    SECTION("it stops reading a libuv tcp socket at its read buffer size") {
+        QTcpServer server;
+        REQUIRE( server.listen(QHostAddress::LocalHost) );
+        const int size = 4 << 20;
+        QObject::connect(&server, &QTcpServer::newConnection, [&server, size]{
+            server.nextPendingConnection()->write(QByteArray(size, 'x'));
+        });
+
+        qtjs::EventDispatcherLibUvTcpSocket client;
+        client.setReadBufferSize(65536);
+        client.connectToHost("127.0.0.1", server.serverPort());
+        processAppEvents(*global.app, [&client]{ return client.bytesAvailable() >= 65536; }, 1);
+        bool waited = false;
+        QTimer::singleShot(50, [&waited]{ waited = true; });
+        processAppEvents(*global.app, waited, 1);
+        // a read may go over the limit, but no further one follows while nothing is taken
+        REQUIRE( client.bytesAvailable() < 2 * 65536 );
+
+        qint64 received = 0;
+        processAppEvents(*global.app, [&client, &received, size]{
+            received += client.readAll().size();
+            return received == size;
+        }, 2);
+    }
+
+    SECTION("it receives the datagrams of a readiness event as one batch") {
+        qtjs::EventDispatcherLibUvUdpSocket receiver;
+        REQUIRE( receiver.bind("127.0.0.1", 0) );
+        qtjs::EventDispatcherLibUvUdpSocket sender;
+        REQUIRE( sender.connectToHost("127.0.0.1", receiver.localPort()) );
+
+        int batches = 0;
+        QObject::connect(&receiver, &qtjs::EventDispatcherLibUvUdpSocket::readyRead, [&batches]{ ++batches; });
+        for (const char *datagram : {"one", "two", "three"}) {
+            REQUIRE( sender.writeDatagram(datagram, strlen(datagram)) );
+        }
+        REQUIRE( sender.datagramsToWrite() == 3 );
+        processAppEvents(*global.app, [&receiver]{ return receiver.pendingDatagramCount() == 3; }, 1);
+
+        qtjs::EventDispatcherLibUvUdpSocket::Datagram datagrams[4];
+        REQUIRE( receiver.readDatagrams(datagrams, 4) == 3 );
+        REQUIRE( QByteArray(datagrams[2].data, datagrams[2].size) == "three" );
+        REQUIRE( batches == 1 );
+    }
+
     SECTION("it supports finalising the app when libuv finishes") {
         using namespace std::chrono;
         steady_clock::time_point started = steady_clock::now();
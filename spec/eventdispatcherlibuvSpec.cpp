@@ -4,6 +4,8 @@
 
 #include <QSocketNotifier>
 
+#include <poll.h>
+
 
 MOCK_BASE_CLASS( MockedLibuvApi, qtjs::LibuvApi ) {
     MOCK_METHOD(uv_poll_init, 3)
@@ -14,16 +16,42 @@ MOCK_BASE_CLASS( MockedLibuvApi, qtjs::LibuvApi ) {
     MOCK_METHOD(uv_timer_start, 4)
     MOCK_METHOD(uv_timer_stop, 1)
 
+    MOCK_METHOD(uv_check_init, 2)
+    MOCK_METHOD(uv_check_start, 2)
+    MOCK_METHOD(uv_check_stop, 1)
+
+    MOCK_METHOD(uv_idle_init, 2)
+    MOCK_METHOD(uv_idle_start, 2)
+    MOCK_METHOD(uv_idle_stop, 1)
+
     MOCK_METHOD(uv_hrtime, 0)
+    MOCK_METHOD(uv_now, 1)
 
     MOCK_METHOD(uv_close, 2)
 
     MOCK_METHOD(uv_async_init, 3)
     MOCK_METHOD(uv_async_send, 1)
 
+    MOCK_METHOD(uv_ref, 1)
     MOCK_METHOD(uv_unref, 1)
+
+    MOCK_METHOD(uv_queue_work, 4)
+    MOCK_METHOD(uv_cancel, 1)
 };
 
+// the specs inject mocks, so they use the notifiers built on the virtual LibuvApi
+typedef qtjs::EventDispatcherLibUvBasicSocketNotifier<qtjs::LibuvApi> SocketNotifier;
+typedef qtjs::EventDispatcherLibUvBasicTimerNotifier<qtjs::LibuvApi> TimerNotifier;
+typedef qtjs::EventDispatcherLibUvBasicTimerWheel<qtjs::LibuvApi> TimerWheel;
+typedef qtjs::EventDispatcherLibUvBasicZeroTimerQueue<qtjs::LibuvApi> ZeroTimerQueue;
+typedef qtjs::EventDispatcherLibUvBasicStreamRegistry<qtjs::LibuvApi> StreamRegistry;
+#ifdef Q_OS_LINUX
+typedef qtjs::EventDispatcherLibUvBasicTimerFdNotifier<qtjs::LibuvApi> TimerFdNotifier;
+#endif
+typedef qtjs::EventDispatcherLibUvTimerTracker TimerTracker;
+typedef qtjs::EventDispatcherLibUvBasicAsyncChannel<qtjs::LibuvApi> AsyncChannel;
+typedef qtjs::EventDispatcherLibUvBasicWorkQueue<qtjs::LibuvApi> WorkQueue;
+
 namespace {
 
 struct PollMocker {
@@ -75,6 +103,40 @@ struct TimerMocker {
     void verifyAndReset();
 };
 
+struct WheelMocker {
+    uv_timer_t *driverHandle;
+    uint64_t now, due;
+    bool armed;
+    MockedLibuvApi *api;
+
+    WheelMocker(MockedLibuvApi *api);
+    ~WheelMocker();
+    void advanceTo(TimerWheel &wheel, uint64_t time);
+};
+
+struct ZeroTimerMocker {
+    uv_check_t *checkHandle;
+    uv_idle_t *idleHandle;
+    bool checking, idling;
+    MockedLibuvApi *api;
+
+    ZeroTimerMocker(MockedLibuvApi *api);
+    ~ZeroTimerMocker();
+};
+
+#ifdef Q_OS_LINUX
+struct TimerFdMocker {
+    uv_poll_t *pollHandle;
+    int fd;
+    uint64_t now;
+    bool polling;
+    MockedLibuvApi *api;
+
+    TimerFdMocker(MockedLibuvApi *api);
+    ~TimerFdMocker();
+};
+#endif
+
 }
 
 TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
@@ -85,8 +147,9 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         PollMocker mocker(api);
         mocker.mockInitAndExecute(19, UV_READABLE);
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
         dispatcher.registerSocketNotifier(19, QSocketNotifier::Read, []{});
+        dispatcher.commitPendingChanges();
 
         mocker.checkHandles();
     }
@@ -97,12 +160,33 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         PollMocker mocker(api);
         mocker.mockInitAndExecute(20, UV_WRITABLE);
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
         dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
+        dispatcher.commitPendingChanges();
 
         mocker.checkHandles();
     }
 
+    SECTION("registerSocketNotifier initialises libuv handle on the given loop")
+    {
+        uv_loop_t loop;
+        uv_poll_t *registeredHandle = nullptr;
+        MockedLibuvApi *api = new MockedLibuvApi();
+        MOCK_EXPECT( api->uv_poll_init ).once()
+                .with( mock::equal(&loop), mock::retrieve(registeredHandle), mock::equal(19) )
+                .returns(0);
+        MOCK_EXPECT( api->uv_poll_start ).returns(0);
+        MOCK_EXPECT( api->uv_poll_stop ).returns(0);
+        MOCK_EXPECT( api->uv_close );
+
+        {
+            SocketNotifier dispatcher(&loop, api);
+            dispatcher.registerSocketNotifier(19, QSocketNotifier::Read, []{});
+        }
+
+        REQUIRE( registeredHandle );
+    }
+
     SECTION("unregisterSocketNotifier stops uv poller for a registered handle")
     {
         MockedLibuvApi *api = new MockedLibuvApi();
@@ -110,9 +194,11 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         mocker.mockInitAndExecute(20, UV_WRITABLE);
         mocker.mockStop();
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
         dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
+        dispatcher.commitPendingChanges();
         dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
+        dispatcher.commitPendingChanges();
 
         mocker.checkHandles();
     }
@@ -124,8 +210,9 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         mocker.mockInitAndExecute(20, UV_WRITABLE);
         mocker.mockStop();
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
         dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
+        dispatcher.commitPendingChanges();
     }
 
     SECTION("unregisterSocketNotifier does not call libuv if the socket was not registered")
@@ -134,7 +221,7 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
 
         MOCK_EXPECT( api->uv_poll_stop ).never();
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
         dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
     }
 
@@ -145,12 +232,97 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         mocker.mockInitAndExecute(20, UV_WRITABLE);
         mocker.mockStop();
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
+        dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
+        dispatcher.commitPendingChanges();
+        dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
+        dispatcher.commitPendingChanges();
+        dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
+        dispatcher.commitPendingChanges();
+
+        mocker.checkHandles();
+    }
+
+    SECTION("it hands only the net change of an iteration to libuv")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        PollMocker mocker(api);
+        mocker.mockInitAndExecute(20, UV_READABLE);
+
+        SocketNotifier dispatcher(uv_default_loop(), api);
+        dispatcher.registerSocketNotifier(20, QSocketNotifier::Read, []{});
+        REQUIRE( dispatcher.commitPendingChanges() );
+        mocker.checkHandles();
+        mocker.verifyAndReset();
+
+        MOCK_RESET( api->uv_poll_stop );
+        MOCK_EXPECT( api->uv_poll_start ).never();
+        MOCK_EXPECT( api->uv_poll_stop ).never();
         dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
         dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
+        REQUIRE_FALSE( dispatcher.commitPendingChanges() );
+        REQUIRE( dispatcher.pollStarts() == 1 );
+        REQUIRE( dispatcher.pollStops() == 0 );
+        MOCK_VERIFY( api->uv_poll_start );
+        MOCK_RESET( api->uv_poll_start );
+        MOCK_RESET( api->uv_poll_stop );
+        mocker.mockImplicitStopClose();
+    }
+
+    SECTION("it keeps unregistered watchers dormant and restarts them")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        PollMocker mocker(api);
+        mocker.mockInitAndExecute(20, UV_WRITABLE);
+        mocker.mockStop();
+        MOCK_RESET( api->uv_close );
+        MOCK_EXPECT( api->uv_close ).never();
+
+        SocketNotifier dispatcher(uv_default_loop(), api);
+        dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
+        dispatcher.commitPendingChanges();
         dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
+        dispatcher.commitPendingChanges();
+        mocker.checkHandles();
+        mocker.verifyAndReset();
+        MOCK_VERIFY( api->uv_close );
+        MOCK_RESET( api->uv_close );
+        mocker.mockImplicitStopClose();
+
+        // no new handle to initialise
+        mocker.mockStart(UV_READABLE);
+        dispatcher.registerSocketNotifier(20, QSocketNotifier::Read, []{});
+        dispatcher.commitPendingChanges();
+        mocker.checkHandles();
+        mocker.verifyAndReset();
+    }
+
+    SECTION("it restarts the watcher of a descriptor closed and reused within an iteration")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        PollMocker mocker(api);
+        mocker.mockInitAndExecute(20, UV_READABLE);
+
+        SocketNotifier dispatcher(uv_default_loop(), api);
+        dispatcher.registerSocketNotifier(20, QSocketNotifier::Read, []{});
+        dispatcher.commitPendingChanges();
+        mocker.checkHandles();
+        mocker.verifyAndReset();
+
+        // the socket disables its notifier and closes the descriptor, which takes it out of
+        // the backend, so libuv has to be told before an accept gets the same number
+        mocker.mockStop();
+        dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Read);
+        mocker.checkHandles();
+        mocker.verifyAndReset();
 
+        mocker.mockStart(UV_READABLE);
+        dispatcher.registerSocketNotifier(20, QSocketNotifier::Read, []{});
+        REQUIRE( dispatcher.commitPendingChanges() );
         mocker.checkHandles();
+        mocker.verifyAndReset();
+        REQUIRE( dispatcher.pollStarts() == 2 );
+        REQUIRE( dispatcher.pollStops() == 1 );
     }
 
     SECTION("socket watcher invokes read callback")
@@ -187,6 +359,70 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         REQUIRE( callbackInvoked == 1 );
     }
 
+    SECTION("socket watcher skips the callbacks unregistered by an earlier one of the same events")
+    {
+        int callbackInvoked = 0;
+        qtjs::SocketCallbacks callbacks = {
+            UV_READABLE | UV_WRITABLE | UV_PRIORITIZED,
+            [&callbackInvoked, &callbacks]{
+                callbackInvoked++;
+                callbacks.eventMask = UV_READABLE;
+            },
+            []{ FAIL("unexpected call"); },
+            []{ FAIL("unexpected call"); }
+        };
+
+        uv_poll_t request;
+        request.data = &callbacks;
+
+        qtjs::uv_socket_watcher(&request, 0, UV_READABLE | UV_WRITABLE | UV_PRIORITIZED);
+
+        REQUIRE( callbackInvoked == 1 );
+    }
+
+    SECTION("socket watcher invokes exception callback for prioritized events")
+    {
+        int callbackInvoked = 0;
+        qtjs::SocketCallbacks callbacks = {
+            UV_READABLE | UV_PRIORITIZED,
+            []{},
+            []{ FAIL("unexpected call"); },
+            [&callbackInvoked]{ callbackInvoked++; }
+        };
+
+        uv_poll_t request;
+        request.data = &callbacks;
+
+        qtjs::uv_socket_watcher(&request, 0, UV_PRIORITIZED);
+
+        REQUIRE( callbackInvoked == 1 );
+    }
+
+    SECTION("registerSocketNotifier polls for prioritized events on exception notifiers")
+    {
+        int callbackInvoked = 0;
+        MockedLibuvApi *api = new MockedLibuvApi();
+        PollMocker mocker(api);
+        mocker.mockInitAndExecute(21, UV_READABLE | UV_PRIORITIZED);
+
+        SocketNotifier dispatcher(uv_default_loop(), api);
+        dispatcher.registerSocketNotifier(21, QSocketNotifier::Read, []{});
+        dispatcher.registerSocketNotifier(21, QSocketNotifier::Exception, [&callbackInvoked]{ callbackInvoked++; });
+        dispatcher.commitPendingChanges();
+
+        mocker.checkHandles();
+        ((qtjs::SocketCallbacks *)mocker.startedHandle->data)->exceptionAvailable();
+        REQUIRE( callbackInvoked == 1 );
+        mocker.verifyAndReset();
+
+        mocker.mockStart(UV_READABLE);
+
+        dispatcher.unregisterSocketNotifier(21, QSocketNotifier::Exception);
+        dispatcher.commitPendingChanges();
+
+        mocker.checkHandles();
+        mocker.verifyAndReset();
+    }
 
     SECTION("registerSocketNotifier initialises libuv handle read callback")
     {
@@ -195,8 +431,9 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         PollMocker mocker(api);
         mocker.mockInitAndExecute(19, UV_READABLE);
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
         dispatcher.registerSocketNotifier(19, QSocketNotifier::Read, [&callbackInvoked]{ callbackInvoked++; });
+        dispatcher.commitPendingChanges();
 
         mocker.checkHandles();
         REQUIRE( mocker.startedHandle->data );
@@ -212,8 +449,9 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         PollMocker mocker(api);
         mocker.mockInitAndExecute(19, UV_WRITABLE);
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
         dispatcher.registerSocketNotifier(19, QSocketNotifier::Write, [&callbackInvoked]{ callbackInvoked++; });
+        dispatcher.commitPendingChanges();
 
         mocker.checkHandles();
         REQUIRE( mocker.startedHandle->data );
@@ -227,12 +465,12 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         int callbackInvoked = 0;
         MockedLibuvApi *api = new MockedLibuvApi();
         PollMocker mocker(api);
-        mocker.mockInitAndExecute(19, UV_READABLE);
-        mocker.mockStart(UV_WRITABLE);
+        mocker.mockInitAndExecute(19, UV_READABLE | UV_WRITABLE);
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
         dispatcher.registerSocketNotifier(19, QSocketNotifier::Read, [&callbackInvoked]{ callbackInvoked++; });
         dispatcher.registerSocketNotifier(19, QSocketNotifier::Write, [&callbackInvoked]{ callbackInvoked++; });
+        dispatcher.commitPendingChanges();
 
         mocker.checkHandles();
         REQUIRE( mocker.startedHandle->data );
@@ -248,34 +486,87 @@ TEST_CASE("EventDispatcherLibUv supports QSocketNotifier registration")
         MockedLibuvApi *api = new MockedLibuvApi();
         PollMocker mocker(api);
         mocker.mockInitAndExecute(20, UV_WRITABLE);
-        mocker.mockStart(UV_READABLE);
+        mocker.mockStart(UV_READABLE | UV_WRITABLE);
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
+        SocketNotifier dispatcher(uv_default_loop(), api);
         dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
+        dispatcher.commitPendingChanges();
         dispatcher.registerSocketNotifier(20, QSocketNotifier::Read, []{});
+        dispatcher.commitPendingChanges();
 
         mocker.checkHandles();
         mocker.verifyAndReset();
 
-        mocker.mockStop();
+        // starting a handle again replaces its events, no need to stop it first
         mocker.mockStart(UV_READABLE);
 
         dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
+        dispatcher.commitPendingChanges();
 
         mocker.checkHandles();
         mocker.verifyAndReset();
     }
 
-    SECTION("unregisterSocketNotifier calls uv_close before deallocation")
+    SECTION("socket watchers are taken from the pool and returned to it on close")
+    {
+        qtjs::EventDispatcherLibUvPool<qtjs::PollWatcher> pool;
+        uv_handle_t *closedHandle = nullptr;
+        uv_close_cb closeCallback = nullptr;
+        MockedLibuvApi *api = new MockedLibuvApi();
+        MOCK_EXPECT( api->uv_poll_init ).returns(0);
+        MOCK_EXPECT( api->uv_poll_start ).returns(0);
+        MOCK_EXPECT( api->uv_poll_stop ).returns(0);
+        MOCK_EXPECT( api->uv_close ).once()
+            .with( mock::retrieve(closedHandle), mock::retrieve(closeCallback) );
+
+        {
+            SocketNotifier dispatcher(uv_default_loop(), api, &pool);
+            dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
+            dispatcher.commitPendingChanges();
+            REQUIRE( pool.counters().inUse == 1 );
+
+            dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
+            dispatcher.commitPendingChanges();
+            REQUIRE( pool.counters().inUse == 1 );
+        }
+        REQUIRE( pool.counters().inUse == 1 );
+        closeCallback(closedHandle);
+        REQUIRE( pool.counters().inUse == 0 );
+        REQUIRE( pool.counters().highWaterMark == 1 );
+    }
+
+    SECTION("it closes polling watchers on destruction, closing stops them")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        PollMocker mocker(api);
+        mocker.mockInit(20);
+        mocker.mockStart(UV_READABLE);
+        mocker.mockClose();
+        MOCK_EXPECT( api->uv_poll_stop ).never();
+
+        {
+            SocketNotifier dispatcher(uv_default_loop(), api);
+            dispatcher.registerSocketNotifier(20, QSocketNotifier::Read, []{});
+            dispatcher.commitPendingChanges();
+        }
+
+        mocker.checkHandles();
+    }
+
+    SECTION("it calls uv_close on its watchers before deallocation")
     {
         MockedLibuvApi *api = new MockedLibuvApi();
         PollMocker mocker(api);
         mocker.mockInitAndExecute(20, UV_WRITABLE);
         mocker.mockClose();
 
-        qtjs::EventDispatcherLibUvSocketNotifier dispatcher(api);
-        dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
-        dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
+        {
+            SocketNotifier dispatcher(uv_default_loop(), api);
+            dispatcher.registerSocketNotifier(20, QSocketNotifier::Write, []{});
+            dispatcher.commitPendingChanges();
+            dispatcher.unregisterSocketNotifier(20, QSocketNotifier::Write);
+            dispatcher.commitPendingChanges();
+        }
 
         mocker.checkHandles();
     }
@@ -291,7 +582,7 @@ TEST_CASE("EventDispatcherLibUv async wakeups")
         mocker.mockClose();
 
         {
-            qtjs::EventDispatcherLibUvAsyncChannel channel(api);
+            AsyncChannel channel(uv_default_loop(), api);
         }
 
         mocker.checkHandles();
@@ -305,165 +596,1356 @@ TEST_CASE("EventDispatcherLibUv async wakeups")
         mocker.mockAsyncSend();
 
         {
-            qtjs::EventDispatcherLibUvAsyncChannel channel(api);
+            AsyncChannel channel(uv_default_loop(), api);
             channel.send();
         }
 
         mocker.checkHandles();
     }
-}
 
-TEST_CASE("EventDispatcherLibUv supports QTimer registration")
-{
-    SECTION("it does not unregister a non-existing timer")
+    SECTION("it keeps the loop alive until the last reference is dropped")
     {
         MockedLibuvApi *api = new MockedLibuvApi();
-        qtjs::EventDispatcherLibUvTimerNotifier dispatcher(api);
+        AsyncMocker mocker(api);
+        mocker.mockInit();
 
-        REQUIRE( dispatcher.unregisterTimer(83) == false );
+        {
+            AsyncChannel channel(uv_default_loop(), api);
+            MOCK_EXPECT(api->uv_ref).once().with( mock::equal((uv_handle_t*)mocker.registeredHandle) );
+            channel.ref();
+            channel.ref();
+            MOCK_VERIFY(api->uv_ref);
+
+            MOCK_RESET(api->uv_unref);
+            MOCK_EXPECT(api->uv_unref).never();
+            channel.unref();
+            MOCK_VERIFY(api->uv_unref);
+
+            MOCK_RESET(api->uv_unref);
+            MOCK_EXPECT(api->uv_unref).once().with( mock::equal((uv_handle_t*)mocker.registeredHandle) );
+            channel.unref();
+            MOCK_VERIFY(api->uv_unref);
+        }
+
+        mocker.checkHandles();
     }
 
-    SECTION("it unregisters a registered timer once")
+    SECTION("it runs posted tasks from the async callback")
     {
         MockedLibuvApi *api = new MockedLibuvApi();
-        qtjs::EventDispatcherLibUvTimerNotifier dispatcher(api);
-
-        TimerMocker mocker(api);
+        AsyncMocker mocker(api);
         mocker.mockInit();
-        mocker.mockStart(30);
-        mocker.mockStop();
+        mocker.mockAsyncSend();
 
-        dispatcher.registerTimer(83, 30, []{});
-        REQUIRE( dispatcher.unregisterTimer(83) == true );
-        REQUIRE( dispatcher.unregisterTimer(83) == false );
+        std::vector<int> ran;
+        {
+            AsyncChannel channel(uv_default_loop(), api);
+            channel.post([&ran]{ ran.push_back(1); });
+            channel.post([&ran]{ ran.push_back(2); });
+            REQUIRE( ran.empty() );
+
+            qtjs::uv_async_watcher(mocker.registeredHandle);
+        }
 
+        REQUIRE( ran == std::vector<int>({1, 2}) );
         mocker.checkHandles();
     }
 
-    SECTION("it unregisters a registered timer on destruction")
+    SECTION("it wakes the loop again for tasks posted after the queue was drained")
     {
         MockedLibuvApi *api = new MockedLibuvApi();
-        qtjs::EventDispatcherLibUvTimerNotifier dispatcher(api);
-
-        TimerMocker mocker(api);
+        AsyncMocker mocker(api);
         mocker.mockInit();
-        mocker.mockStart(30);
-        mocker.mockStop();
+        MOCK_EXPECT(api->uv_async_send).exactly(2).returns(0);
 
-        dispatcher.registerTimer(83, 30, []{});
+        int ran = 0;
+        {
+            AsyncChannel channel(uv_default_loop(), api);
+            REQUIRE( channel.post([&ran]{ ++ran; }) );
+            REQUIRE_FALSE( channel.post([&ran]{ ++ran; }) );
+            qtjs::uv_async_watcher(mocker.registeredHandle);
+            REQUIRE( channel.post([&ran]{ ++ran; }) );
+            qtjs::uv_async_watcher(mocker.registeredHandle);
+        }
+
+        REQUIRE( ran == 3 );
     }
+}
 
-    SECTION("timer watcher invokes timeout callback")
-    {
-        int callbackInvoked = 0;
-        qtjs::TimerData data = {
-            [&callbackInvoked]{ callbackInvoked++; }
-        };
+namespace {
 
-        uv_timer_t request;
-        request.data = &data;
+// stands in for the platform dispatcher of a GUI thread, it records the timeout timer of the bridge
+class PlatformDispatcherStub : public QAbstractEventDispatcher {
+public:
+    PlatformDispatcherStub() : timeout(-1) {}
+    virtual bool processEvents(QEventLoop::ProcessEventsFlags) { return false; }
+    virtual bool hasPendingEvents(void) { return false; }
+    virtual void registerSocketNotifier(QSocketNotifier*) {}
+    virtual void unregisterSocketNotifier(QSocketNotifier*) {}
+    virtual void registerTimer(int, int interval, Qt::TimerType, QObject*) { timeout = interval; }
+    virtual bool unregisterTimer(int) { timeout = -1; return true; }
+    virtual bool unregisterTimers(QObject*) { timeout = -1; return true; }
+    virtual QList<TimerInfo> registeredTimers(QObject*) const { return QList<TimerInfo>(); }
+    virtual int remainingTime(int) { return timeout; }
+    virtual void wakeUp(void) {}
+    virtual void interrupt(void) {}
+    virtual void flush(void) {}
+#ifdef Q_OS_WIN
+    virtual bool registerEventNotifier(QWinEventNotifier*) { return false; }
+    virtual void unregisterEventNotifier(QWinEventNotifier*) {}
+#endif
+    int timeout;
+};
 
-        qtjs::uv_timer_watcher(&request);
+}
 
-        REQUIRE( callbackInvoked == 1 );
-    }
+TEST_CASE("EventDispatcherLibUv shares the wait of a GUI thread with the platform dispatcher")
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    PlatformDispatcherStub platform;
 
-    SECTION("registerTimer initialises timeout callback")
+    SECTION("it lets an idle GUI thread block without a timeout")
     {
-        int callbackInvoked = 0;
-        MockedLibuvApi *api = new MockedLibuvApi();
-        TimerMocker mocker(api);
-        mocker.mockInit();
-        mocker.mockStart(30);
-
-        qtjs::EventDispatcherLibUvTimerNotifier dispatcher(api);
-        dispatcher.registerTimer(83, 30, [&callbackInvoked]{ callbackInvoked++; });
-
-        mocker.checkHandles();
-        REQUIRE( mocker.startedHandle->data );
-        ((qtjs::TimerData *)mocker.startedHandle->data)->timeout();
-        REQUIRE( callbackInvoked == 1 );
+        uv_async_t wakeup;
+        uv_async_init(&loop, &wakeup, [](uv_async_t*){});
+        uv_unref((uv_handle_t*)&wakeup);
+        {
+            qtjs::EventDispatcherLibUvPlatformBridge bridge(&loop, &platform);
+            REQUIRE( bridge.prepareWait() );
+            REQUIRE( platform.timeout == -1 );
+        }
+        uv_close((uv_handle_t*)&wakeup, nullptr);
     }
 
-    SECTION("calls uv_close before deallocating timer handle")
+    SECTION("it arms the platform timer for the next libuv timer")
     {
-        MockedLibuvApi *api = new MockedLibuvApi();
-        TimerMocker mocker(api);
-        mocker.mockInit();
-        mocker.mockStart(30);
-        mocker.mockStop();
-        mocker.mockClose();
+        uv_timer_t timer;
+        uv_timer_init(&loop, &timer);
+        uv_timer_start(&timer, [](uv_timer_t*){}, 5000, 0);
+        {
+            qtjs::EventDispatcherLibUvPlatformBridge bridge(&loop, &platform);
+            REQUIRE( bridge.prepareWait() );
+            REQUIRE( platform.timeout > 4000 );
+            REQUIRE( platform.timeout <= 5000 );
+        }
+        REQUIRE( platform.timeout == -1 );
+        uv_close((uv_handle_t*)&timer, nullptr);
+    }
 
-        qtjs::EventDispatcherLibUvTimerNotifier dispatcher(api);
-        dispatcher.registerTimer(83, 30, []{});
-        dispatcher.unregisterTimer(83);
+    SECTION("it keeps the platform from blocking while libuv has work pending")
+    {
+        uv_idle_t idle;
+        uv_idle_init(&loop, &idle);
+        uv_idle_start(&idle, [](uv_idle_t*){});
+        {
+            qtjs::EventDispatcherLibUvPlatformBridge bridge(&loop, &platform);
+            REQUIRE_FALSE( bridge.prepareWait() );
+        }
+        uv_close((uv_handle_t*)&idle, nullptr);
+    }
 
-        mocker.checkHandles();
+#ifdef Q_OS_LINUX
+    SECTION("it hands a precise timer started after the last poll to the backend before the platform waits")
+    {
+        uv_run(&loop, UV_RUN_NOWAIT);
+        {
+            // as from a posted event, the timerfd watcher starts once libuv polled
+            qtjs::EventDispatcherLibUvTimerFdNotifier timers(&loop);
+            timers.registerTimer(1, 1, []{});
+            qtjs::EventDispatcherLibUvPlatformBridge bridge(&loop, &platform);
+            REQUIRE( bridge.prepareWait() );
+
+            // the platform blocks on the backend fd, which has to wake it for the timer
+            pollfd backend = {uv_backend_fd(&loop), POLLIN, 0};
+            REQUIRE( ::poll(&backend, 1, 1000) == 1 );
+        }
     }
+#endif
 
+    uv_run(&loop, UV_RUN_NOWAIT);
+    REQUIRE( uv_loop_close(&loop) == 0 );
 }
 
-TEST_CASE("EventDispatcherLibUv tracks timer execution")
+TEST_CASE("EventDispatcherLibUv runs work on the libuv threadpool")
 {
-    SECTION("TimerWatcher returns empty list when there are no timers registered")
+    uv_work_t *queued = nullptr;
+    uv_work_cb workCallback = nullptr;
+    uv_after_work_cb afterWorkCallback = nullptr;
+    auto mockQueueWork = [&queued, &workCallback, &afterWorkCallback](MockedLibuvApi *api) {
+        MOCK_EXPECT( api->uv_queue_work )
+            .calls([&queued, &workCallback, &afterWorkCallback](uv_loop_t *, uv_work_t *request, uv_work_cb work, uv_after_work_cb afterWork) {
+                queued = request;
+                workCallback = work;
+                afterWorkCallback = afterWork;
+                return 0;
+            });
+    };
+    int ran = 0;
+    int done = 0;
+
+    SECTION("it runs the work on the threadpool and done from the after-work callback")
     {
-        qtjs::EventDispatcherLibUvTimerTracker watcher;
-        REQUIRE( watcher.getTimerInfo(nullptr).empty() );
+        MockedLibuvApi *api = new MockedLibuvApi();
+        mockQueueWork(api);
+        WorkQueue queue(uv_default_loop(), api);
+
+        REQUIRE( queue.queueWork(nullptr, [&ran]{ ++ran; }, [&done]{ ++done; }) );
+        REQUIRE( queued );
+        workCallback(queued);
+        REQUIRE( ran == 1 );
+        REQUIRE( done == 0 );
+
+        afterWorkCallback(queued, 0);
+        REQUIRE( done == 1 );
+        REQUIRE( queue.size() == 0 );
+        REQUIRE( queue.completed() == 1 );
     }
 
-    SECTION("TimerWatcher returns a list of registered timers for object")
+    SECTION("it drops done when the receiver was destroyed meanwhile")
     {
-        qtjs::EventDispatcherLibUvTimerTracker watcher;
-        watcher.registerTimer(12, 101, Qt::CoarseTimer, (QObject *)919192);
-        auto list = watcher.getTimerInfo((QObject *)919192);
-        REQUIRE( list.count() == 1 );
-        REQUIRE( list.back().timerId == 12 );
-        REQUIRE( list.back().interval == 101 );
-        REQUIRE( list.back().timerType == Qt::CoarseTimer );
+        MockedLibuvApi *api = new MockedLibuvApi();
+        mockQueueWork(api);
+        WorkQueue queue(uv_default_loop(), api);
+        QObject *receiver = new QObject();
+
+        queue.queueWork(receiver, [&ran]{ ++ran; }, [&done]{ ++done; });
+        workCallback(queued);
+        delete receiver;
+        afterWorkCallback(queued, 0);
+
+        REQUIRE( ran == 1 );
+        REQUIRE( done == 0 );
+        REQUIRE( queue.dropped() == 1 );
     }
 
-    SECTION("TimerWatcher returns time left until next firing at the start")
+    SECTION("it cancels work that did not start yet")
     {
         MockedLibuvApi *api = new MockedLibuvApi();
-        qtjs::EventDispatcherLibUvTimerTracker watcher(api);
+        mockQueueWork(api);
+        WorkQueue queue(uv_default_loop(), api);
 
-        uint64_t returnedValues[] = {1000000, 3000000},
-                 *pReturnedValues = returnedValues;
-
-        MOCK_EXPECT( api->uv_hrtime ).exactly(2)
-            .calls([&pReturnedValues]() { return *pReturnedValues++; });
-
-        watcher.registerTimer(12, 5, Qt::CoarseTimer, (QObject *)919192);
+        int workId = queue.queueWork(nullptr, [&ran]{ ++ran; }, [&done]{ ++done; });
+        MOCK_EXPECT( api->uv_cancel ).once()
+            .with( mock::equal((uv_req_t *)queued) )
+            .returns(0);
+        REQUIRE( queue.cancelWork(workId) );
+        afterWorkCallback(queued, UV_ECANCELED);
 
-        REQUIRE( watcher.remainingTime(12) == 3 );
+        REQUIRE( ran == 0 );
+        REQUIRE( done == 0 );
+        REQUIRE( queue.size() == 0 );
     }
 
-    SECTION("TimerWatcher returns time left until next firing after firing")
+    SECTION("it drops done of cancelled work that runs already")
     {
         MockedLibuvApi *api = new MockedLibuvApi();
-        qtjs::EventDispatcherLibUvTimerTracker watcher(api);
-
-        uint64_t returnedValues[] = {1000000, 3000000, 4000000},
-                 *pReturnedValues = returnedValues;
+        mockQueueWork(api);
+        WorkQueue queue(uv_default_loop(), api);
 
-        MOCK_EXPECT( api->uv_hrtime ).exactly(3)
-            .calls([&pReturnedValues]() { return *pReturnedValues++; });
+        int workId = queue.queueWork(nullptr, [&ran]{ ++ran; }, [&done]{ ++done; });
+        MOCK_EXPECT( api->uv_cancel ).once().returns(UV_EBUSY);
+        REQUIRE_FALSE( queue.cancelWork(workId) );
+        workCallback(queued);
+        afterWorkCallback(queued, 0);
 
-        watcher.registerTimer(12, 5, Qt::CoarseTimer, (QObject *)919192);
-
-        watcher.fireTimer(12);
-
-        REQUIRE( watcher.remainingTime(12) == 4 );
+        REQUIRE( ran == 1 );
+        REQUIRE( done == 0 );
     }
 
-    SECTION("TimerWatcher unregisters timerinfo")
+    SECTION("it leaves work finishing after the queue went away to the after-work callback")
     {
-        qtjs::EventDispatcherLibUvTimerTracker watcher;
-        watcher.registerTimer(12, 101, Qt::CoarseTimer, (QObject *)919192);
-        watcher.unregisterTimer(12);
-        REQUIRE( watcher.getTimerInfo((QObject *)919192).empty() );
-    }
-
+        MockedLibuvApi *api = new MockedLibuvApi();
+        mockQueueWork(api);
+        MOCK_EXPECT( api->uv_cancel ).returns(UV_EBUSY);
+        {
+            WorkQueue queue(uv_default_loop(), api);
+            queue.queueWork(nullptr, [&ran]{ ++ran; }, [&done]{ ++done; });
+        }
+        workCallback(queued);
+        afterWorkCallback(queued, 0);
+
+        REQUIRE( ran == 1 );
+        REQUIRE( done == 0 );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv supports QTimer registration")
+{
+    SECTION("it does not unregister a non-existing timer")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerNotifier dispatcher(uv_default_loop(), api);
+
+        REQUIRE( dispatcher.unregisterTimer(83) == false );
+    }
+
+    SECTION("it unregisters a registered timer once")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerNotifier dispatcher(uv_default_loop(), api);
+
+        TimerMocker mocker(api);
+        mocker.mockInit();
+        mocker.mockStart(30);
+        mocker.mockStop();
+
+        dispatcher.registerTimer(83, 30, []{});
+        REQUIRE( dispatcher.unregisterTimer(83) == true );
+        REQUIRE( dispatcher.unregisterTimer(83) == false );
+
+        mocker.checkHandles();
+    }
+
+    SECTION("it reports the time left until the deadline a timer was started for")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerNotifier dispatcher(uv_default_loop(), api);
+
+        TimerMocker mocker(api);
+        mocker.mockInit();
+        mocker.mockStart(30);
+
+        dispatcher.registerTimer(83, 30, []{});
+        REQUIRE( dispatcher.remainingTime(83) == 30 );
+        MOCK_RESET( api->uv_now );
+        MOCK_EXPECT( api->uv_now ).returns(1012);
+        REQUIRE( dispatcher.remainingTime(83) == 18 );
+        REQUIRE( dispatcher.remainingTime(84) == -1 );
+    }
+
+    SECTION("it initialises timer handles on the given loop")
+    {
+        uv_loop_t loop;
+        uv_timer_t *registeredHandle = nullptr;
+        MockedLibuvApi *api = new MockedLibuvApi();
+        MOCK_EXPECT( api->uv_timer_init ).once()
+            .with( mock::equal(&loop), mock::retrieve(registeredHandle) )
+            .returns(0);
+        MOCK_EXPECT( api->uv_timer_start ).returns(0);
+        MOCK_EXPECT( api->uv_timer_stop ).returns(0);
+        MOCK_EXPECT( api->uv_now ).returns(1000);
+        MOCK_EXPECT( api->uv_close );
+
+        {
+            TimerNotifier dispatcher(&loop, api);
+            dispatcher.registerTimer(83, 30, []{});
+        }
+
+        REQUIRE( registeredHandle );
+    }
+
+    SECTION("it closes a registered timer on destruction, closing stops it")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerMocker mocker(api);
+        mocker.mockInit();
+        mocker.mockStart(30);
+        mocker.mockClose();
+        MOCK_RESET( api->uv_timer_stop );
+        MOCK_EXPECT( api->uv_timer_stop ).never();
+
+        {
+            TimerNotifier dispatcher(uv_default_loop(), api);
+            dispatcher.registerTimer(83, 30, []{});
+        }
+
+        mocker.checkHandles();
+    }
+
+    SECTION("it closes its timers latest registered first on destruction")
+    {
+        std::vector<uv_timer_t *> registered;
+        std::vector<uv_handle_t *> closed;
+        MockedLibuvApi *api = new MockedLibuvApi();
+        MOCK_EXPECT( api->uv_timer_init )
+            .calls([&registered](uv_loop_t *, uv_timer_t *handle) {
+                registered.push_back(handle);
+                return 0;
+            });
+        MOCK_EXPECT( api->uv_timer_start ).returns(0);
+        MOCK_EXPECT( api->uv_now ).returns(1000);
+        MOCK_EXPECT( api->uv_close )
+            .calls([&closed](uv_handle_t *handle, uv_close_cb) {
+                closed.push_back(handle);
+            });
+
+        {
+            TimerNotifier dispatcher(uv_default_loop(), api);
+            dispatcher.registerTimer(1, 30, []{});
+            dispatcher.registerTimer(2, 30, []{});
+            dispatcher.registerTimer(3, 30, []{});
+        }
+
+        REQUIRE( closed.size() == 3 );
+        REQUIRE( closed[0] == (uv_handle_t *)registered[2] );
+        REQUIRE( closed[1] == (uv_handle_t *)registered[1] );
+        REQUIRE( closed[2] == (uv_handle_t *)registered[0] );
+    }
+
+    SECTION("timer watcher invokes timeout callback")
+    {
+        int callbackInvoked = 0;
+        qtjs::TimerData data = {
+            [&callbackInvoked]{ callbackInvoked++; }
+        };
+
+        uv_timer_t request;
+        request.data = &data;
+
+        qtjs::uv_timer_watcher(&request);
+
+        REQUIRE( callbackInvoked == 1 );
+    }
+
+    SECTION("registerTimer initialises timeout callback")
+    {
+        int callbackInvoked = 0;
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerMocker mocker(api);
+        mocker.mockInit();
+        mocker.mockStart(30);
+
+        TimerNotifier dispatcher(uv_default_loop(), api);
+        dispatcher.registerTimer(83, 30, [&callbackInvoked]{ callbackInvoked++; });
+
+        mocker.checkHandles();
+        REQUIRE( mocker.startedHandle->data );
+        ((qtjs::TimerData *)mocker.startedHandle->data)->timeout();
+        REQUIRE( callbackInvoked == 1 );
+    }
+
+    SECTION("calls uv_close before deallocating timer handle")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerMocker mocker(api);
+        mocker.mockInit();
+        mocker.mockStart(30);
+        mocker.mockStop();
+        mocker.mockClose();
+
+        TimerNotifier dispatcher(uv_default_loop(), api);
+        dispatcher.registerTimer(83, 30, []{});
+        dispatcher.unregisterTimer(83);
+
+        mocker.checkHandles();
+    }
+
+}
+
+TEST_CASE("EventDispatcherLibUv pools handle records")
+{
+    SECTION("it recycles released records")
+    {
+        qtjs::EventDispatcherLibUvPool<qtjs::TimerWatcher> pool(4);
+        qtjs::TimerWatcher *first = pool.acquire();
+        pool.release(first);
+        REQUIRE( pool.acquire() == first );
+    }
+
+    SECTION("it grows by whole blocks and tracks occupancy")
+    {
+        qtjs::EventDispatcherLibUvPool<qtjs::TimerWatcher> pool(4);
+        std::vector<qtjs::TimerWatcher *> watchers;
+        for (int i = 0; i < 5; ++i) {
+            watchers.push_back(pool.acquire());
+        }
+        pool.release(watchers.back());
+        pool.release(watchers.front());
+
+        REQUIRE( pool.counters().inUse == 3 );
+        REQUIRE( pool.counters().highWaterMark == 5 );
+        REQUIRE( pool.counters().capacity == 8 );
+    }
+
+    SECTION("it hands out constructed records")
+    {
+        qtjs::EventDispatcherLibUvPool<qtjs::PollWatcher> pool;
+        qtjs::PollWatcher *watcher = pool.acquire();
+        REQUIRE( watcher->callbacks.eventMask == 0 );
+        REQUIRE_FALSE( watcher->callbacks.readAvailable );
+    }
+
+    SECTION("it recycles read buffers once their last reference is gone")
+    {
+        auto *pool = new qtjs::EventDispatcherLibUvReadBufferPool();
+        auto *buffer = pool->acquire();
+        qtjs::EventDispatcherLibUvReadBufferPool::ref(buffer);
+        qtjs::EventDispatcherLibUvReadBufferPool::unref(buffer);
+        REQUIRE( pool->counters().inUse == 1 );
+
+        qtjs::EventDispatcherLibUvReadBufferPool::unref(buffer);
+        REQUIRE( pool->counters().inUse == 0 );
+        REQUIRE( pool->acquire() == buffer );
+        REQUIRE( buffer->used == 0 );
+
+        pool->orphan();
+        qtjs::EventDispatcherLibUvReadBufferPool::unref(buffer);
+    }
+}
+
+struct StreamStub : qtjs::EventDispatcherLibUvStream {
+    std::function<void()> flushed;
+    std::function<void()> detached;
+    void flush() override {
+        flushed();
+    }
+    void detachFromDispatcher() override {
+        detached();
+    }
+};
+
+TEST_CASE("EventDispatcherLibUv stream registry")
+{
+    MockedLibuvApi *api = new MockedLibuvApi();
+    ZeroTimerMocker mocker(api);
+    // the stubs do not detach themselves, the registry goes first
+    StreamStub first, second, third;
+    std::vector<StreamStub *> flushed, detached;
+    StreamRegistry streams(uv_default_loop(), api);
+    for (StreamStub *stream : {&first, &second, &third}) {
+        stream->flushed = [stream, &flushed] { flushed.push_back(stream); };
+        stream->detached = [stream, &detached] { detached.push_back(stream); };
+        streams.attach(stream);
+    }
+
+    SECTION("it tells every stream still attached once")
+    {
+        streams.detach(&second);
+        streams.detachAll();
+        streams.detachAll();
+        REQUIRE( detached == std::vector<StreamStub *>({&first, &third}) );
+    }
+
+    SECTION("a stream may detach another one while it is told")
+    {
+        first.detached = [&] {
+            detached.push_back(&first);
+            streams.detach(&second);
+        };
+        streams.detachAll();
+        REQUIRE( detached == std::vector<StreamStub *>({&first, &third}) );
+    }
+
+    SECTION("it flushes each scheduled stream once after the poll and keeps the loop from blocking meanwhile")
+    {
+        REQUIRE_FALSE( mocker.checking );
+        streams.scheduleFlush(&third);
+        streams.scheduleFlush(&first);
+        streams.scheduleFlush(&third);
+        REQUIRE( mocker.checking );
+        REQUIRE( mocker.idling );
+
+        streams.flushStreams();
+        REQUIRE( flushed == std::vector<StreamStub *>({&third, &first}) );
+        REQUIRE_FALSE( mocker.checking );
+        REQUIRE_FALSE( mocker.idling );
+    }
+
+    SECTION("it leaves a stream scheduled from its flush to the next iteration")
+    {
+        first.flushed = [&] {
+            flushed.push_back(&first);
+            streams.scheduleFlush(&first);
+        };
+        streams.scheduleFlush(&first);
+
+        streams.flushStreams();
+        REQUIRE( flushed.size() == 1 );
+        REQUIRE( mocker.idling );
+        streams.flushStreams();
+        REQUIRE( flushed.size() == 2 );
+    }
+
+    SECTION("it does not flush a stream detached before its turn")
+    {
+        first.flushed = [&] {
+            flushed.push_back(&first);
+            streams.detach(&second);
+        };
+        streams.scheduleFlush(&first);
+        streams.scheduleFlush(&second);
+        streams.scheduleFlush(&third);
+        streams.detach(&third);
+
+        streams.flushStreams();
+        REQUIRE( flushed == std::vector<StreamStub *>({&first}) );
+        REQUIRE_FALSE( mocker.idling );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv stores callbacks inline")
+{
+    SECTION("an empty callback is false")
+    {
+        qtjs::EventDispatcherLibUvCallback callback;
+        REQUIRE_FALSE( callback );
+    }
+
+    SECTION("it calls the captured lambda")
+    {
+        int timerId = 12, firedTimerId = 0;
+        QObject *object = (QObject *)919192, *firedObject = nullptr;
+        qtjs::EventDispatcherLibUvCallback callback([timerId, object, &firedTimerId, &firedObject] {
+            firedTimerId = timerId;
+            firedObject = object;
+        });
+        qtjs::EventDispatcherLibUvCallback copy = callback;
+        copy();
+        REQUIRE( firedTimerId == 12 );
+        REQUIRE( firedObject == (QObject *)919192 );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv loop metrics")
+{
+    SECTION("it buckets phase times by powers of two microseconds")
+    {
+        REQUIRE( qtjs::EventDispatcherLibUvLoopMetrics::histogramBucket(999) == 0 );
+        REQUIRE( qtjs::EventDispatcherLibUvLoopMetrics::histogramBucket(1000) == 1 );
+        REQUIRE( qtjs::EventDispatcherLibUvLoopMetrics::histogramBucket(3999) == 2 );
+        REQUIRE( qtjs::EventDispatcherLibUvLoopMetrics::histogramBucket(4000) == 3 );
+        REQUIRE( qtjs::EventDispatcherLibUvLoopMetrics::histogramBucket(uint64_t(3600) * 1000000000) == 19 );
+    }
+
+    SECTION("it records phase times and iterations")
+    {
+        qtjs::EventDispatcherLibUvLoopMetrics metrics;
+        metrics.recordPhase(2, 1500);
+        metrics.recordPhase(2, 2500);
+        metrics.finishIteration(nullptr, false);
+        REQUIRE( metrics.iterations.load() == 1 );
+        REQUIRE( metrics.phaseSamples[2].load() == 2 );
+        REQUIRE( metrics.phaseNs[2].load() == 4000 );
+        REQUIRE( metrics.histogram[2][1].load() == 1 );
+        REQUIRE( metrics.histogram[2][2].load() == 1 );
+        REQUIRE( metrics.phaseSamples[0].load() == 0 );
+    }
+
+    SECTION("it only times phases while enabled")
+    {
+        qtjs::EventDispatcherLibUvLoopMetrics metrics;
+        {
+            qtjs::EventDispatcherLibUvPhaseClock clock(metrics, nullptr);
+            clock.mark(1);
+        }
+        REQUIRE( metrics.iterations.load() == 1 );
+        REQUIRE( metrics.phaseSamples[1].load() == 0 );
+
+        uv_loop_t loop;
+        uv_loop_init(&loop);
+        metrics.setEnabled(true);
+        {
+            qtjs::EventDispatcherLibUvPhaseClock clock(metrics, &loop);
+            clock.mark(1);
+            clock.mark(3);
+            clock.mark(1);
+        }
+        uv_loop_close(&loop);
+        REQUIRE( metrics.iterations.load() == 2 );
+        REQUIRE( metrics.phaseSamples[1].load() == 1 );
+        REQUIRE( metrics.phaseSamples[3].load() == 1 );
+        REQUIRE( metrics.phaseNs[1].load() > 0 );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv profiles event dispatches")
+{
+    const QMetaObject *type = &QObject::staticMetaObject;
+
+    SECTION("it does not time dispatches unless asked to")
+    {
+        qtjs::EventDispatcherLibUvDispatchProfiler profiler;
+        REQUIRE_FALSE( profiler.active() );
+        profiler.setAggregating(true);
+        REQUIRE( profiler.active() );
+    }
+
+    SECTION("it aggregates dispatches per receiver and ranks them by total time")
+    {
+        qtjs::EventDispatcherLibUvDispatchProfiler profiler;
+        profiler.setAggregating(true);
+        profiler.record(qtjs::EventDispatcherLibUv::TimerDispatch, 3, type, "poller", 100);
+        profiler.record(qtjs::EventDispatcherLibUv::TimerDispatch, 3, type, "poller", 300);
+        profiler.record(qtjs::EventDispatcherLibUv::SocketDispatch, 7, type, "", 250);
+        auto top = profiler.top(1);
+        REQUIRE( top.size() == 1 );
+        REQUIRE( top[0].id == 3 );
+        REQUIRE( top[0].objectName == "poller" );
+        REQUIRE( top[0].count == 2 );
+        REQUIRE( top[0].totalNs == 400 );
+        REQUIRE( top[0].maxNs == 300 );
+        REQUIRE( profiler.top(10).size() == 2 );
+        profiler.reset();
+        REQUIRE( profiler.top(10).isEmpty() );
+    }
+
+    SECTION("it reports dispatches over the threshold")
+    {
+        qtjs::EventDispatcherLibUvDispatchProfiler profiler;
+        QList<int> slowIds;
+        profiler.setSlowThreshold(200, [&slowIds](const qtjs::EventDispatcherLibUv::DispatchRecord &record) {
+            slowIds.append(record.id);
+        });
+        REQUIRE( profiler.active() );
+        profiler.record(qtjs::EventDispatcherLibUv::SocketDispatch, 7, type, "", 250);
+        profiler.record(qtjs::EventDispatcherLibUv::SocketDispatch, 8, type, "", 150);
+        REQUIRE( slowIds == QList<int>() << 7 );
+        REQUIRE( profiler.top(10).isEmpty() );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv budgets dispatches per iteration")
+{
+    QObject *busy = (QObject *)0x10, *quiet = (QObject *)0x20, *late = (QObject *)0x30;
+    qtjs::EventDispatcherLibUvDispatchBudget budget;
+    qtjs::EventDispatcherLibUvDispatchBudget::Dispatch dispatch;
+
+    SECTION("it dispatches everything without limits")
+    {
+        budget.startIteration();
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE_FALSE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, busy, 5) );
+        }
+    }
+
+    SECTION("it defers dispatches past the limit to the next iteration in order")
+    {
+        budget.setLimits(1, 0);
+        budget.startIteration();
+        REQUIRE_FALSE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, busy, 5) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, quiet, 6) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::TimerDispatch, late, 9) );
+        REQUIRE( budget.hasDeferred() );
+
+        budget.startIteration();
+        REQUIRE( budget.takeDeferred(dispatch) );
+        REQUIRE( dispatch.receiver == quiet );
+        REQUIRE_FALSE( budget.takeDeferred(dispatch) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, busy, 5) );
+
+        budget.startIteration();
+        REQUIRE( budget.takeDeferred(dispatch) );
+        REQUIRE( dispatch.source == qtjs::EventDispatcherLibUv::TimerDispatch );
+        REQUIRE( dispatch.id == 9 );
+        budget.startIteration();
+        REQUIRE( budget.takeDeferred(dispatch) );
+        REQUIRE( dispatch.receiver == busy );
+        REQUIRE_FALSE( budget.hasDeferred() );
+    }
+
+    SECTION("it queues a socket reported again while it waits only once")
+    {
+        budget.setLimits(1, 0);
+        budget.startIteration();
+        REQUIRE_FALSE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, busy, 5) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, quiet, 6) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, quiet, 6) );
+
+        budget.setLimits(0, 0);
+        budget.startIteration();
+        REQUIRE( budget.takeDeferred(dispatch) );
+        REQUIRE_FALSE( budget.takeDeferred(dispatch) );
+    }
+
+    SECTION("it counts the fires of a timer fired again while it waits")
+    {
+        budget.setLimits(1, 0);
+        budget.startIteration();
+        REQUIRE_FALSE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, busy, 5) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::TimerDispatch, late, 9) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, quiet, 6) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::TimerDispatch, late, 9) );
+
+        budget.setLimits(0, 0);
+        budget.startIteration();
+        REQUIRE( budget.takeDeferred(dispatch) );
+        REQUIRE( dispatch.id == 9 );
+        REQUIRE( dispatch.fires == 2 );
+        REQUIRE( budget.takeDeferred(dispatch) );
+        REQUIRE( dispatch.receiver == quiet );
+        REQUIRE( dispatch.fires == 1 );
+        REQUIRE_FALSE( budget.takeDeferred(dispatch) );
+    }
+
+    SECTION("it drops deferred dispatches of unregistered notifiers and timers")
+    {
+        budget.setLimits(1, 0);
+        budget.startIteration();
+        REQUIRE_FALSE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, busy, 5) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::SocketDispatch, quiet, 6) );
+        REQUIRE( budget.defer(qtjs::EventDispatcherLibUv::TimerDispatch, late, 9) );
+        REQUIRE( budget.defersTimer(9) );
+        budget.forgetNotifier(quiet);
+        budget.forgetTimer(9);
+        REQUIRE_FALSE( budget.defersTimer(9) );
+        REQUIRE_FALSE( budget.hasDeferred() );
+        budget.startIteration();
+        REQUIRE_FALSE( budget.takeDeferred(dispatch) );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv indexes watchers by descriptor")
+{
+    SECTION("it finds descriptors in the directly indexed range")
+    {
+        int watcher = 0;
+        qtjs::EventDispatcherLibUvIndexTable<int> table(1024);
+        table.insert(700, &watcher);
+        REQUIRE( table.find(700) == &watcher );
+        REQUIRE( table.find(699) == nullptr );
+        REQUIRE( table.find(2000) == nullptr );
+        REQUIRE( table.size() == 1 );
+    }
+
+    SECTION("it keeps descriptors beyond its limit in the overflow map")
+    {
+        int low = 0, high = 0, negative = 0;
+        qtjs::EventDispatcherLibUvIndexTable<int> table(16);
+        table.insert(3, &low);
+        table.insert(5000, &high);
+        table.insert(-4, &negative);
+        REQUIRE( table.find(5000) == &high );
+        REQUIRE( table.find(-4) == &negative );
+        REQUIRE( table.size() == 3 );
+
+        int visited = 0;
+        table.forEach([&](int, int *) { ++visited; });
+        REQUIRE( visited == 3 );
+    }
+
+    SECTION("it forgets taken descriptors")
+    {
+        int watcher = 0;
+        qtjs::EventDispatcherLibUvIndexTable<int> table(16);
+        table.insert(3, &watcher);
+        REQUIRE( table.take(3) == &watcher );
+        REQUIRE( table.take(3) == nullptr );
+        REQUIRE( table.find(3) == nullptr );
+        REQUIRE( table.size() == 0 );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv timer wheel")
+{
+    SECTION("it drives all timers with a single libuv timer")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        WheelMocker mocker(api);
+        TimerWheel wheel(uv_default_loop(), api);
+
+        wheel.registerTimer(1, 10, Qt::PreciseTimer, []{});
+        wheel.registerTimer(2, 20, Qt::PreciseTimer, []{});
+        wheel.registerTimer(3, 30, Qt::PreciseTimer, []{});
+
+        REQUIRE( mocker.driverHandle );
+        REQUIRE( mocker.armed );
+        REQUIRE( mocker.due == 1010 );
+    }
+
+    SECTION("it fires timers when they are due")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        WheelMocker mocker(api);
+        TimerWheel wheel(uv_default_loop(), api);
+
+        int first = 0, second = 0;
+        wheel.registerTimer(1, 10, Qt::PreciseTimer, [&first]{ first++; });
+        wheel.registerTimer(2, 25, Qt::PreciseTimer, [&second]{ second++; });
+
+        mocker.advanceTo(wheel, 1009);
+        REQUIRE( first == 0 );
+        mocker.advanceTo(wheel, 1010);
+        REQUIRE( first == 1 );
+        mocker.advanceTo(wheel, 1025);
+        REQUIRE( first == 2 );
+        REQUIRE( second == 1 );
+    }
+
+    SECTION("it cascades long timers down to the millisecond they are due")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        WheelMocker mocker(api);
+        TimerWheel wheel(uv_default_loop(), api);
+
+        int fired = 0;
+        wheel.registerTimer(1, 70000, Qt::PreciseTimer, [&fired]{ fired++; });
+
+        mocker.advanceTo(wheel, 70999);
+        REQUIRE( fired == 0 );
+        mocker.advanceTo(wheel, 71000);
+        REQUIRE( fired == 1 );
+    }
+
+    SECTION("it does not fire unregistered timers")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        WheelMocker mocker(api);
+        TimerWheel wheel(uv_default_loop(), api);
+
+        wheel.registerTimer(1, 10, Qt::PreciseTimer, []{ FAIL("unexpected call"); });
+        REQUIRE( wheel.unregisterTimer(1) == true );
+        REQUIRE( wheel.unregisterTimer(1) == false );
+        REQUIRE_FALSE( mocker.armed );
+
+        mocker.advanceTo(wheel, 1100);
+    }
+
+    SECTION("it fires coarse timers that coalesce onto one deadline in a single wakeup")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        WheelMocker mocker(api);
+        TimerWheel wheel(uv_default_loop(), api);
+
+        int fired = 0;
+        wheel.registerTimer(1, 990, Qt::CoarseTimer, [&fired]{ fired++; });
+        wheel.registerTimer(2, 1000, Qt::CoarseTimer, [&fired]{ fired++; });
+        wheel.registerTimer(3, 1010, Qt::CoarseTimer, [&fired]{ fired++; });
+
+        mocker.advanceTo(wheel, 1999);
+        REQUIRE( fired == 0 );
+        mocker.advanceTo(wheel, 2000);
+        REQUIRE( fired == 3 );
+        REQUIRE( wheel.wakeups() == 1 );
+        REQUIRE( wheel.expirations() == 3 );
+    }
+
+    SECTION("it reports the time left until the deadline a timer was coalesced to")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        WheelMocker mocker(api);
+        TimerWheel wheel(uv_default_loop(), api);
+
+        wheel.registerTimer(1, 990, Qt::CoarseTimer, []{});
+        REQUIRE( wheel.remainingTime(1) == 1000 );
+        mocker.advanceTo(wheel, 1500);
+        REQUIRE( wheel.remainingTime(1) == 500 );
+        REQUIRE( wheel.remainingTime(2) == -1 );
+    }
+
+    SECTION("a timer can unregister itself while firing")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        WheelMocker mocker(api);
+        TimerWheel wheel(uv_default_loop(), api);
+
+        int fired = 0;
+        wheel.registerTimer(1, 10, Qt::PreciseTimer, [&fired, &wheel]{
+            fired++;
+            wheel.unregisterTimer(1);
+        });
+
+        mocker.advanceTo(wheel, 1100);
+        REQUIRE( fired == 1 );
+        REQUIRE_FALSE( mocker.armed );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv zero timer queue")
+{
+    SECTION("it needs no libuv timers and keeps the loop from blocking while it has timers")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        ZeroTimerMocker mocker(api);
+        MOCK_EXPECT( api->uv_timer_init ).never();
+        ZeroTimerQueue queue(uv_default_loop(), api);
+
+        REQUIRE( mocker.checkHandle );
+        REQUIRE( mocker.idleHandle );
+        REQUIRE_FALSE( mocker.checking );
+        REQUIRE_FALSE( mocker.idling );
+
+        queue.registerTimer(1, []{});
+        queue.registerTimer(2, []{});
+        REQUIRE( mocker.checking );
+        REQUIRE( mocker.idling );
+
+        queue.unregisterTimer(1);
+        REQUIRE( mocker.idling );
+        queue.unregisterTimer(2);
+        REQUIRE_FALSE( mocker.checking );
+        REQUIRE_FALSE( mocker.idling );
+    }
+
+    SECTION("it fires each repeating timer once per pass")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        ZeroTimerMocker mocker(api);
+        ZeroTimerQueue queue(uv_default_loop(), api);
+
+        int first = 0, second = 0;
+        queue.registerTimer(1, [&first]{ first++; });
+        queue.registerTimer(2, [&second]{ second++; });
+
+        queue.processTimers();
+        REQUIRE( first == 1 );
+        REQUIRE( second == 1 );
+        queue.processTimers();
+        REQUIRE( first == 2 );
+        REQUIRE( second == 2 );
+        REQUIRE( queue.expirations() == 4 );
+    }
+
+    SECTION("it reports its timers as due")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        ZeroTimerMocker mocker(api);
+        ZeroTimerQueue queue(uv_default_loop(), api);
+
+        queue.registerTimer(1, []{});
+        REQUIRE( queue.remainingTime(1) == 0 );
+        REQUIRE( queue.remainingTime(2) == -1 );
+        queue.unregisterTimer(1);
+    }
+
+    SECTION("it leaves timers registered while firing to the next pass")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        ZeroTimerMocker mocker(api);
+        ZeroTimerQueue queue(uv_default_loop(), api);
+
+        int restarts = 0;
+        int timerId = 1;
+        std::function<void()> restart = [&]{
+            queue.unregisterTimer(timerId);
+            restarts++;
+            queue.registerTimer(++timerId, [&restart]{ restart(); });
+        };
+        queue.registerTimer(timerId, [&restart]{ restart(); });
+
+        queue.processTimers();
+        REQUIRE( restarts == 1 );
+        REQUIRE( mocker.idling );
+        queue.processTimers();
+        REQUIRE( restarts == 2 );
+        queue.unregisterTimer(timerId);
+    }
+
+    SECTION("it does not fire timers unregistered earlier in the pass")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        ZeroTimerMocker mocker(api);
+        ZeroTimerQueue queue(uv_default_loop(), api);
+
+        int fired = 0;
+        queue.registerTimer(1, [&fired, &queue]{
+            fired++;
+            queue.unregisterTimer(1);
+            queue.unregisterTimer(2);
+        });
+        queue.registerTimer(2, []{ FAIL("unexpected call"); });
+
+        queue.processTimers();
+        REQUIRE( fired == 1 );
+        REQUIRE_FALSE( mocker.idling );
+        REQUIRE( queue.poolCounters().inUse == 0 );
+    }
+}
+
+#ifdef Q_OS_LINUX
+TEST_CASE("EventDispatcherLibUv timerfd precise timers")
+{
+    SECTION("it polls a single timerfd armed at the earliest deadline")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerFdMocker mocker(api);
+        MOCK_EXPECT( api->uv_timer_init ).never();
+        TimerFdNotifier notifier(uv_default_loop(), api);
+        REQUIRE( notifier.isValid() );
+
+        notifier.registerTimer(1, 30, []{});
+        notifier.registerTimer(2, 10, []{});
+        notifier.registerTimer(3, 20, []{});
+
+        REQUIRE( mocker.polling );
+        REQUIRE( mocker.fd >= 0 );
+        REQUIRE( notifier.armedDeadline() == 1010000000 );
+    }
+
+    SECTION("it closes its polling watcher without stopping it first")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerFdMocker mocker(api);
+        {
+            TimerFdNotifier notifier(uv_default_loop(), api);
+            notifier.registerTimer(1, 30, []{});
+            REQUIRE( mocker.polling );
+
+            MOCK_RESET( api->uv_poll_stop );
+            MOCK_EXPECT( api->uv_poll_stop ).never();
+            MOCK_RESET( api->uv_close );
+            MOCK_EXPECT( api->uv_close ).once()
+                .with( mock::equal((uv_handle_t *)mocker.pollHandle), mock::equal(&qtjs::uv_close_timerFdHandle) );
+        }
+        MOCK_VERIFY( api->uv_close );
+    }
+
+    SECTION("it fires due timers and keeps them on their period")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerFdMocker mocker(api);
+        TimerFdNotifier notifier(uv_default_loop(), api);
+
+        int fired = 0;
+        notifier.registerTimer(1, 10, [&fired]{ fired++; });
+
+        mocker.now = 1010400000;
+        notifier.processTimers();
+        REQUIRE( fired == 1 );
+        REQUIRE( notifier.armedDeadline() == 1020000000 );
+
+        // missed periods are skipped
+        mocker.now = 1045000000;
+        notifier.processTimers();
+        REQUIRE( fired == 2 );
+        REQUIRE( notifier.armedDeadline() == 1050000000 );
+    }
+
+    SECTION("it reports the time left until a timer's deadline to the nearest millisecond")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerFdMocker mocker(api);
+        TimerFdNotifier notifier(uv_default_loop(), api);
+
+        notifier.registerTimer(1, 10, []{});
+        mocker.now = 1004400000;
+        REQUIRE( notifier.remainingTime(1) == 6 );
+        mocker.now = 1012000000;
+        REQUIRE( notifier.remainingTime(1) == 0 );
+        REQUIRE( notifier.remainingTime(2) == -1 );
+    }
+
+    SECTION("it does not fire timers unregistered earlier in the pass")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerFdMocker mocker(api);
+        TimerFdNotifier notifier(uv_default_loop(), api);
+
+        int fired = 0;
+        notifier.registerTimer(1, 10, [&fired, &notifier]{
+            fired++;
+            notifier.unregisterTimer(1);
+            notifier.unregisterTimer(2);
+        });
+        notifier.registerTimer(2, 10, []{ FAIL("unexpected call"); });
+
+        mocker.now = 1010000000;
+        notifier.processTimers();
+        REQUIRE( fired == 1 );
+    }
+
+    SECTION("it disarms the timerfd and stops polling without timers")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        TimerFdMocker mocker(api);
+        TimerFdNotifier notifier(uv_default_loop(), api);
+
+        notifier.registerTimer(1, 10, []{});
+        REQUIRE( notifier.unregisterTimer(1) == true );
+        REQUIRE( notifier.unregisterTimer(1) == false );
+
+        REQUIRE_FALSE( mocker.polling );
+        REQUIRE( notifier.armedDeadline() == 0 );
+    }
+}
+#endif
+
+TEST_CASE("EventDispatcherLibUv keeps repeating timers on their period")
+{
+    SECTION("a timer on time goes on with its next period")
+    {
+        REQUIRE( qtjs::nextTimerDeadline(1010, 10, 1010, qtjs::EventDispatcherLibUv::SkipMissedPeriods) == 1020 );
+        REQUIRE( qtjs::nextTimerDeadline(1010, 10, 1010, qtjs::EventDispatcherLibUv::FireOnceAndRestart) == 1020 );
+        REQUIRE( qtjs::nextTimerDeadline(1010, 10, 1010, qtjs::EventDispatcherLibUv::BurstMissedPeriods) == 1020 );
+    }
+
+    SECTION("a late timer skips to the next period still ahead")
+    {
+        REQUIRE( qtjs::nextTimerDeadline(1010, 10, 1014, qtjs::EventDispatcherLibUv::SkipMissedPeriods) == 1020 );
+        REQUIRE( qtjs::nextTimerDeadline(1010, 10, 1035, qtjs::EventDispatcherLibUv::SkipMissedPeriods) == 1040 );
+        REQUIRE( qtjs::nextTimerDeadline(1010, 10, 1040, qtjs::EventDispatcherLibUv::SkipMissedPeriods) == 1050 );
+    }
+
+    SECTION("a late timer restarts its periods or bursts through the missed ones")
+    {
+        REQUIRE( qtjs::nextTimerDeadline(1010, 10, 1035, qtjs::EventDispatcherLibUv::FireOnceAndRestart) == 1045 );
+        REQUIRE( qtjs::nextTimerDeadline(1010, 10, 1035, qtjs::EventDispatcherLibUv::BurstMissedPeriods) == 1020 );
+    }
+
+    SECTION("the timer wheel keeps a late timer on its period")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        WheelMocker mocker(api);
+        TimerWheel wheel(uv_default_loop(), api);
+
+        int fired = 0;
+        wheel.registerTimer(1, 10, Qt::PreciseTimer, [&fired]{ fired++; });
+
+        mocker.now = 1035;
+        mocker.armed = false;
+        wheel.processTimers();
+        REQUIRE( fired == 1 );
+        REQUIRE( mocker.due == 1040 );
+    }
+
+    SECTION("the timer wheel fires the missed periods when bursting")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        WheelMocker mocker(api);
+        TimerWheel wheel(uv_default_loop(), api);
+        wheel.setCatchUpPolicy(qtjs::EventDispatcherLibUv::BurstMissedPeriods);
+
+        int fired = 0;
+        wheel.registerTimer(1, 10, Qt::PreciseTimer, [&fired]{ fired++; });
+
+        mocker.now = 1035;
+        mocker.armed = false;
+        wheel.processTimers();
+        REQUIRE( fired == 3 );
+        REQUIRE( mocker.due == 1040 );
+    }
+
+    SECTION("libuv timers are re-armed for the rest of the period")
+    {
+        MockedLibuvApi *api = new MockedLibuvApi();
+        uv_timer_t *handle = nullptr;
+        uint64_t now = 1000, timeout = 0, repeat = 1;
+        MOCK_EXPECT( api->uv_timer_init ).once().with( mock::any, mock::retrieve(handle) ).returns(0);
+        MOCK_EXPECT( api->uv_now ).calls([&now](const uv_loop_t *) { return now; });
+        MOCK_EXPECT( api->uv_timer_start )
+            .calls([&timeout, &repeat](uv_timer_t *, uv_timer_cb, uint64_t t, uint64_t r) {
+                timeout = t;
+                repeat = r;
+                return 0;
+            });
+        MOCK_EXPECT( api->uv_timer_stop ).returns(0);
+        MOCK_EXPECT( api->uv_close );
+
+        int fired = 0;
+        TimerNotifier notifier(uv_default_loop(), api);
+        notifier.registerTimer(1, 10, [&fired]{ fired++; });
+        REQUIRE( timeout == 10 );
+        REQUIRE( repeat == 0 );
+
+        now = 1013;
+        qtjs::uv_timer_watcher(handle);
+        REQUIRE( fired == 1 );
+        REQUIRE( timeout == 7 );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv coalesces coarse timers")
+{
+    SECTION("precise timers are due exactly after their interval")
+    {
+        REQUIRE( qtjs::coalescedTimerDeadline(1007, 100, Qt::PreciseTimer) == 1107 );
+    }
+
+    SECTION("coarse timers up to 20ms are handled as precise ones")
+    {
+        REQUIRE( qtjs::coalescedTimerDeadline(1003, 15, Qt::CoarseTimer) == 1018 );
+    }
+
+    SECTION("coarse timers move by at most 5% of their interval towards a round boundary")
+    {
+        REQUIRE( qtjs::coalescedTimerDeadline(1007, 100, Qt::CoarseTimer) == 1102 );
+        REQUIRE( qtjs::coalescedTimerDeadline(10480, 1000, Qt::CoarseTimer) == 11500 );
+    }
+
+    SECTION("coarse timers take a nearby full second")
+    {
+        REQUIRE( qtjs::coalescedTimerDeadline(1000, 1010, Qt::CoarseTimer) == 2000 );
+        REQUIRE( qtjs::coalescedTimerDeadline(1000, 990, Qt::CoarseTimer) == 2000 );
+    }
+
+    SECTION("very coarse timers are rounded to full seconds")
+    {
+        REQUIRE( qtjs::coalescedTimerDeadline(1003, 1400, Qt::VeryCoarseTimer) == 2000 );
+        REQUIRE( qtjs::coalescedTimerDeadline(1003, 1600, Qt::VeryCoarseTimer) == 3000 );
+        REQUIRE( qtjs::coalescedTimerDeadline(1003, 100, Qt::VeryCoarseTimer) == 2000 );
+    }
+
+    SECTION("very coarse timers count from the nearest full second")
+    {
+        REQUIRE( qtjs::coalescedTimerDeadline(1499, 1000, Qt::VeryCoarseTimer) == 2000 );
+        REQUIRE( qtjs::coalescedTimerDeadline(1999, 1000, Qt::VeryCoarseTimer) == 3000 );
+        REQUIRE( qtjs::coalescedTimerDeadline(1500, 1000, Qt::VeryCoarseTimer) == 3000 );
+    }
+
+    SECTION("coarse timers of 20s and more are handled as very coarse ones")
+    {
+        REQUIRE( qtjs::coalescedTimerDeadline(1003, 20000, Qt::CoarseTimer) == 21000 );
+    }
+}
+
+TEST_CASE("EventDispatcherLibUv tracks timer execution")
+{
+    SECTION("TimerWatcher returns empty list when there are no timers registered")
+    {
+        TimerTracker watcher;
+        REQUIRE( watcher.getTimerInfo(nullptr).empty() );
+    }
+
+    SECTION("TimerWatcher returns a list of registered timers for object")
+    {
+        TimerTracker watcher;
+        watcher.registerTimer(12, 101, Qt::CoarseTimer, (QObject *)919192);
+        auto list = watcher.getTimerInfo((QObject *)919192);
+        REQUIRE( list.count() == 1 );
+        REQUIRE( list.back().timerId == 12 );
+        REQUIRE( list.back().interval == 101 );
+        REQUIRE( list.back().timerType == Qt::CoarseTimer );
+    }
+
+    SECTION("TimerWatcher unregisters timerinfo")
+    {
+        TimerTracker watcher;
+        watcher.registerTimer(12, 101, Qt::CoarseTimer, (QObject *)919192);
+        watcher.unregisterTimer(12);
+        REQUIRE( watcher.getTimerInfo((QObject *)919192).empty() );
+    }
+
+    SECTION("TimerWatcher keeps timers of an object in registration order")
+    {
+        TimerTracker watcher;
+        watcher.registerTimer(12, 101, Qt::CoarseTimer, (QObject *)919192);
+        watcher.registerTimer(13, 102, Qt::PreciseTimer, (QObject *)919192);
+        watcher.registerTimer(14, 103, Qt::VeryCoarseTimer, (QObject *)919192);
+        watcher.unregisterTimer(13);
+        auto list = watcher.getTimerInfo((QObject *)919192);
+        REQUIRE( list.count() == 2 );
+        REQUIRE( list.front().timerId == 12 );
+        REQUIRE( list.back().timerId == 14 );
+    }
+
+    SECTION("TimerWatcher unregisters all timers of an object at once")
+    {
+        TimerTracker watcher;
+        watcher.registerTimer(12, 101, Qt::CoarseTimer, (QObject *)919192);
+        watcher.registerTimer(13, 102, Qt::PreciseTimer, (QObject *)919192);
+        watcher.registerTimer(14, 103, Qt::CoarseTimer, (QObject *)828282);
+
+        std::vector<int> unregistered;
+        watcher.unregisterTimers((QObject *)919192, [&unregistered](int timerId, Qt::TimerType) {
+            unregistered.push_back(timerId);
+        });
+
+        REQUIRE( unregistered == std::vector<int>({12, 13}) );
+        REQUIRE( watcher.getTimerInfo((QObject *)919192).empty() );
+        REQUIRE_FALSE( watcher.unregisterTimer(12) );
+        REQUIRE( watcher.getTimerInfo((QObject *)828282).count() == 1 );
+    }
+
+    SECTION("TimerWatcher finds the type of registered timers only")
+    {
+        TimerTracker watcher;
+        Qt::TimerType timerType;
+        watcher.registerTimer(12, 101, Qt::VeryCoarseTimer, (QObject *)919192);
+        REQUIRE( watcher.find(12, &timerType) );
+        REQUIRE( timerType == Qt::VeryCoarseTimer );
+        REQUIRE_FALSE( watcher.find(13, &timerType) );
+    }
+
 
 }
 
@@ -480,10 +1962,6 @@ PollMocker::PollMocker(MockedLibuvApi *api)
 
 PollMocker::~PollMocker()
 {
-    if (registeredHandle) {
-        delete (qtjs::SocketCallbacks *)registeredHandle->data;
-        delete registeredHandle;
-    }
 }
 
 void PollMocker::mockInit(int fd)
@@ -578,7 +2056,7 @@ AsyncMocker::~AsyncMocker()
 void AsyncMocker::mockInit()
 {
     MOCK_EXPECT(api->uv_async_init).once()
-        .with( mock::equal(uv_default_loop()), mock::retrieve(registeredHandle), mock::equal(nullptr))
+        .with( mock::equal(uv_default_loop()), mock::retrieve(registeredHandle), mock::equal(&qtjs::uv_async_watcher))
         .returns(0);
     MOCK_EXPECT(api->uv_unref).once()
         .with( mock::retrieve(unreffedHandle));
@@ -623,10 +2101,6 @@ TimerMocker::TimerMocker(MockedLibuvApi *api)
 
 TimerMocker::~TimerMocker()
 {
-    if (registeredHandle) {
-        delete (qtjs::TimerData *) registeredHandle->data;
-        delete registeredHandle;
-    }
 }
 
 void TimerMocker::mockInit()
@@ -634,11 +2108,12 @@ void TimerMocker::mockInit()
     MOCK_EXPECT( api->uv_timer_init ).once()
         .with( mock::equal(uv_default_loop()), mock::retrieve(registeredHandle) )
         .returns(0);
+    MOCK_EXPECT( api->uv_now ).returns(1000);
 }
 void TimerMocker::mockStart(uint64_t timeout)
 {
     MOCK_EXPECT( api->uv_timer_start ).once()
-        .with( mock::retrieve(startedHandle),  mock::equal(&qtjs::uv_timer_watcher), mock::equal(timeout), mock::equal(timeout) )
+        .with( mock::retrieve(startedHandle),  mock::equal(&qtjs::uv_timer_watcher), mock::equal(timeout), mock::equal(0) )
         .returns(0);
     checkStart = true;
     mockImplicitStopClose();
@@ -678,6 +2153,110 @@ void TimerMocker::checkHandles()
         REQUIRE( (uv_handle_t *)registeredHandle == closedHandle );
     }
 }
+WheelMocker::WheelMocker(MockedLibuvApi *api)
+    : driverHandle(nullptr), now(1000), due(0), armed(false), api(api)
+{
+    MOCK_EXPECT( api->uv_timer_init ).once()
+        .with( mock::equal(uv_default_loop()), mock::retrieve(driverHandle) )
+        .returns(0);
+    MOCK_EXPECT( api->uv_timer_start )
+        .calls([this](uv_timer_t *, uv_timer_cb, uint64_t timeout, uint64_t) {
+            armed = true;
+            due = now + timeout;
+            return 0;
+        });
+    MOCK_EXPECT( api->uv_timer_stop )
+        .calls([this](uv_timer_t *) {
+            armed = false;
+            return 0;
+        });
+    MOCK_EXPECT( api->uv_now )
+        .calls([this](const uv_loop_t *) { return now; });
+    MOCK_EXPECT( api->uv_close );
+}
+
+WheelMocker::~WheelMocker()
+{
+    delete driverHandle;
+}
+
+void WheelMocker::advanceTo(TimerWheel &wheel, uint64_t time)
+{
+    while (armed && due <= time) {
+        now = due;
+        armed = false;
+        wheel.processTimers();
+    }
+    now = time;
+}
+
+ZeroTimerMocker::ZeroTimerMocker(MockedLibuvApi *api)
+    : checkHandle(nullptr), idleHandle(nullptr), checking(false), idling(false), api(api)
+{
+    MOCK_EXPECT( api->uv_check_init ).once()
+        .with( mock::equal(uv_default_loop()), mock::retrieve(checkHandle) )
+        .returns(0);
+    MOCK_EXPECT( api->uv_idle_init ).once()
+        .with( mock::equal(uv_default_loop()), mock::retrieve(idleHandle) )
+        .returns(0);
+    MOCK_EXPECT( api->uv_check_start )
+        .calls([this](uv_check_t *, uv_check_cb) {
+            checking = true;
+            return 0;
+        });
+    MOCK_EXPECT( api->uv_check_stop )
+        .calls([this](uv_check_t *) {
+            checking = false;
+            return 0;
+        });
+    MOCK_EXPECT( api->uv_idle_start )
+        .calls([this](uv_idle_t *, uv_idle_cb) {
+            idling = true;
+            return 0;
+        });
+    MOCK_EXPECT( api->uv_idle_stop )
+        .calls([this](uv_idle_t *) {
+            idling = false;
+            return 0;
+        });
+    MOCK_EXPECT( api->uv_close );
+}
+
+ZeroTimerMocker::~ZeroTimerMocker()
+{
+    delete checkHandle;
+    delete idleHandle;
+}
+
+#ifdef Q_OS_LINUX
+TimerFdMocker::TimerFdMocker(MockedLibuvApi *api)
+    : pollHandle(nullptr), fd(-1), now(1000000000), polling(false), api(api)
+{
+    MOCK_EXPECT( api->uv_poll_init ).once()
+        .with( mock::equal(uv_default_loop()), mock::retrieve(pollHandle), mock::retrieve(fd) )
+        .returns(0);
+    MOCK_EXPECT( api->uv_poll_start )
+        .with( mock::any, UV_READABLE, mock::any )
+        .calls([this](uv_poll_t *, int, uv_poll_cb) {
+            polling = true;
+            return 0;
+        });
+    MOCK_EXPECT( api->uv_poll_stop )
+        .calls([this](uv_poll_t *) {
+            polling = false;
+            return 0;
+        });
+    MOCK_EXPECT( api->uv_hrtime )
+        .calls([this]() { return now; });
+    MOCK_EXPECT( api->uv_close );
+}
+
+TimerFdMocker::~TimerFdMocker()
+{
+    delete pollHandle;
+}
+#endif
+
 void TimerMocker::verifyAndReset()
 {
     MOCK_VERIFY(api->uv_timer_init);
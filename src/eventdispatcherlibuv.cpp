@@ -2,6 +2,7 @@
 
 #include <QCoreApplication>
 #include <QSocketNotifier>
+#include <QThread>
 #ifdef Q_OS_WIN
 #include <cassert>
 #include <QWinEventNotifier>
@@ -21,41 +22,136 @@ extern uint qGlobalPostedEventsCount(); // from qapplication.cpp
 namespace
 {
 
-void forgetCurrentUvHandles()
+void forgetCurrentUvHandles(uv_loop_t *loop)
 {
-    uv_walk(uv_default_loop(), [](uv_handle_t* handle, void* arg){
+    uv_walk(loop, [](uv_handle_t* handle, void* arg){
         if (uv_has_ref(handle)) {
             uv_unref(handle);
         }
     }, 0);
 }
 
+qtjs::EventDispatcherLibUv::PoolOccupancy poolOccupancy(const qtjs::PoolCounters &counters)
+{
+    qtjs::EventDispatcherLibUv::PoolOccupancy occupancy;
+    occupancy.inUse = counters.inUse;
+    occupancy.highWaterMark = counters.highWaterMark;
+    occupancy.capacity = counters.capacity;
+    return occupancy;
+}
+
+uv_loop_t *createLoop(qtjs::EventDispatcherLibUv::LoopSource loopSource)
+{
+    if (loopSource == qtjs::EventDispatcherLibUv::UseDefaultLoop) {
+        return uv_default_loop();
+    }
+    uv_loop_t *loop = new uv_loop_t();
+    uv_loop_init(loop);
+    return loop;
+}
+
 }
 
 namespace qtjs {
 
 
 EventDispatcherLibUv::EventDispatcherLibUv(QObject *parent) :
+    EventDispatcherLibUv(UseDefaultLoop, parent)
+{
+}
+
+EventDispatcherLibUv::EventDispatcherLibUv(LoopSource loopSource, QObject *parent) :
     QAbstractEventDispatcher(parent),
-    socketNotifier(new EventDispatcherLibUvSocketNotifier()),
-    timerNotifier(new EventDispatcherLibUvTimerNotifier()),
+    loop(createLoop(loopSource)),
+    ownsLoop(loopSource == CreatePrivateLoop),
+    handlePools(new EventDispatcherLibUvHandlePools()),
+    readBuffers(new EventDispatcherLibUvReadBufferPool()),
+    socketNotifier(new EventDispatcherLibUvSocketNotifier(loop, nullptr, &handlePools->pollWatchers)),
+    timerNotifier(new EventDispatcherLibUvTimerNotifier(loop, nullptr, &handlePools->timerWatchers)),
+    timerWheel(new EventDispatcherLibUvTimerWheel(loop)),
+    zeroTimers(new EventDispatcherLibUvZeroTimerQueue(loop)),
+    streams(new EventDispatcherLibUvStreamRegistry(loop)),
+#ifdef Q_OS_LINUX
+    timerFdNotifier(new EventDispatcherLibUvTimerFdNotifier(loop)),
+#endif
     timerTracker(new EventDispatcherLibUvTimerTracker()),
-    asyncChannel(new EventDispatcherLibUvAsyncChannel()),
+    asyncChannel(new EventDispatcherLibUvAsyncChannel(loop)),
+    workQueue(new EventDispatcherLibUvWorkQueue(loop)),
+    metrics(new EventDispatcherLibUvLoopMetrics()),
+    profiler(new EventDispatcherLibUvDispatchProfiler()),
+    budget(new EventDispatcherLibUvDispatchBudget()),
     finalise(false),
+    guiThread(false),
     osEventDispatcher(nullptr)
 {
+#ifdef Q_OS_LINUX
+    if (!timerFdNotifier->isValid()) {
+        timerFdNotifier.reset();
+    }
+#endif
+    // with nothing else active uv_run would return right away and an idle thread would spin, the
+    // wakeup handle keeps a loop of our own blocking; the default loop is shared and is not held
+    if (ownsLoop) {
+        asyncChannel->ref();
+    }
 }
 
 EventDispatcherLibUv::~EventDispatcherLibUv(void)
 {
+    workQueue->cancelAll();
+    // sockets outliving their dispatcher have their handles closed now, while the loop still runs
+    streams.reset();
+    platformBridge.reset();
     socketNotifier.reset();
     timerNotifier.reset();
+    timerWheel.reset();
+    zeroTimers.reset();
+#ifdef Q_OS_LINUX
+    timerFdNotifier.reset();
+#endif
     timerTracker.reset();
     asyncChannel.reset();
-    uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+    // the pooled watchers are released from their close callbacks, which may take more than one
+    // pass to run, e.g. for poll handles on windows; the pools must not go before the last one.
+    // Work already running on the threadpool is waited for as well, without its done callback
+    do {
+        uv_run(loop, workQueue->size() ? UV_RUN_ONCE : UV_RUN_NOWAIT);
+    } while (handlePools->pollWatchers.counters().inUse || handlePools->timerWatchers.counters().inUse || workQueue->size());
+    workQueue.reset();
+    if (ownsLoop) {
+        if (uv_loop_close(loop) == 0) {
+            delete loop;
+        } else {
+            qWarning() << "EventDispatcherLibUv: private loop still has open handles, leaking it";
+        }
+    }
     if (osEventDispatcher) {
         delete osEventDispatcher;
     }
+    readBuffers->orphan();
+}
+
+uv_loop_s *EventDispatcherLibUv::uvLoop() const
+{
+    return loop;
+}
+
+void EventDispatcherLibUv::post(std::function<void()> task)
+{
+    // the platform dispatcher may be the one blocking, see processEvents
+    if (asyncChannel->post(std::move(task)) && osEventDispatcher) {
+        osEventDispatcher->wakeUp();
+    }
+}
+
+int EventDispatcherLibUv::queueWork(QObject *receiver, std::function<void()> work, std::function<void()> done)
+{
+    return workQueue->queueWork(receiver, std::move(work), std::move(done));
+}
+
+bool EventDispatcherLibUv::cancelWork(int workId)
+{
+    return workQueue->cancelWork(workId);
 }
 
 void EventDispatcherLibUv::wakeUp(void)
@@ -83,22 +179,40 @@ void EventDispatcherLibUv::flush(void)
 
 bool EventDispatcherLibUv::processEvents(QEventLoop::ProcessEventsFlags flags)
 {
+    EventDispatcherLibUvPhaseClock clock(*metrics, loop);
+    if (platformBridge) {
+        return processPlatformEvents(flags, clock);
+    }
     if (osEventDispatcher) {
         osEventDispatcher->processEvents(flags & ~QEventLoop::WaitForMoreEvents & ~QEventLoop::EventLoopExec);
+        clock.mark(LoopMetrics::PlatformPhase);
     } else {
         emit awake();
-        QWindowSystemInterface::sendWindowSystemEvents(flags);
+        if (guiThread) {
+            QWindowSystemInterface::sendWindowSystemEvents(flags);
+        }
+        clock.mark(LoopMetrics::WindowSystemEventsPhase);
     }
     QCoreApplication::sendPostedEvents();
+    clock.mark(LoopMetrics::PostedEventsPhase);
     emit aboutToBlock();
 
-    int leftHandles = uv_run(uv_default_loop(), UV_RUN_ONCE);
+    budget->startIteration();
+    dispatchDeferred();
+    socketNotifier->commitPendingChanges();
+    // events left over from the budget must not wait for new ones
+    int leftHandles = uv_run(loop, budget->hasDeferred() ? UV_RUN_NOWAIT : UV_RUN_ONCE);
 #ifdef Q_OS_WIN
     activateEventNotifiers();
 #endif
+    clock.mark(LoopMetrics::LibuvPhase);
+    if (budget->hasDeferred()) {
+        return true;
+    }
     if (!leftHandles) {
         if (osEventDispatcher) {
             osEventDispatcher->processEvents(flags & ~QEventLoop::EventLoopExec | QEventLoop::WaitForMoreEvents);
+            clock.mark(LoopMetrics::PlatformPhase);
         } else if (finalise) {
             qApp->exit(0);
         }
@@ -106,6 +220,38 @@ bool EventDispatcherLibUv::processEvents(QEventLoop::ProcessEventsFlags flags)
     return leftHandles;
 }
 
+// the platform dispatcher blocks once for both sources, it wakes up for the libuv backend fd and
+// for the next libuv timeout, libuv itself is only ever run without waiting
+bool EventDispatcherLibUv::processPlatformEvents(QEventLoop::ProcessEventsFlags flags, EventDispatcherLibUvPhaseClock &clock)
+{
+    emit awake();
+    budget->startIteration();
+    dispatchDeferred();
+    socketNotifier->commitPendingChanges();
+    uv_run(loop, UV_RUN_NOWAIT);
+    clock.mark(LoopMetrics::LibuvPhase);
+    QCoreApplication::sendPostedEvents();
+    clock.mark(LoopMetrics::PostedEventsPhase);
+
+    // the bridge runs libuv once more, which hands the started watchers to the backend; notifiers
+    // changed from that run only get there on the next iteration, the platform must not wait then
+    socketNotifier->commitPendingChanges();
+    QEventLoop::ProcessEventsFlags platformFlags = flags & ~QEventLoop::EventLoopExec;
+    bool wait = platformBridge->prepareWait();
+    if (!wait || socketNotifier->commitPendingChanges() || budget->hasDeferred()) {
+        platformFlags = platformFlags & ~QEventLoop::WaitForMoreEvents;
+    }
+    clock.mark(LoopMetrics::LibuvPhase);
+    emit aboutToBlock();
+    osEventDispatcher->processEvents(platformFlags);
+    clock.mark(LoopMetrics::PlatformPhase);
+
+    socketNotifier->commitPendingChanges();
+    bool leftHandles = uv_run(loop, UV_RUN_NOWAIT);
+    clock.mark(LoopMetrics::LibuvPhase);
+    return leftHandles || budget->hasDeferred();
+}
+
 bool EventDispatcherLibUv::hasPendingEvents(void)
 {
     if (osEventDispatcher) {
@@ -116,52 +262,256 @@ bool EventDispatcherLibUv::hasPendingEvents(void)
 
 void EventDispatcherLibUv::registerSocketNotifier(QSocketNotifier* notifier)
 {
-    socketNotifier->registerSocketNotifier(notifier->socket(), notifier->type(), [notifier]{
-        QEvent event(QEvent::SockAct);
-        QCoreApplication::sendEvent(notifier, &event);
+    if (platformBridge && platformBridge->owns(notifier)) {
+        osEventDispatcher->registerSocketNotifier(notifier);
+        return;
+    }
+    socketNotifier->registerSocketNotifier(notifier->socket(), notifier->type(), [notifier, this]{
+        if (!budget->defer(SocketDispatch, notifier, notifier->socket())) {
+            dispatchSocket(notifier);
+        }
     });
 }
 void EventDispatcherLibUv::unregisterSocketNotifier(QSocketNotifier* notifier)
 {
+    if (platformBridge && platformBridge->owns(notifier)) {
+        osEventDispatcher->unregisterSocketNotifier(notifier);
+        return;
+    }
     socketNotifier->unregisterSocketNotifier(notifier->socket(), notifier->type());
+    budget->forgetNotifier(notifier);
 }
 
 void EventDispatcherLibUv::registerTimer(int timerId, int interval, Qt::TimerType timerType, QObject* object)
 {
-    timerNotifier->registerTimer(timerId, interval, [timerId, object, this] {
-        timerTracker->fireTimer(timerId);
-        QTimerEvent e(timerId);
-        QCoreApplication::sendEvent(object, &e);
-    });
+    auto callback = [timerId, object, this] {
+        if (!budget->defer(TimerDispatch, object, timerId)) {
+            dispatchTimer(timerId, object);
+        }
+    };
+    // precise timers keep a libuv handle each, or share the timerfd on linux, the rest share
+    // the timer wheel; 0 ms timers of either type are due on every iteration and skip them all
+    if (!interval) {
+        zeroTimers->registerTimer(timerId, callback);
+#ifdef Q_OS_LINUX
+    } else if (timerType == Qt::PreciseTimer && timerFdNotifier) {
+        timerFdNotifier->registerTimer(timerId, interval, callback);
+#endif
+    } else if (timerType == Qt::PreciseTimer) {
+        timerNotifier->registerTimer(timerId, interval, callback);
+    } else {
+        timerWheel->registerTimer(timerId, interval, timerType, callback);
+    }
     timerTracker->registerTimer(timerId, interval, timerType, object);
 }
 
 bool EventDispatcherLibUv::unregisterTimer(int timerId)
 {
-    bool ret = timerNotifier->unregisterTimer(timerId);
-    if (ret) {
-        timerTracker->unregisterTimer(timerId);
+    Qt::TimerType timerType;
+    if (!timerTracker->unregisterTimer(timerId, &timerType)) {
+        return false;
     }
-    return ret;
+    return stopTimer(timerId, timerType);
 }
 
 bool EventDispatcherLibUv::unregisterTimers(QObject* object)
 {
     bool ret = true;
-    for (auto info : registeredTimers(object)) {
-        ret &= unregisterTimer(info.timerId);
-    }
+    timerTracker->unregisterTimers(object, [this, &ret](int timerId, Qt::TimerType timerType) {
+        ret &= stopTimer(timerId, timerType);
+    });
     return ret;
 }
 
+bool EventDispatcherLibUv::stopTimer(int timerId, Qt::TimerType timerType)
+{
+    budget->forgetTimer(timerId);
+    if (zeroTimers->unregisterTimer(timerId)) {
+        return true;
+    }
+#ifdef Q_OS_LINUX
+    if (timerType == Qt::PreciseTimer && timerFdNotifier) {
+        return timerFdNotifier->unregisterTimer(timerId);
+    }
+#endif
+    if (timerType == Qt::PreciseTimer) {
+        return timerNotifier->unregisterTimer(timerId);
+    }
+    return timerWheel->unregisterTimer(timerId);
+}
+
+void EventDispatcherLibUv::dispatchSocket(QSocketNotifier *notifier)
+{
+    metrics->countSocketEvent();
+    QEvent event(QEvent::SockAct);
+    sendEvent(notifier, &event, SocketDispatch, notifier->socket());
+}
+
+void EventDispatcherLibUv::dispatchTimer(int timerId, QObject *object)
+{
+    metrics->countTimerEvent();
+    QTimerEvent e(timerId);
+    sendEvent(object, &e, TimerDispatch, timerId);
+}
+
+// the events deferred by the budget of earlier iterations come first
+void EventDispatcherLibUv::dispatchDeferred()
+{
+    EventDispatcherLibUvDispatchBudget::Dispatch dispatch;
+    while (budget->takeDeferred(dispatch)) {
+        if (dispatch.source == SocketDispatch) {
+            dispatchSocket(static_cast<QSocketNotifier *>(dispatch.receiver));
+        } else {
+            // fires while it waited are delivered as one event, as Qt does
+            dispatchTimer(dispatch.id, dispatch.receiver);
+        }
+    }
+}
+
+void EventDispatcherLibUv::sendEvent(QObject *receiver, QEvent *event, DispatchSource source, int id)
+{
+    if (!profiler->active()) {
+        QCoreApplication::sendEvent(receiver, event);
+        return;
+    }
+    const QMetaObject *type = receiver->metaObject();
+    QString objectName = receiver->objectName();
+    uint64_t started = uv_hrtime();
+    QCoreApplication::sendEvent(receiver, event);
+    profiler->record(source, id, type, objectName, uv_hrtime() - started);
+}
+
 QList<QAbstractEventDispatcher::TimerInfo> EventDispatcherLibUv::registeredTimers(QObject* object) const
 {
     return timerTracker->getTimerInfo(object);
 }
 
+// asks the engine that armed the timer, a timer whose dispatch the budget deferred is overdue;
+// the loop time stands still between iterations and is brought up to date first
 int EventDispatcherLibUv::remainingTime(int timerId)
 {
-    return timerTracker->remainingTime(timerId);
+    Qt::TimerType timerType;
+    if (!timerTracker->find(timerId, &timerType)) {
+        return -1;
+    }
+    if (budget->defersTimer(timerId)) {
+        return 0;
+    }
+    int remaining = zeroTimers->remainingTime(timerId);
+    if (remaining >= 0) {
+        return remaining;
+    }
+#ifdef Q_OS_LINUX
+    if (timerType == Qt::PreciseTimer && timerFdNotifier) {
+        return timerFdNotifier->remainingTime(timerId);
+    }
+#endif
+    uv_update_time(loop);
+    if (timerType == Qt::PreciseTimer) {
+        return timerNotifier->remainingTime(timerId);
+    }
+    return timerWheel->remainingTime(timerId);
+}
+
+void EventDispatcherLibUv::setTimerCatchUpPolicy(TimerCatchUpPolicy policy)
+{
+    timerNotifier->setCatchUpPolicy(policy);
+#ifdef Q_OS_LINUX
+    if (timerFdNotifier) {
+        timerFdNotifier->setCatchUpPolicy(policy);
+    }
+#endif
+    timerWheel->setCatchUpPolicy(policy);
+}
+
+EventDispatcherLibUv::PoolStatistics EventDispatcherLibUv::poolStatistics() const
+{
+    PoolStatistics statistics;
+    statistics.socketWatchers = poolOccupancy(handlePools->pollWatchers.counters());
+    statistics.timerWatchers = poolOccupancy(handlePools->timerWatchers.counters());
+    statistics.wheelTimers = poolOccupancy(timerWheel->poolCounters());
+    statistics.zeroTimers = poolOccupancy(zeroTimers->poolCounters());
+    statistics.readBuffers = poolOccupancy(readBuffers->counters());
+    return statistics;
+}
+
+EventDispatcherLibUvReadBufferPool *EventDispatcherLibUv::readBufferPool() const
+{
+    return readBuffers;
+}
+
+EventDispatcherLibUvStreamRegistry *EventDispatcherLibUv::streamRegistry() const
+{
+    return streams.get();
+}
+
+EventDispatcherLibUv::SocketStatistics EventDispatcherLibUv::socketStatistics() const
+{
+    SocketStatistics statistics;
+    statistics.pollStarts = socketNotifier->pollStarts();
+    statistics.pollStops = socketNotifier->pollStops();
+    return statistics;
+}
+
+EventDispatcherLibUv::TimerStatistics EventDispatcherLibUv::timerStatistics() const
+{
+    TimerStatistics statistics;
+    statistics.wakeups = timerWheel->wakeups();
+    statistics.expirations = timerWheel->expirations();
+    return statistics;
+}
+
+void EventDispatcherLibUv::setLoopMetricsEnabled(bool enabled)
+{
+    metrics->setEnabled(enabled);
+}
+
+EventDispatcherLibUv::LoopMetrics EventDispatcherLibUv::loopMetrics() const
+{
+    static_assert(int(LoopMetrics::PhaseCount) == int(EventDispatcherLibUvLoopMetrics::phaseCount)
+                  && int(LoopMetrics::HistogramBuckets) == int(EventDispatcherLibUvLoopMetrics::histogramBuckets),
+                  "loop metrics layout mismatch");
+    const std::memory_order relaxed = std::memory_order_relaxed;
+    LoopMetrics snapshot;
+    snapshot.timestampNs = uv_hrtime();
+    snapshot.iterations = metrics->iterations.load(relaxed);
+    snapshot.idleNs = metrics->idleNs.load(relaxed);
+    snapshot.socketEvents = metrics->socketEvents.load(relaxed);
+    snapshot.timerEvents = metrics->timerEvents.load(relaxed);
+    snapshot.postedTasks = asyncChannel->tasksRun();
+    for (int phase = 0; phase < LoopMetrics::PhaseCount; ++phase) {
+        snapshot.phases[phase].samples = metrics->phaseSamples[phase].load(relaxed);
+        snapshot.phases[phase].totalNs = metrics->phaseNs[phase].load(relaxed);
+        for (int bucket = 0; bucket < LoopMetrics::HistogramBuckets; ++bucket) {
+            snapshot.phases[phase].histogram[bucket] = metrics->histogram[phase][bucket].load(relaxed);
+        }
+    }
+    return snapshot;
+}
+
+void EventDispatcherLibUv::setSlowDispatchThreshold(qint64 thresholdUs, SlowDispatchHandler handler)
+{
+    profiler->setSlowThreshold(thresholdUs > 0 ? uint64_t(thresholdUs) * 1000 : 0, std::move(handler));
+}
+
+void EventDispatcherLibUv::setDispatchProfilingEnabled(bool enabled)
+{
+    profiler->setAggregating(enabled);
+}
+
+QList<EventDispatcherLibUv::DispatchRecord> EventDispatcherLibUv::topDispatches(int count) const
+{
+    return profiler->top(count);
+}
+
+void EventDispatcherLibUv::resetDispatchProfile()
+{
+    profiler->reset();
+}
+
+void EventDispatcherLibUv::setDispatchBudget(int maxDispatches, qint64 maxUs)
+{
+    budget->setLimits(maxDispatches, maxUs > 0 ? uint64_t(maxUs) * 1000 : 0);
 }
 
 #ifdef Q_OS_WIN
@@ -250,16 +600,28 @@ void EventDispatcherLibUv::unregisterEventNotifier(QWinEventNotifier *notifier)
 #endif
 
 void EventDispatcherLibUv::startingUp() {
+    // window system events and the platform dispatcher belong to the gui thread only
+    guiThread = qApp && qApp->thread() == QThread::currentThread();
+    if (!guiThread) {
+        return;
+    }
     auto pi = QGuiApplicationPrivate::platformIntegration();
     if (pi) {
         osEventDispatcher = pi->createEventDispatcher();
         if (osEventDispatcher) {
             osEventDispatcher->startingUp();
+#ifndef Q_OS_WIN
+            if (uv_backend_fd(loop) >= 0) {
+                platformBridge.reset(new EventDispatcherLibUvPlatformBridge(loop, osEventDispatcher));
+                platformBridge->watchBackend();
+            }
+#endif
         }
     }
 }
 
 void EventDispatcherLibUv::closingDown() {
+    platformBridge.reset();
     if (osEventDispatcher) {
         osEventDispatcher->closingDown();
     }
@@ -267,7 +629,7 @@ void EventDispatcherLibUv::closingDown() {
 
 void EventDispatcherLibUv::setFinalise()
 {
-    forgetCurrentUvHandles();
+    forgetCurrentUvHandles(loop);
     finalise = true;
 }
 
@@ -2,9 +2,15 @@
 #define EVENTDISPATCHERLIBUV_H
 
 #include <QAbstractEventDispatcher>
+#include <QByteArray>
+#include <QList>
 #include <QMap>
+#include <QString>
 
+#include <functional>
 #include <memory>
+#include <type_traits>
+#include <utility>
 #ifdef Q_OS_WIN
 #include <windows.h>
 #include <mutex>
@@ -12,20 +18,62 @@
 #endif
 #include <time.h>
 
+struct uv_loop_s;
 
 namespace qtjs {
 
-class EventDispatcherLibUvSocketNotifier;
-class EventDispatcherLibUvTimerNotifier;
+struct EventDispatcherLibUvHandlePools;
+class EventDispatcherLibUvReadBufferPool;
+class EventDispatcherLibUvLoopMetrics;
+class EventDispatcherLibUvPhaseClock;
+class EventDispatcherLibUvDispatchProfiler;
+class EventDispatcherLibUvDispatchBudget;
+struct LibuvDirectApi;
+class EventDispatcherLibUvPlatformBridge;
 class EventDispatcherLibUvTimerTracker;
-class EventDispatcherLibUvAsyncChannel;
+template <typename Api> class EventDispatcherLibUvBasicSocketNotifier;
+template <typename Api> class EventDispatcherLibUvBasicTimerNotifier;
+template <typename Api> class EventDispatcherLibUvBasicTimerWheel;
+template <typename Api> class EventDispatcherLibUvBasicZeroTimerQueue;
+template <typename Api> class EventDispatcherLibUvBasicStreamRegistry;
+#ifdef Q_OS_LINUX
+template <typename Api> class EventDispatcherLibUvBasicTimerFdNotifier;
+#endif
+template <typename Api> class EventDispatcherLibUvBasicAsyncChannel;
+template <typename Api> class EventDispatcherLibUvBasicWorkQueue;
+typedef EventDispatcherLibUvBasicSocketNotifier<LibuvDirectApi> EventDispatcherLibUvSocketNotifier;
+typedef EventDispatcherLibUvBasicTimerNotifier<LibuvDirectApi> EventDispatcherLibUvTimerNotifier;
+typedef EventDispatcherLibUvBasicTimerWheel<LibuvDirectApi> EventDispatcherLibUvTimerWheel;
+typedef EventDispatcherLibUvBasicZeroTimerQueue<LibuvDirectApi> EventDispatcherLibUvZeroTimerQueue;
+typedef EventDispatcherLibUvBasicStreamRegistry<LibuvDirectApi> EventDispatcherLibUvStreamRegistry;
+#ifdef Q_OS_LINUX
+typedef EventDispatcherLibUvBasicTimerFdNotifier<LibuvDirectApi> EventDispatcherLibUvTimerFdNotifier;
+#endif
+typedef EventDispatcherLibUvBasicAsyncChannel<LibuvDirectApi> EventDispatcherLibUvAsyncChannel;
+typedef EventDispatcherLibUvBasicWorkQueue<LibuvDirectApi> EventDispatcherLibUvWorkQueue;
 
 class EventDispatcherLibUv : public QAbstractEventDispatcher {
     Q_OBJECT
+    uv_loop_s *loop;
+    bool ownsLoop;
+    std::unique_ptr<EventDispatcherLibUvHandlePools> handlePools;
+    // shared with the chunks read from streams, which may outlive the dispatcher
+    EventDispatcherLibUvReadBufferPool *readBuffers;
     std::unique_ptr<EventDispatcherLibUvSocketNotifier> socketNotifier;
     std::unique_ptr<EventDispatcherLibUvTimerNotifier> timerNotifier;
+    std::unique_ptr<EventDispatcherLibUvTimerWheel> timerWheel;
+    std::unique_ptr<EventDispatcherLibUvZeroTimerQueue> zeroTimers;
+    std::unique_ptr<EventDispatcherLibUvStreamRegistry> streams;
+#ifdef Q_OS_LINUX
+    // precise timers go to libuv timers when there is no timerfd
+    std::unique_ptr<EventDispatcherLibUvTimerFdNotifier> timerFdNotifier;
+#endif
     std::unique_ptr<EventDispatcherLibUvTimerTracker> timerTracker;
     std::unique_ptr<EventDispatcherLibUvAsyncChannel> asyncChannel;
+    std::unique_ptr<EventDispatcherLibUvWorkQueue> workQueue;
+    std::unique_ptr<EventDispatcherLibUvLoopMetrics> metrics;
+    std::unique_ptr<EventDispatcherLibUvDispatchProfiler> profiler;
+    std::unique_ptr<EventDispatcherLibUvDispatchBudget> budget;
 #ifdef Q_OS_WIN
     struct WinEventNotifierInfo {
         WinEventNotifierInfo(EventDispatcherLibUv* dispatcher, QWinEventNotifier* notifier)
@@ -41,9 +89,37 @@ class EventDispatcherLibUv : public QAbstractEventDispatcher {
 #endif
 
 public:
+    enum LoopSource {
+        // share libuv's default loop, e.g. with other libuv code on the main thread
+        UseDefaultLoop,
+        // create a loop owned by this dispatcher, e.g. for worker QThreads
+        CreatePrivateLoop
+    };
+
     explicit EventDispatcherLibUv(QObject* parent = 0);
+    explicit EventDispatcherLibUv(LoopSource loopSource, QObject* parent = 0);
     virtual ~EventDispatcherLibUv(void);
 
+    uv_loop_s *uvLoop() const;
+
+    // runs the task on the thread of this dispatcher, without going through the posted event
+    // queue; safe to call from any thread while the dispatcher exists
+    void post(std::function<void()> task);
+
+    // runs work on libuv's threadpool, then done with what it returned on the thread of this
+    // dispatcher; done is dropped if the receiver was destroyed meanwhile or the work cancelled.
+    // Call them on the dispatcher thread; queueWork returns the id for cancelWork, 0 on failure
+    template <typename Work, typename Done, typename Result = decltype(std::declval<Work>()())>
+    typename std::enable_if<!std::is_void<Result>::value, int>::type queueWork(QObject *receiver, Work work, Done done)
+    {
+        std::shared_ptr<Result> result = std::make_shared<Result>();
+        return queueWork(receiver, std::function<void()>([work, result] { *result = work(); }),
+                         std::function<void()>([done, result] { done(std::move(*result)); }));
+    }
+    int queueWork(QObject *receiver, std::function<void()> work, std::function<void()> done);
+    // done is dropped in any case; true if the work was kept from starting, false once it runs
+    bool cancelWork(int workId);
+
     virtual void wakeUp(void);
     virtual void interrupt(void);
     virtual void flush(void);
@@ -60,6 +136,111 @@ public:
     virtual QList<QAbstractEventDispatcher::TimerInfo> registeredTimers(QObject* object) const;
     virtual int remainingTime(int timerId);
 
+    // repeating timers stay on the periods counted from their start, however late they fire;
+    // the policy decides what happens to the periods a busy loop missed
+    enum TimerCatchUpPolicy {
+        // fire once, the next period still ahead comes next (the default)
+        SkipMissedPeriods,
+        // fire once, the periods restart from now
+        FireOnceAndRestart,
+        // fire once for each missed period, back to back
+        BurstMissedPeriods
+    };
+    void setTimerCatchUpPolicy(TimerCatchUpPolicy policy);
+
+    // coarse timers are coalesced, so that several of them expire on one wakeup of the loop
+    struct TimerStatistics {
+        quint64 wakeups;
+        quint64 expirations;
+    };
+    TimerStatistics timerStatistics() const;
+
+    // socket notifier changes reach libuv once per loop iteration, as the net change per
+    // descriptor, apart from stops of descriptors left without notifiers, which are immediate;
+    // on linux each start costs libuv up to two epoll_ctl calls, each stop one
+    struct SocketStatistics {
+        quint64 pollStarts;
+        quint64 pollStops;
+    };
+    SocketStatistics socketStatistics() const;
+
+    // handles and their callback records are recycled through per-dispatcher slab pools
+    struct PoolOccupancy {
+        quint64 inUse;
+        quint64 highWaterMark;
+        quint64 capacity;
+    };
+    struct PoolStatistics {
+        PoolOccupancy socketWatchers;
+        PoolOccupancy timerWatchers;
+        PoolOccupancy wheelTimers;
+        PoolOccupancy zeroTimers;
+        PoolOccupancy readBuffers;
+    };
+    PoolStatistics poolStatistics() const;
+    EventDispatcherLibUvReadBufferPool *readBufferPool() const;
+    EventDispatcherLibUvStreamRegistry *streamRegistry() const;
+
+    // counters since creation, diff two snapshots for rates; they can be read from any thread.
+    // Event counts and iterations are always kept, phase times and libuv idle time only while
+    // timing is enabled. The libuv phase includes its wait for events, of which idleNs is the
+    // part spent blocked; on the gui thread the wait is in the platform phase instead.
+    struct LoopMetrics {
+        enum Phase {
+            WindowSystemEventsPhase,
+            PostedEventsPhase,
+            LibuvPhase,
+            PlatformPhase,
+            PhaseCount
+        };
+        // bucket 0 holds phases under 1us, bucket n those under 2^n us, the last all longer ones
+        static const int HistogramBuckets = 20;
+        struct PhaseTimes {
+            quint64 samples;
+            quint64 totalNs;
+            quint64 histogram[HistogramBuckets];
+        };
+        quint64 timestampNs;
+        quint64 iterations;
+        quint64 idleNs;
+        quint64 socketEvents;
+        quint64 timerEvents;
+        quint64 postedTasks;
+        PhaseTimes phases[PhaseCount];
+    };
+    void setLoopMetricsEnabled(bool enabled);
+    LoopMetrics loopMetrics() const;
+
+    // optional timing of socket and timer event delivery, attributed to the receiving object
+    // and to the socket descriptor or timer id; off unless profiling or a threshold is set
+    enum DispatchSource {
+        SocketDispatch,
+        TimerDispatch
+    };
+    struct DispatchRecord {
+        DispatchSource source;
+        int id;
+        QByteArray className;
+        QString objectName;
+        quint64 count;
+        quint64 totalNs;
+        quint64 maxNs;
+    };
+    // called on the dispatcher thread with each slow dispatch as a record of its own
+    typedef std::function<void(const DispatchRecord &)> SlowDispatchHandler;
+    // dispatches taking at least thresholdUs go to the handler, or to qWarning without one; 0 turns it off
+    void setSlowDispatchThreshold(qint64 thresholdUs, SlowDispatchHandler handler = SlowDispatchHandler());
+    // aggregates every dispatch per receiver while enabled
+    void setDispatchProfilingEnabled(bool enabled);
+    // the receivers with the most time spent in total, may be called from any thread
+    QList<DispatchRecord> topDispatches(int count) const;
+    void resetDispatchProfile();
+
+    // bounds the socket and timer events dispatched per loop iteration, by count and by time;
+    // the events past it go first on the next iteration, in the order they became ready.
+    // 0 leaves a limit out, both are off by default
+    void setDispatchBudget(int maxDispatches, qint64 maxUs);
+
 #ifdef Q_OS_WIN
     virtual bool registerEventNotifier(QWinEventNotifier *notifier);
     virtual void unregisterEventNotifier(QWinEventNotifier *notifier);
@@ -76,8 +257,16 @@ private:
     void queueEventNotifierActivation(WinEventNotifierInfo* weni);
     static void CALLBACK queueEventNotifierActivation(PVOID context, BOOLEAN timedOut);
 #endif
+    bool stopTimer(int timerId, Qt::TimerType timerType);
+    void sendEvent(QObject *receiver, QEvent *event, DispatchSource source, int id);
+    void dispatchSocket(QSocketNotifier *notifier);
+    void dispatchTimer(int timerId, QObject *object);
+    void dispatchDeferred();
+    bool processPlatformEvents(QEventLoop::ProcessEventsFlags flags, EventDispatcherLibUvPhaseClock &clock);
     bool finalise;
+    bool guiThread;
     QAbstractEventDispatcher *osEventDispatcher;
+    std::unique_ptr<EventDispatcherLibUvPlatformBridge> platformBridge;
 
     Q_DISABLE_COPY(EventDispatcherLibUv)
 };
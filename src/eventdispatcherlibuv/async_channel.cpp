@@ -3,34 +3,129 @@
 namespace qtjs {
 
 
-EventDispatcherLibUvAsyncChannel::EventDispatcherLibUvAsyncChannel(LibuvApi *api) : api(api), handle(nullptr)
+EventDispatcherLibUvTaskQueue::EventDispatcherLibUvTaskQueue() : head(&stub), tail(&stub), wakeupPending(false), executed(0)
 {
-    if (!this->api) {
-        this->api.reset(new LibuvApi());
+    stub.next.store(nullptr, std::memory_order_relaxed);
+}
+
+EventDispatcherLibUvTaskQueue::~EventDispatcherLibUvTaskQueue()
+{
+    while (Node *node = pop()) {
+        delete node;
+    }
+}
+
+bool EventDispatcherLibUvTaskQueue::push(std::function<void()> task)
+{
+    Node *node = new Node();
+    node->task = std::move(task);
+    pushNode(node);
+    return !wakeupPending.exchange(true, std::memory_order_acq_rel);
+}
+
+void EventDispatcherLibUvTaskQueue::pushNode(Node *node)
+{
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node *previous = head.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+}
+
+// a producer that got preempted between its two steps leaves the queue looking empty,
+// it asks for another wakeup once it has linked its task, as the pending flag is cleared first
+void EventDispatcherLibUvTaskQueue::run()
+{
+    wakeupPending.store(false, std::memory_order_release);
+    while (Node *node = pop()) {
+        std::function<void()> task = std::move(node->task);
+        delete node;
+        executed.store(executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        task();
+    }
+}
+
+EventDispatcherLibUvTaskQueue::Node *EventDispatcherLibUvTaskQueue::pop()
+{
+    Node *first = tail;
+    Node *next = first->next.load(std::memory_order_acquire);
+    if (first == &stub) {
+        if (!next) {
+            return nullptr;
+        }
+        tail = next;
+        first = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        tail = next;
+        return first;
     }
+    if (first != head.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    pushNode(&stub);
+    next = first->next.load(std::memory_order_acquire);
+    if (next) {
+        tail = next;
+        return first;
+    }
+    return nullptr;
+}
+
+
+template <typename Api>
+EventDispatcherLibUvBasicAsyncChannel<Api>::EventDispatcherLibUvBasicAsyncChannel(uv_loop_t *loop, Api *api) : api(api), handle(nullptr), refs(0)
+{
     handle = new uv_async_t();
-    this->api->uv_async_init(uv_default_loop(), handle, nullptr);
+    handle->data = &tasks;
+    this->api->uv_async_init(loop, handle, &uv_async_watcher);
     this->api->uv_unref((uv_handle_t*)handle);
 }
 
-EventDispatcherLibUvAsyncChannel::~EventDispatcherLibUvAsyncChannel()
+template <typename Api>
+EventDispatcherLibUvBasicAsyncChannel<Api>::~EventDispatcherLibUvBasicAsyncChannel()
 {
+    handle->data = nullptr;
     api->uv_close((uv_handle_t *)handle, &uv_close_asyncHandle);
 }
 
-void EventDispatcherLibUvAsyncChannel::ref()
+template <typename Api>
+void EventDispatcherLibUvBasicAsyncChannel<Api>::ref()
+{
+    if (!refs++) {
+        api->uv_ref((uv_handle_t*)handle);
+    }
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicAsyncChannel<Api>::unref()
 {
-    api->uv_ref((uv_handle_t*)handle);
+    if (!--refs) {
+        api->uv_unref((uv_handle_t*)handle);
+    }
 }
 
-void EventDispatcherLibUvAsyncChannel::unref()
+template <typename Api>
+void EventDispatcherLibUvBasicAsyncChannel<Api>::send()
 {
-    api->uv_unref((uv_handle_t*)handle);
+    api->uv_async_send(handle);
 }
 
-void EventDispatcherLibUvAsyncChannel::send()
+template <typename Api>
+bool EventDispatcherLibUvBasicAsyncChannel<Api>::post(std::function<void()> task)
 {
+    if (!tasks.push(std::move(task))) {
+        return false;
+    }
     api->uv_async_send(handle);
+    return true;
+}
+
+void uv_async_watcher(uv_async_t* handle)
+{
+    EventDispatcherLibUvTaskQueue *tasks = (EventDispatcherLibUvTaskQueue *) handle->data;
+    if (tasks) {
+        tasks->run();
+    }
 }
 
 void uv_close_asyncHandle(uv_handle_t* handle)
@@ -38,4 +133,7 @@ void uv_close_asyncHandle(uv_handle_t* handle)
     delete (uv_async_t *)handle;
 }
 
+template class EventDispatcherLibUvBasicAsyncChannel<LibuvDirectApi>;
+template class EventDispatcherLibUvBasicAsyncChannel<LibuvApi>;
+
 }
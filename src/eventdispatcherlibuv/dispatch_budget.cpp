@@ -0,0 +1,124 @@
+#include "../eventdispatcherlibuv_p.h"
+
+namespace qtjs {
+
+
+EventDispatcherLibUvDispatchBudget::EventDispatcherLibUvDispatchBudget()
+    : dispatchLimit(0), timeLimitNs(0), maxDispatches(0), maxNs(0), dispatched(0), started(0)
+{
+}
+
+void EventDispatcherLibUvDispatchBudget::setLimits(int maxDispatches, uint64_t maxNs)
+{
+    dispatchLimit.store(std::max(maxDispatches, 0), std::memory_order_relaxed);
+    timeLimitNs.store(maxNs, std::memory_order_relaxed);
+}
+
+// limits set from another thread take effect from the next iteration on
+void EventDispatcherLibUvDispatchBudget::startIteration()
+{
+    maxDispatches = dispatchLimit.load(std::memory_order_relaxed);
+    maxNs = timeLimitNs.load(std::memory_order_relaxed);
+    dispatched = 0;
+    started = maxNs ? uv_hrtime() : 0;
+}
+
+bool EventDispatcherLibUvDispatchBudget::exhausted() const
+{
+    if (maxDispatches && dispatched >= maxDispatches) {
+        return true;
+    }
+    return maxNs && uv_hrtime() - started >= maxNs;
+}
+
+bool EventDispatcherLibUvDispatchBudget::isDeferred(EventDispatcherLibUv::DispatchSource source, QObject *receiver, int id) const
+{
+    if (source == EventDispatcherLibUv::SocketDispatch) {
+        return deferredNotifiers.count(receiver);
+    }
+    return deferredTimers.count(id);
+}
+
+bool EventDispatcherLibUvDispatchBudget::defer(EventDispatcherLibUv::DispatchSource source, QObject *receiver, int id)
+{
+    if (!limited()) {
+        return false;
+    }
+    // still waiting for its turn
+    if (isDeferred(source, receiver, id)) {
+        if (source == EventDispatcherLibUv::TimerDispatch) {
+            ++deferredTimers[id];
+        }
+        return true;
+    }
+    if (!exhausted()) {
+        ++dispatched;
+        return false;
+    }
+    Dispatch dispatch = {source, receiver, id, 1};
+    deferred.push_back(dispatch);
+    if (source == EventDispatcherLibUv::SocketDispatch) {
+        deferredNotifiers.insert(receiver);
+    } else {
+        deferredTimers[id] = 1;
+    }
+    return true;
+}
+
+bool EventDispatcherLibUvDispatchBudget::takeDeferred(Dispatch &dispatch)
+{
+    while (!deferred.empty() && !exhausted()) {
+        dispatch = deferred.front();
+        deferred.pop_front();
+        // forgotten while it waited
+        if (!dispatch.receiver) {
+            continue;
+        }
+        if (dispatch.source == EventDispatcherLibUv::SocketDispatch) {
+            deferredNotifiers.erase(dispatch.receiver);
+        } else {
+            auto timer = deferredTimers.find(dispatch.id);
+            dispatch.fires = timer->second;
+            deferredTimers.erase(timer);
+        }
+        ++dispatched;
+        return true;
+    }
+    return false;
+}
+
+void EventDispatcherLibUvDispatchBudget::forgetNotifier(QObject *notifier)
+{
+    if (!deferredNotifiers.erase(notifier)) {
+        return;
+    }
+    for (Dispatch &dispatch : deferred) {
+        if (dispatch.source == EventDispatcherLibUv::SocketDispatch && dispatch.receiver == notifier) {
+            dispatch.receiver = nullptr;
+        }
+    }
+    dropForgotten();
+}
+
+void EventDispatcherLibUvDispatchBudget::forgetTimer(int timerId)
+{
+    if (!deferredTimers.erase(timerId)) {
+        return;
+    }
+    for (Dispatch &dispatch : deferred) {
+        if (dispatch.source == EventDispatcherLibUv::TimerDispatch && dispatch.id == timerId) {
+            dispatch.receiver = nullptr;
+        }
+    }
+    dropForgotten();
+}
+
+void EventDispatcherLibUvDispatchBudget::dropForgotten()
+{
+    if (!hasDeferred()) {
+        deferred.clear();
+    }
+}
+
+
+}
@@ -0,0 +1,113 @@
+#include "../eventdispatcherlibuv_p.h"
+
+#include <QDebug>
+
+namespace qtjs {
+
+
+EventDispatcherLibUvDispatchProfiler::EventDispatcherLibUvDispatchProfiler()
+    : aggregating(false), slowThresholdNs(0), timing(false)
+{
+}
+
+bool EventDispatcherLibUvDispatchProfiler::Key::operator<(const Key &other) const
+{
+    if (source != other.source) {
+        return source < other.source;
+    }
+    if (id != other.id) {
+        return id < other.id;
+    }
+    if (type != other.type) {
+        return std::less<const QMetaObject *>()(type, other.type);
+    }
+    return objectName < other.objectName;
+}
+
+void EventDispatcherLibUvDispatchProfiler::setAggregating(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    aggregating = enabled;
+    updateTiming();
+}
+
+void EventDispatcherLibUvDispatchProfiler::setSlowThreshold(uint64_t thresholdNs, EventDispatcherLibUv::SlowDispatchHandler handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    slowThresholdNs = thresholdNs;
+    slowHandler = std::move(handler);
+    updateTiming();
+}
+
+void EventDispatcherLibUvDispatchProfiler::updateTiming()
+{
+    timing.store(aggregating || slowThresholdNs, std::memory_order_relaxed);
+}
+
+void EventDispatcherLibUvDispatchProfiler::record(EventDispatcherLibUv::DispatchSource source, int id, const QMetaObject *type, const QString &objectName, uint64_t ns)
+{
+    EventDispatcherLibUv::SlowDispatchHandler handler;
+    bool isSlow;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (aggregating) {
+            Key key = {source, id, type, objectName};
+            auto found = records.find(key);
+            if (found == records.end()) {
+                Record record = {source, id, QByteArray(type->className()), objectName, 0, 0, 0};
+                found = records.insert(std::make_pair(key, record)).first;
+            }
+            Record &record = found->second;
+            ++record.count;
+            record.totalNs += ns;
+            record.maxNs = std::max<quint64>(record.maxNs, ns);
+        }
+        isSlow = slowThresholdNs && ns >= slowThresholdNs;
+        if (isSlow) {
+            handler = slowHandler;
+        }
+    }
+    if (!isSlow) {
+        return;
+    }
+    // outside of the lock, the handler may well look at the profile
+    Record slow = {source, id, QByteArray(type->className()), objectName, 1, ns, ns};
+    if (handler) {
+        handler(slow);
+    } else {
+        qWarning() << "EventDispatcherLibUv: slow" << (source == EventDispatcherLibUv::SocketDispatch ? "socket" : "timer")
+                   << "dispatch to" << type->className() << objectName
+                   << (source == EventDispatcherLibUv::SocketDispatch ? "fd" : "timer") << id
+                   << "took" << ns / 1000000.0 << "ms";
+    }
+}
+
+QList<EventDispatcherLibUvDispatchProfiler::Record> EventDispatcherLibUvDispatchProfiler::top(int count) const
+{
+    std::vector<Record> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted.reserve(records.size());
+        for (const auto &entry : records) {
+            sorted.push_back(entry.second);
+        }
+    }
+    size_t kept = std::min<size_t>(std::max(count, 0), sorted.size());
+    std::partial_sort(sorted.begin(), sorted.begin() + kept, sorted.end(), [](const Record &a, const Record &b) {
+        return a.totalNs > b.totalNs;
+    });
+    QList<Record> result;
+    for (size_t index = 0; index < kept; ++index) {
+        result.append(sorted[index]);
+    }
+    return result;
+}
+
+void EventDispatcherLibUvDispatchProfiler::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    records.clear();
+}
+
+
+}
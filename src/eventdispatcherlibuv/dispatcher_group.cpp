@@ -0,0 +1,295 @@
+#include "../eventdispatcherlibuvgroup.h"
+#include "../eventdispatcherlibuv_p.h"
+
+#include <QDebug>
+#include <QSemaphore>
+#include <QSocketNotifier>
+
+#include <limits>
+
+#ifndef Q_OS_WIN
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// every thread watching a shared listener is woken for a connection; EPOLLEXCLUSIVE does not
+// help, it only wakes one of the threads blocked in epoll_wait on the very set, and libuv would
+// have to nest such a set in its own. A thread takes this many connections per wakeup at most,
+// the others woken with it take the rest of the backlog.
+const int sharedAcceptBatch = 4;
+
+#ifndef Q_OS_WIN
+void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+// a non-blocking socket listening on host:port, or -1
+int openListener(const char *host, quint16 port, bool reusePort, int backlog)
+{
+    sockaddr_storage address;
+    socklen_t addressSize = sizeof(sockaddr_in);
+    if (!host) {
+        host = "0.0.0.0";
+    }
+    if (uv_ip4_addr(host, port, (sockaddr_in *)&address)) {
+        if (uv_ip6_addr(host, port, (sockaddr_in6 *)&address)) {
+            qWarning() << "EventDispatcherLibUvGroup: not a numeric address" << host;
+            return -1;
+        }
+        addressSize = sizeof(sockaddr_in6);
+    }
+    int fd = socket(address.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        qWarning() << "EventDispatcherLibUvGroup: cannot create a socket:" << qt_error_string(errno);
+        return -1;
+    }
+    setNonBlocking(fd);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+    if (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+        qWarning() << "EventDispatcherLibUvGroup: SO_REUSEPORT is not supported:" << qt_error_string(errno);
+        ::close(fd);
+        return -1;
+    }
+#else
+    if (reusePort) {
+        qWarning() << "EventDispatcherLibUvGroup: SO_REUSEPORT is not supported";
+        ::close(fd);
+        return -1;
+    }
+#endif
+    if (bind(fd, (sockaddr *)&address, addressSize) || ::listen(fd, backlog)) {
+        qWarning() << "EventDispatcherLibUvGroup: cannot listen on" << host << port << qt_error_string(errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+quint16 localPort(int fd)
+{
+    sockaddr_storage address;
+    socklen_t addressSize = sizeof(address);
+    if (getsockname(fd, (sockaddr *)&address, &addressSize)) {
+        return 0;
+    }
+    if (AF_INET6 == address.ss_family) {
+        return ntohs(((sockaddr_in6 *)&address)->sin6_port);
+    }
+    return ntohs(((sockaddr_in *)&address)->sin_port);
+}
+
+int acceptConnection(int fd)
+{
+#ifdef Q_OS_LINUX
+    return accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int connection = accept(fd, nullptr, nullptr);
+    if (connection >= 0) {
+        setNonBlocking(connection);
+    }
+    return connection;
+#endif
+}
+#endif
+
+}
+
+namespace qtjs {
+
+struct EventDispatcherLibUvGroup::Worker {
+    explicit Worker(int index)
+        : index(index), dispatcher(nullptr), listenFd(-1), notifier(nullptr), accepted(0) {}
+
+    int index;
+    QThread thread;
+    // owned by the thread, which deletes it when it finishes
+    EventDispatcherLibUv *dispatcher;
+    // a shard of its own, or the shared listener
+    int listenFd;
+    QSocketNotifier *notifier;
+    std::atomic<quint64> accepted;
+};
+
+
+EventDispatcherLibUvGroup::EventDispatcherLibUvGroup(int threadCount)
+    : next(0), sharedFd(-1), port(0)
+{
+    for (int index = 0; index < std::max(threadCount, 1); ++index) {
+        std::unique_ptr<Worker> worker(new Worker(index));
+        worker->dispatcher = new EventDispatcherLibUv(EventDispatcherLibUv::CreatePrivateLoop);
+        worker->thread.setEventDispatcher(worker->dispatcher);
+        worker->thread.start();
+        workers.push_back(std::move(worker));
+    }
+}
+
+EventDispatcherLibUvGroup::~EventDispatcherLibUvGroup()
+{
+    close();
+    for (auto &worker : workers) {
+        worker->thread.quit();
+    }
+    for (auto &worker : workers) {
+        worker->thread.wait();
+    }
+}
+
+int EventDispatcherLibUvGroup::size() const
+{
+    return workers.size();
+}
+
+QThread *EventDispatcherLibUvGroup::thread(int index) const
+{
+    return &workers[index]->thread;
+}
+
+EventDispatcherLibUv *EventDispatcherLibUvGroup::dispatcher(int index) const
+{
+    return workers[index]->dispatcher;
+}
+
+int EventDispatcherLibUvGroup::nextIndex()
+{
+    return next.fetch_add(1, std::memory_order_relaxed) % workers.size();
+}
+
+bool EventDispatcherLibUvGroup::listen(const char *host, quint16 port, ListenMode mode, AcceptHandler handler, int backlog)
+{
+#ifdef Q_OS_WIN
+    Q_UNUSED(host);
+    Q_UNUSED(port);
+    Q_UNUSED(mode);
+    Q_UNUSED(handler);
+    Q_UNUSED(backlog);
+    qWarning() << "EventDispatcherLibUvGroup: listening is not supported on windows";
+    return false;
+#else
+    if (this->port) {
+        return false;
+    }
+    std::vector<int> fds;
+    if (ReusePortShards == mode) {
+        // the first shard settles the port for the others
+        for (size_t index = 0; index < workers.size(); ++index) {
+            int fd = openListener(host, index ? this->port : port, true, backlog);
+            if (fd < 0) {
+                break;
+            }
+            this->port = localPort(fd);
+            fds.push_back(fd);
+        }
+        if (fds.size() != workers.size()) {
+            for (int fd : fds) {
+                ::close(fd);
+            }
+            this->port = 0;
+            return false;
+        }
+    } else {
+        sharedFd = openListener(host, port, false, backlog);
+        if (sharedFd < 0) {
+            return false;
+        }
+        this->port = localPort(sharedFd);
+        fds.assign(workers.size(), sharedFd);
+    }
+    acceptHandler = std::move(handler);
+    for (size_t index = 0; index < workers.size(); ++index) {
+        Worker *worker = workers[index].get();
+        int fd = fds[index];
+        worker->accepted = 0;
+        runAndWait(worker, [this, worker, fd] { watch(worker, fd); });
+    }
+    return true;
+#endif
+}
+
+quint16 EventDispatcherLibUvGroup::serverPort() const
+{
+    return port;
+}
+
+quint64 EventDispatcherLibUvGroup::acceptedConnections(int index) const
+{
+    return workers[index]->accepted.load(std::memory_order_relaxed);
+}
+
+void EventDispatcherLibUvGroup::close()
+{
+#ifndef Q_OS_WIN
+    for (auto &worker : workers) {
+        Worker *closing = worker.get();
+        if (!closing->notifier) {
+            continue;
+        }
+        runAndWait(closing, [this, closing] {
+            delete closing->notifier;
+            closing->notifier = nullptr;
+            if (closing->listenFd != sharedFd) {
+                ::close(closing->listenFd);
+            }
+            closing->listenFd = -1;
+        });
+    }
+    if (sharedFd >= 0) {
+        ::close(sharedFd);
+        sharedFd = -1;
+    }
+#endif
+    acceptHandler = nullptr;
+    port = 0;
+}
+
+void EventDispatcherLibUvGroup::handOver(int index, int fd, std::function<void(int fd)> handler)
+{
+    workers[index]->dispatcher->post([handler, fd] { handler(fd); });
+}
+
+// runs on the thread of the worker
+void EventDispatcherLibUvGroup::watch(Worker *worker, int fd)
+{
+    worker->listenFd = fd;
+    worker->notifier = new QSocketNotifier(fd, QSocketNotifier::Read);
+    QObject::connect(worker->notifier, &QSocketNotifier::activated, [this, worker] { acceptConnections(worker); });
+}
+
+// runs on the thread of the worker, until the backlog is empty or another thread took the rest;
+// a shard is drained, a shared listener is left to the other threads after a batch
+void EventDispatcherLibUvGroup::acceptConnections(Worker *worker)
+{
+#ifndef Q_OS_WIN
+    int batch = worker->listenFd == sharedFd ? sharedAcceptBatch : std::numeric_limits<int>::max();
+    for (int taken = 0; taken < batch; ++taken) {
+        int fd = acceptConnection(worker->listenFd);
+        if (fd < 0) {
+            break;
+        }
+        worker->accepted.fetch_add(1, std::memory_order_relaxed);
+        acceptHandler(worker->index, fd);
+    }
+#else
+    Q_UNUSED(worker);
+#endif
+}
+
+void EventDispatcherLibUvGroup::runAndWait(Worker *worker, std::function<void()> task)
+{
+    QSemaphore done;
+    worker->dispatcher->post([&task, &done] {
+        task();
+        done.release();
+    });
+    done.acquire();
+}
+
+}
@@ -33,11 +33,46 @@ int LibuvApi::uv_timer_stop(uv_timer_t* handle)
     return ::uv_timer_stop(handle);
 }
 
+int LibuvApi::uv_check_init(uv_loop_t* loop, uv_check_t* check)
+{
+    return ::uv_check_init(loop, check);
+}
+
+int LibuvApi::uv_check_start(uv_check_t* check, uv_check_cb cb)
+{
+    return ::uv_check_start(check, cb);
+}
+
+int LibuvApi::uv_check_stop(uv_check_t* check)
+{
+    return ::uv_check_stop(check);
+}
+
+int LibuvApi::uv_idle_init(uv_loop_t* loop, uv_idle_t* idle)
+{
+    return ::uv_idle_init(loop, idle);
+}
+
+int LibuvApi::uv_idle_start(uv_idle_t* idle, uv_idle_cb cb)
+{
+    return ::uv_idle_start(idle, cb);
+}
+
+int LibuvApi::uv_idle_stop(uv_idle_t* idle)
+{
+    return ::uv_idle_stop(idle);
+}
+
 uint64_t LibuvApi::uv_hrtime()
 {
     return ::uv_hrtime();
 }
 
+uint64_t LibuvApi::uv_now(const uv_loop_t* loop)
+{
+    return ::uv_now(loop);
+}
+
 void LibuvApi::uv_close(uv_handle_t* handle, uv_close_cb close_cb)
 {
     return ::uv_close(handle, close_cb);
@@ -62,4 +97,14 @@ void LibuvApi::uv_unref(uv_handle_t* handle)
     ::uv_unref(handle);
 }
 
+int LibuvApi::uv_queue_work(uv_loop_t* loop, uv_work_t* req, uv_work_cb work_cb, uv_after_work_cb after_work_cb)
+{
+    return ::uv_queue_work(loop, req, work_cb, after_work_cb);
+}
+
+int LibuvApi::uv_cancel(uv_req_t* req)
+{
+    return ::uv_cancel(req);
+}
+
 }
@@ -0,0 +1,57 @@
+#include "../eventdispatcherlibuv_p.h"
+
+namespace qtjs {
+
+
+EventDispatcherLibUvLoopMetrics::EventDispatcherLibUvLoopMetrics()
+    : iterations(0), idleNs(0), socketEvents(0), timerEvents(0), timing(false), idleTimeConfigured(false)
+{
+    for (int phase = 0; phase < phaseCount; ++phase) {
+        phaseSamples[phase].store(0, std::memory_order_relaxed);
+        phaseNs[phase].store(0, std::memory_order_relaxed);
+        for (int bucket = 0; bucket < histogramBuckets; ++bucket) {
+            histogram[phase][bucket].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void EventDispatcherLibUvLoopMetrics::recordPhase(int phase, uint64_t ns)
+{
+    bump(phaseSamples[phase]);
+    bump(phaseNs[phase], ns);
+    bump(histogram[phase][histogramBucket(ns)]);
+}
+
+void EventDispatcherLibUvLoopMetrics::finishIteration(uv_loop_t *loop, bool timed)
+{
+    bump(iterations);
+#if UV_VERSION_HEX >= 0x012700
+    // idle time accounting costs libuv two clock reads per poll, so it is only turned on once
+    // timing is, and from the loop thread, as the loop configuration is not thread safe
+    if (timed) {
+        if (!idleTimeConfigured) {
+            idleTimeConfigured = uv_loop_configure(loop, UV_METRICS_IDLE_TIME) == 0;
+        }
+        if (idleTimeConfigured) {
+            idleNs.store(uv_metrics_idle_time(loop), std::memory_order_relaxed);
+        }
+    }
+#else
+    (void)loop;
+    (void)timed;
+#endif
+}
+
+int EventDispatcherLibUvLoopMetrics::histogramBucket(uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    int bucket = 0;
+    while (us && bucket < histogramBuckets - 1) {
+        us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+
+}
@@ -0,0 +1,68 @@
+#include "../eventdispatcherlibuv_p.h"
+
+#include <QtCore/private/qabstracteventdispatcher_p.h>
+
+namespace qtjs {
+
+
+EventDispatcherLibUvPlatformBridge::EventDispatcherLibUvPlatformBridge(uv_loop_t *loop, QAbstractEventDispatcher *platform)
+    : loop(loop), platform(platform), backendNotifier(nullptr), creatingNotifier(false),
+      timerId(QAbstractEventDispatcherPrivate::allocateTimerId()), armedTimeout(-1)
+{
+}
+
+EventDispatcherLibUvPlatformBridge::~EventDispatcherLibUvPlatformBridge()
+{
+    if (armedTimeout >= 0) {
+        platform->unregisterTimer(timerId);
+    }
+    QAbstractEventDispatcherPrivate::releaseTimerId(timerId);
+    // the dispatcher no longer routes to the bridge while it is being destroyed
+    if (backendNotifier) {
+        platform->unregisterSocketNotifier(backendNotifier);
+        delete backendNotifier;
+    }
+}
+
+void EventDispatcherLibUvPlatformBridge::watchBackend()
+{
+    creatingNotifier = true;
+    backendNotifier = new QSocketNotifier(uv_backend_fd(loop), QSocketNotifier::Read);
+    creatingNotifier = false;
+}
+
+bool EventDispatcherLibUvPlatformBridge::owns(QSocketNotifier *notifier) const
+{
+    return creatingNotifier || notifier == backendNotifier;
+}
+
+bool EventDispatcherLibUvPlatformBridge::prepareWait()
+{
+    // libuv hands watchers started since its last poll, e.g. by a precise timer or a socket
+    // opened from a posted event, to the backend on its next poll only; the platform waiting on
+    // the backend fd before that would never see their events
+    uv_run(loop, UV_RUN_NOWAIT);
+    // libuv reports a loop without active handles as due right away, but there is nothing to
+    // wait for, the wakeup handle is on the backend fd and the platform blocks until either fires
+    int timeout = -1;
+    if (uv_loop_alive(loop)) {
+        timeout = uv_backend_timeout(loop);
+        if (!timeout) {
+            return false;
+        }
+    }
+    // an unchanged timeout keeps the earlier, at most too early, platform timer
+    if (timeout != armedTimeout) {
+        if (armedTimeout >= 0) {
+            platform->unregisterTimer(timerId);
+        }
+        if (timeout > 0) {
+            platform->registerTimer(timerId, timeout, Qt::PreciseTimer, &timeoutReceiver);
+        }
+        armedTimeout = timeout;
+    }
+    return true;
+}
+
+
+}
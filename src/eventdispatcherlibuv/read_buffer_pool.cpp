@@ -0,0 +1,64 @@
+#include "../eventdispatcherlibuv_p.h"
+
+namespace qtjs {
+
+EventDispatcherLibUvReadBufferPool::~EventDispatcherLibUvReadBufferPool()
+{
+    while (freeList) {
+        Buffer *buffer = freeList;
+        freeList = buffer->nextFree;
+        delete buffer;
+    }
+}
+
+EventDispatcherLibUvReadBufferPool::Buffer *EventDispatcherLibUvReadBufferPool::acquire()
+{
+    Buffer *buffer = freeList;
+    if (buffer) {
+        freeList = buffer->nextFree;
+        --freeCount;
+    } else {
+        buffer = new Buffer;
+        buffer->pool = this;
+    }
+    buffer->nextFree = nullptr;
+    buffer->refs = 1;
+    buffer->used = 0;
+    if (++used > highWater) {
+        highWater = used;
+    }
+    return buffer;
+}
+
+void EventDispatcherLibUvReadBufferPool::unref(Buffer *buffer)
+{
+    if (!--buffer->refs) {
+        buffer->pool->release(buffer);
+    }
+}
+
+void EventDispatcherLibUvReadBufferPool::release(Buffer *buffer)
+{
+    --used;
+    if (orphaned || freeCount >= maxFree) {
+        delete buffer;
+    } else {
+        buffer->nextFree = freeList;
+        freeList = buffer;
+        ++freeCount;
+    }
+    if (orphaned && !used) {
+        delete this;
+    }
+}
+
+void EventDispatcherLibUvReadBufferPool::orphan()
+{
+    if (!used) {
+        delete this;
+        return;
+    }
+    orphaned = true;
+}
+
+}
@@ -2,12 +2,42 @@
 
 #include <QDebug>
 
+#ifndef Q_OS_WIN
+#include <sys/resource.h>
+#endif
+
 namespace {
 
+// descriptors at or above this fall back to the overflow map of the watcher table
+const size_t maxIndexedDescriptors = 1 << 20;
+
+size_t indexedDescriptorLimit() {
+#ifdef Q_OS_WIN
+    // SOCKETs are handles rather than small dense integers
+    return 0;
+#else
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) || RLIM_INFINITY == limit.rlim_cur || limit.rlim_cur > maxIndexedDescriptors) {
+        return maxIndexedDescriptors;
+    }
+    return limit.rlim_cur;
+#endif
+}
+
+// out-of-band data and sysfs interrupts come as priority events, which libuv only polls for on unix
+#if !defined(Q_OS_WIN) && UV_VERSION_HEX >= 0x010900
+const int uvExceptionEvents = UV_PRIORITIZED;
+#else
+const int uvExceptionEvents = 0;
+#endif
+
+const int uvNotifierEvents = UV_READABLE | UV_WRITABLE | uvExceptionEvents;
+
 inline int translateQSocketNotifierTypeToUv(QSocketNotifier::Type type) {
     switch (type) {
         case QSocketNotifier::Read: return UV_READABLE;
         case QSocketNotifier::Write: return UV_WRITABLE;
+        case QSocketNotifier::Exception: return uvExceptionEvents ? uvExceptionEvents : -1;
         default: return -1;
     }
 }
@@ -17,22 +47,27 @@ inline int translateQSocketNotifierTypeToUv(QSocketNotifier::Type type) {
 namespace qtjs {
 
 
-EventDispatcherLibUvSocketNotifier::EventDispatcherLibUvSocketNotifier(LibuvApi *api) : api(api)
+template <typename Api>
+EventDispatcherLibUvBasicSocketNotifier<Api>::EventDispatcherLibUvBasicSocketNotifier(uv_loop_t *loop, Api *api, EventDispatcherLibUvPool<PollWatcher> *pool)
+    : loop(loop), api(api), pool(pool), socketWatchers(indexedDescriptorLimit()), startCount(0), stopCount(0)
 {
-    if (!this->api) {
-        this->api.reset(new LibuvApi());
+    if (!this->pool) {
+        ownedPool.reset(new EventDispatcherLibUvPool<PollWatcher>());
+        this->pool = ownedPool.get();
     }
 }
 
-EventDispatcherLibUvSocketNotifier::~EventDispatcherLibUvSocketNotifier()
+template <typename Api>
+EventDispatcherLibUvBasicSocketNotifier<Api>::~EventDispatcherLibUvBasicSocketNotifier()
 {
-    for (auto it : socketWatchers) {
-        unregisterPollWatcher(it.second, UV_READABLE | UV_WRITABLE);
-    }
+    socketWatchers.forEach([this](int, uv_poll_t *fdWatcher) {
+        closePollWatcher(fdWatcher);
+    });
     socketWatchers.clear();
 }
 
-void EventDispatcherLibUvSocketNotifier::registerSocketNotifier(int fd, QSocketNotifier::Type type, std::function<void()> callback)
+template <typename Api>
+void EventDispatcherLibUvBasicSocketNotifier<Api>::registerSocketNotifier(int fd, QSocketNotifier::Type type, EventDispatcherLibUvCallback callback)
 {
     int uvType = translateQSocketNotifierTypeToUv(type);
     if (uvType < 0) {
@@ -49,49 +84,103 @@ void EventDispatcherLibUvSocketNotifier::registerSocketNotifier(int fd, QSocketN
     if (uvType == UV_WRITABLE) {
         callbacks->writeAvailable = callback;
     }
-    api->uv_poll_start(fdWatcher, uvType, &qtjs::uv_socket_watcher);
+    if (uvType == uvExceptionEvents) {
+        callbacks->exceptionAvailable = callback;
+    }
+    markPending(fdWatcher);
 }
 
-uv_poll_t *EventDispatcherLibUvSocketNotifier::findOrCreateWatcher(int fd)
+template <typename Api>
+uv_poll_t *EventDispatcherLibUvBasicSocketNotifier<Api>::findOrCreateWatcher(int fd)
 {
-    auto it = socketWatchers.find(fd);
-    if (socketWatchers.end() == it) {
-        socketWatchers.insert(std::make_pair(fd, new uv_poll_t()));
-        it = socketWatchers.find(fd);
-        Q_ASSERT(socketWatchers.end() != it);
-        it->second->data = new SocketCallbacks();
-        api->uv_poll_init(uv_default_loop(), it->second, fd);
+    uv_poll_t *fdWatcher = socketWatchers.find(fd);
+    if (!fdWatcher) {
+        PollWatcher *watcher = pool->acquire();
+        watcher->pool = pool;
+        watcher->fd = fd;
+        watcher->handle.data = &watcher->callbacks;
+        fdWatcher = &watcher->handle;
+        socketWatchers.insert(fd, fdWatcher);
+        api->uv_poll_init(loop, fdWatcher, fd);
     }
-    return it->second;
+    return fdWatcher;
 }
 
-void EventDispatcherLibUvSocketNotifier::unregisterSocketNotifier(int fd, QSocketNotifier::Type type)
+template <typename Api>
+void EventDispatcherLibUvBasicSocketNotifier<Api>::unregisterSocketNotifier(int fd, QSocketNotifier::Type type)
 {
     int uvType = translateQSocketNotifierTypeToUv(type);
     if (uvType < 0) {
         qWarning() << "unsupported notifier type" << type;
         return;
     }
-    auto it = socketWatchers.find(fd);
-    if (socketWatchers.end() != it) {
-        uv_poll_t *fdWatcher = it->second;
-        if (unregisterPollWatcher(fdWatcher, uvType)) {
-            socketWatchers.erase(it);
+    uv_poll_t *fdWatcher = socketWatchers.find(fd);
+    if (!fdWatcher) {
+        return;
+    }
+    SocketCallbacks *callbacks = (SocketCallbacks *)fdWatcher->data;
+    if (callbacks->eventMask & uvType) {
+        callbacks->eventMask &= ~uvType;
+        // a watcher left without events is stopped right away rather than on commit: Qt closes
+        // the descriptor next, and a socket getting the same number within the iteration would
+        // come back with the mask still polled for and never be started on the backend again
+        if (!callbacks->eventMask && callbacks->pollingMask) {
+            api->uv_poll_stop(fdWatcher);
+            callbacks->pollingMask = 0;
+            ++stopCount;
         }
+        markPending(fdWatcher);
     }
 }
 
-bool EventDispatcherLibUvSocketNotifier::unregisterPollWatcher(uv_poll_t *fdWatcher, unsigned int eventMask)
+template <typename Api>
+void EventDispatcherLibUvBasicSocketNotifier<Api>::markPending(uv_poll_t *fdWatcher)
 {
-    api->uv_poll_stop(fdWatcher);
     SocketCallbacks *callbacks = (SocketCallbacks *)fdWatcher->data;
-    callbacks->eventMask &= ~eventMask;
-    if (!callbacks->eventMask) {
-        api->uv_close((uv_handle_t *) fdWatcher, uv_close_pollHandle);
-        return true;
+    if (!callbacks->pending) {
+        callbacks->pending = true;
+        pendingWatchers.push_back(fdWatcher);
     }
-    api->uv_poll_start(fdWatcher, callbacks->eventMask, &qtjs::uv_socket_watcher);
-    return false;
+}
+
+// Qt toggles write notifiers around nearly every write; every libuv start or stop costs an
+// epoll_ctl of its own, and often a toggle is undone within the same iteration anyway
+template <typename Api>
+bool EventDispatcherLibUvBasicSocketNotifier<Api>::commitPendingChanges()
+{
+    bool started = false;
+    for (uv_poll_t *fdWatcher : pendingWatchers) {
+        SocketCallbacks *callbacks = (SocketCallbacks *)fdWatcher->data;
+        callbacks->pending = false;
+#ifdef Q_OS_WIN
+        // libuv binds a poll handle to the socket behind it, and socket handle values are
+        // recycled freely, so watchers are not kept for the next socket of the same value
+        if (!callbacks->eventMask) {
+            closePollWatcher(fdWatcher);
+            socketWatchers.take(((PollWatcher *)fdWatcher)->fd);
+            continue;
+        }
+#endif
+        if (callbacks->eventMask == callbacks->pollingMask) {
+            continue;
+        }
+        // watchers left without events were stopped when unregistered, and stay around dormant
+        // until the descriptor is watched again; starting a poll handle again replaces its
+        // events, so it takes the combined mask
+        api->uv_poll_start(fdWatcher, callbacks->eventMask, &qtjs::uv_socket_watcher);
+        ++startCount;
+        started = true;
+        callbacks->pollingMask = callbacks->eventMask;
+    }
+    pendingWatchers.clear();
+    return started;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicSocketNotifier<Api>::closePollWatcher(uv_poll_t *fdWatcher)
+{
+    // closing stops the handle, a stop before it would take the descriptor out of the backend twice
+    api->uv_close((uv_handle_t *) fdWatcher, uv_close_pollHandle);
 }
 
 
@@ -100,22 +189,29 @@ void uv_socket_watcher(uv_poll_t* req, int /* status */, int events)
 {
     SocketCallbacks *callbacks = (SocketCallbacks *) req->data;
     if (callbacks) {
-        if (events & UV_READABLE) {
+        // libuv may still poll for events unregistered since the last commit, and a callback may
+        // unregister the notifiers after it, so the mask is looked at before each of them
+        if (events & callbacks->eventMask & UV_READABLE) {
             callbacks->readAvailable();
         }
-        if (events & UV_WRITABLE) {
+        if (events & callbacks->eventMask & UV_WRITABLE) {
             callbacks->writeAvailable();
         }
+        if (events & callbacks->eventMask & uvExceptionEvents) {
+            callbacks->exceptionAvailable();
+        }
     }
 }
 
 
 void uv_close_pollHandle(uv_handle_t* handle)
 {
-    uv_poll_t *fdWatcher = (uv_poll_t *)handle;
-    delete (SocketCallbacks *)fdWatcher->data;
-    delete fdWatcher;
+    PollWatcher *watcher = (PollWatcher *)handle;
+    watcher->pool->release(watcher);
 }
 
 
+template class EventDispatcherLibUvBasicSocketNotifier<LibuvDirectApi>;
+template class EventDispatcherLibUvBasicSocketNotifier<LibuvApi>;
+
 }
@@ -0,0 +1,146 @@
+#include "../eventdispatcherlibuv_p.h"
+
+namespace qtjs {
+
+EventDispatcherLibUvStream::EventDispatcherLibUvStream()
+{
+    attached.prev = attached.next = &attached;
+    attached.stream = this;
+    flushed.prev = flushed.next = &flushed;
+    flushed.stream = this;
+}
+
+
+template <typename Api>
+EventDispatcherLibUvBasicStreamRegistry<Api>::EventDispatcherLibUvBasicStreamRegistry(uv_loop_t *loop, Api *api)
+    : api(api), check(nullptr), idle(nullptr), started(false)
+{
+    attached.prev = attached.next = &attached;
+    attached.stream = nullptr;
+    flushing.prev = flushing.next = &flushing;
+    flushing.stream = nullptr;
+    check = new uv_check_t();
+    check->data = this;
+    this->api->uv_check_init(loop, check);
+    idle = new uv_idle_t();
+    this->api->uv_idle_init(loop, idle);
+}
+
+template <typename Api>
+EventDispatcherLibUvBasicStreamRegistry<Api>::~EventDispatcherLibUvBasicStreamRegistry()
+{
+    detachAll();
+    check->data = nullptr;
+    api->uv_close((uv_handle_t *)check, &uv_close_checkHandle);
+    api->uv_close((uv_handle_t *)idle, &uv_close_idleHandle);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicStreamRegistry<Api>::attach(EventDispatcherLibUvStream *stream)
+{
+    append(attached, &stream->attached);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicStreamRegistry<Api>::detach(EventDispatcherLibUvStream *stream)
+{
+    unlink(&stream->attached);
+    unlink(&stream->flushed);
+    updateHandles();
+}
+
+// a stream is unlinked before it is told, closing one may well delete another
+template <typename Api>
+void EventDispatcherLibUvBasicStreamRegistry<Api>::detachAll()
+{
+    while (attached.next != &attached) {
+        EventDispatcherLibUvStream *stream = attached.next->stream;
+        detach(stream);
+        stream->detachFromDispatcher();
+    }
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicStreamRegistry<Api>::scheduleFlush(EventDispatcherLibUvStream *stream)
+{
+    if (stream->flushed.next != &stream->flushed) {
+        return;
+    }
+    append(flushing, &stream->flushed);
+    updateHandles();
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicStreamRegistry<Api>::flushStreams()
+{
+    if (flushing.next == &flushing) {
+        return;
+    }
+    Link pending;
+    pending.next = flushing.next;
+    pending.prev = flushing.prev;
+    pending.next->prev = pending.prev->next = &pending;
+    flushing.prev = flushing.next = &flushing;
+
+    // the stream is unlinked first, its flush may schedule it again or detach any other stream
+    while (pending.next != &pending) {
+        EventDispatcherLibUvStream *stream = pending.next->stream;
+        unlink(&stream->flushed);
+        stream->flush();
+    }
+    updateHandles();
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicStreamRegistry<Api>::append(Link &list, Link *link)
+{
+    link->prev = list.prev;
+    link->next = &list;
+    list.prev->next = link;
+    list.prev = link;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicStreamRegistry<Api>::unlink(Link *link)
+{
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->prev = link->next = link;
+}
+
+// both handles only stay active while a flush is scheduled, an idle loop blocks in the poll
+template <typename Api>
+void EventDispatcherLibUvBasicStreamRegistry<Api>::updateHandles()
+{
+    bool wanted = flushing.next != &flushing;
+    if (wanted == started) {
+        return;
+    }
+    if (wanted) {
+        api->uv_check_start(check, &uv_stream_flusher<Api>);
+        api->uv_idle_start(idle, &uv_stream_flush_idler);
+    } else {
+        api->uv_check_stop(check);
+        api->uv_idle_stop(idle);
+    }
+    started = wanted;
+}
+
+
+template <typename Api>
+void uv_stream_flusher(uv_check_t* handle)
+{
+    EventDispatcherLibUvBasicStreamRegistry<Api> *streams = (EventDispatcherLibUvBasicStreamRegistry<Api> *) handle->data;
+    if (streams) {
+        streams->flushStreams();
+    }
+}
+
+void uv_stream_flush_idler(uv_idle_t*)
+{
+}
+
+template class EventDispatcherLibUvBasicStreamRegistry<LibuvDirectApi>;
+template class EventDispatcherLibUvBasicStreamRegistry<LibuvApi>;
+
+}
@@ -0,0 +1,689 @@
+#include "../eventdispatcherlibuvtcpsocket.h"
+#include "../eventdispatcherlibuv_p.h"
+
+#include <QPointer>
+
+#include <cstring>
+
+namespace {
+
+// the rest of a read buffer is offered to the next read down to this size
+const size_t minimumRead = 4096;
+// small writes are appended to the last pending block up to this size, larger ones get their own
+const int coalescedWriteSize = 64 * 1024;
+
+}
+
+namespace qtjs {
+
+typedef EventDispatcherLibUvReadBufferPool::Buffer ReadBuffer;
+
+// the libuv side of EventDispatcherLibUvTcpSocket
+class EventDispatcherLibUvTcpStream : public EventDispatcherLibUvStream {
+public:
+    // the data stays referenced by the request until libuv is done with it
+    struct Write {
+        uv_write_t request;
+        EventDispatcherLibUvTcpStream *stream;
+        std::vector<QByteArray> blocks;
+        qint64 size;
+    };
+
+    EventDispatcherLibUvTcpStream(EventDispatcherLibUvTcpSocket *socket, EventDispatcherLibUv *dispatcher);
+    ~EventDispatcherLibUvTcpStream();
+
+    void connectToHost(const char *host, quint16 port);
+    bool adopt(qintptr fd);
+    void disconnectFromHost();
+    void abort();
+    void clearReceived();
+    void setReadBufferSize(qint64 size);
+
+    qint64 read(char *data, qint64 maxSize);
+    EventDispatcherLibUvTcpSocket::Chunk takeChunk();
+    bool hasLine() const;
+    qint64 write(const char *data, qint64 size);
+
+    void allocate(uv_buf_t *buf);
+    void received(ssize_t size);
+    void connected(int status);
+    void written(Write *write, int status);
+    void shut(int status);
+    void flush() override;
+    void detachFromDispatcher() override;
+
+    EventDispatcherLibUvTcpSocket *socket;
+    EventDispatcherLibUv *dispatcher;
+    EventDispatcherLibUvReadBufferPool *pool;
+    uv_tcp_t *handle;
+    uv_connect_t *connecting;
+    uv_shutdown_t *shuttingDown;
+    Write *writing;
+    ReadBuffer *readBuffer;
+    std::deque<EventDispatcherLibUvTcpSocket::Chunk> chunks;
+    qint64 receivedBytes;
+    qint64 readBufferSize;
+    bool reading;
+    std::vector<QByteArray> pending;
+    qint64 pendingBytes;
+    EventDispatcherLibUvTcpSocket::State state;
+    int lastError;
+
+private:
+    bool openHandle();
+    void updateReading();
+    void scheduleFlush();
+    void shutdown();
+    void closeHandle();
+    void fail(int error);
+};
+
+void uv_tcp_connected(uv_connect_t* request, int status);
+void uv_tcp_allocate(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buf);
+void uv_tcp_received(uv_stream_t* handle, ssize_t size, const uv_buf_t* buf);
+void uv_tcp_written(uv_write_t* request, int status);
+void uv_tcp_shut(uv_shutdown_t* request, int status);
+void uv_close_tcpHandle(uv_handle_t* handle);
+
+
+EventDispatcherLibUvTcpStream::EventDispatcherLibUvTcpStream(EventDispatcherLibUvTcpSocket *socket, EventDispatcherLibUv *dispatcher)
+    : socket(socket), dispatcher(dispatcher), pool(dispatcher->readBufferPool()), handle(nullptr), connecting(nullptr),
+      shuttingDown(nullptr), writing(nullptr), readBuffer(nullptr), receivedBytes(0), readBufferSize(0), reading(false), pendingBytes(0),
+      state(EventDispatcherLibUvTcpSocket::UnconnectedState), lastError(0)
+{
+    dispatcher->streamRegistry()->attach(this);
+}
+
+// requests still out are cancelled by closing the handle, their callbacks only free them
+EventDispatcherLibUvTcpStream::~EventDispatcherLibUvTcpStream()
+{
+    if (dispatcher) {
+        dispatcher->streamRegistry()->detach(this);
+    }
+    closeHandle();
+    clearReceived();
+    if (readBuffer) {
+        EventDispatcherLibUvReadBufferPool::unref(readBuffer);
+    }
+}
+
+bool EventDispatcherLibUvTcpStream::openHandle()
+{
+    handle = new uv_tcp_t();
+    handle->data = this;
+    int error = uv_tcp_init(dispatcher->uvLoop(), handle);
+    if (error) {
+        delete handle;
+        handle = nullptr;
+        fail(error);
+        return false;
+    }
+    return true;
+}
+
+void EventDispatcherLibUvTcpStream::connectToHost(const char *host, quint16 port)
+{
+    sockaddr_storage address;
+    int error = uv_ip4_addr(host, port, (sockaddr_in *)&address);
+    if (error) {
+        error = uv_ip6_addr(host, port, (sockaddr_in6 *)&address);
+    }
+    if (error) {
+        fail(error);
+        return;
+    }
+    if (!openHandle()) {
+        return;
+    }
+    connecting = new uv_connect_t();
+    connecting->data = this;
+    error = uv_tcp_connect(connecting, handle, (const sockaddr *)&address, &uv_tcp_connected);
+    if (error) {
+        delete connecting;
+        connecting = nullptr;
+        fail(error);
+        return;
+    }
+    state = EventDispatcherLibUvTcpSocket::ConnectingState;
+}
+
+bool EventDispatcherLibUvTcpStream::adopt(qintptr fd)
+{
+    if (!openHandle()) {
+        return false;
+    }
+    int error = uv_tcp_open(handle, (uv_os_sock_t)fd);
+    if (error) {
+        fail(error);
+        return false;
+    }
+    state = EventDispatcherLibUvTcpSocket::ConnectedState;
+    updateReading();
+    return true;
+}
+
+void EventDispatcherLibUvTcpStream::disconnectFromHost()
+{
+    if (EventDispatcherLibUvTcpSocket::ConnectedState != state) {
+        if (EventDispatcherLibUvTcpSocket::ConnectingState == state) {
+            abort();
+        }
+        return;
+    }
+    state = EventDispatcherLibUvTcpSocket::ClosingState;
+    if (!writing && pending.empty()) {
+        shutdown();
+    }
+}
+
+void EventDispatcherLibUvTcpStream::abort()
+{
+    bool wasOpen = handle && EventDispatcherLibUvTcpSocket::ConnectingState != state;
+    pending.clear();
+    pendingBytes = 0;
+    closeHandle();
+    if (wasOpen) {
+        emit socket->disconnected();
+    }
+}
+
+void EventDispatcherLibUvTcpStream::clearReceived()
+{
+    chunks.clear();
+    receivedBytes = 0;
+    updateReading();
+}
+
+void EventDispatcherLibUvTcpStream::setReadBufferSize(qint64 size)
+{
+    readBufferSize = std::max<qint64>(size, 0);
+    updateReading();
+}
+
+qint64 EventDispatcherLibUvTcpStream::read(char *data, qint64 maxSize)
+{
+    qint64 copied = 0;
+    while (copied < maxSize && !chunks.empty()) {
+        EventDispatcherLibUvTcpSocket::Chunk &chunk = chunks.front();
+        qint64 size = std::min(maxSize - copied, chunk.length);
+        memcpy(data + copied, chunk.begin, size);
+        copied += size;
+        chunk.begin += size;
+        chunk.length -= size;
+        if (!chunk.length) {
+            chunks.pop_front();
+        }
+    }
+    receivedBytes -= copied;
+    updateReading();
+    if (!copied && EventDispatcherLibUvTcpSocket::UnconnectedState == state) {
+        return -1;
+    }
+    return copied;
+}
+
+EventDispatcherLibUvTcpSocket::Chunk EventDispatcherLibUvTcpStream::takeChunk()
+{
+    if (chunks.empty()) {
+        return EventDispatcherLibUvTcpSocket::Chunk();
+    }
+    EventDispatcherLibUvTcpSocket::Chunk chunk = chunks.front();
+    chunks.pop_front();
+    receivedBytes -= chunk.length;
+    updateReading();
+    return chunk;
+}
+
+bool EventDispatcherLibUvTcpStream::hasLine() const
+{
+    for (const EventDispatcherLibUvTcpSocket::Chunk &chunk : chunks) {
+        if (memchr(chunk.begin, '\n', chunk.length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+qint64 EventDispatcherLibUvTcpStream::write(const char *data, qint64 size)
+{
+    if (EventDispatcherLibUvTcpSocket::ConnectedState != state && EventDispatcherLibUvTcpSocket::ConnectingState != state) {
+        return -1;
+    }
+    if (!pending.empty() && pending.back().size() + size <= coalescedWriteSize) {
+        pending.back().append(data, size);
+    } else {
+        pending.push_back(QByteArray(data, size));
+    }
+    pendingBytes += size;
+    scheduleFlush();
+    return size;
+}
+
+// everything written while handling the current events goes out in one go, after the next poll
+void EventDispatcherLibUvTcpStream::scheduleFlush()
+{
+    if (writing || EventDispatcherLibUvTcpSocket::ConnectedState != state) {
+        return;
+    }
+    dispatcher->streamRegistry()->scheduleFlush(this);
+}
+
+// as much as the socket takes right away goes with uv_try_write, the rest with one uv_write
+void EventDispatcherLibUvTcpStream::flush()
+{
+    if (writing || pending.empty() || !handle) {
+        return;
+    }
+    std::vector<uv_buf_t> buffers;
+    buffers.reserve(pending.size());
+    for (QByteArray &block : pending) {
+        buffers.push_back(uv_buf_init(block.data(), block.size()));
+    }
+    int sent = uv_try_write((uv_stream_t *)handle, buffers.data(), buffers.size());
+    if (sent < 0 && UV_EAGAIN != sent && UV_ENOSYS != sent) {
+        fail(sent);
+        return;
+    }
+    qint64 written = std::max(sent, 0);
+    qint64 left = pendingBytes - written;
+    if (left) {
+        size_t first = 0;
+        qint64 skipped = written;
+        while (skipped >= (qint64)buffers[first].len) {
+            skipped -= buffers[first++].len;
+        }
+        buffers[first].base += skipped;
+        buffers[first].len -= skipped;
+        writing = new Write();
+        writing->request.data = nullptr;
+        writing->stream = this;
+        writing->blocks.swap(pending);
+        writing->size = left;
+        int error = uv_write(&writing->request, (uv_stream_t *)handle, buffers.data() + first, buffers.size() - first, &uv_tcp_written);
+        if (error) {
+            delete writing;
+            writing = nullptr;
+            fail(error);
+            return;
+        }
+    } else {
+        pending.clear();
+    }
+    pendingBytes = left;
+    QPointer<EventDispatcherLibUvTcpSocket> guard(socket);
+    if (written) {
+        emit socket->bytesWritten(written);
+    }
+    if (guard && !writing && pending.empty() && EventDispatcherLibUvTcpSocket::ClosingState == state) {
+        shutdown();
+    }
+}
+
+// the socket stops reading while the data not taken yet reaches the read buffer size, and the
+// kernel buffers and TCP flow control hold up the peer rather than memory growing without bound
+void EventDispatcherLibUvTcpStream::updateReading()
+{
+    if (!handle || EventDispatcherLibUvTcpSocket::ConnectingState == state) {
+        return;
+    }
+    bool wanted = !readBufferSize || receivedBytes < readBufferSize;
+    if (wanted == reading) {
+        return;
+    }
+    reading = wanted;
+    if (reading) {
+        uv_read_start((uv_stream_t *)handle, &uv_tcp_allocate, &uv_tcp_received);
+    } else {
+        uv_read_stop((uv_stream_t *)handle);
+    }
+}
+
+void EventDispatcherLibUvTcpStream::shutdown()
+{
+    shuttingDown = new uv_shutdown_t();
+    shuttingDown->data = this;
+    int error = uv_shutdown(shuttingDown, (uv_stream_t *)handle, &uv_tcp_shut);
+    if (error) {
+        delete shuttingDown;
+        shuttingDown = nullptr;
+        abort();
+    }
+}
+
+void EventDispatcherLibUvTcpStream::closeHandle()
+{
+    if (!handle) {
+        return;
+    }
+    if (connecting) {
+        connecting->data = nullptr;
+        connecting = nullptr;
+    }
+    if (shuttingDown) {
+        shuttingDown->data = nullptr;
+        shuttingDown = nullptr;
+    }
+    if (writing) {
+        writing->stream = nullptr;
+        writing = nullptr;
+    }
+    handle->data = nullptr;
+    uv_close((uv_handle_t *)handle, &uv_close_tcpHandle);
+    handle = nullptr;
+    reading = false;
+    state = EventDispatcherLibUvTcpSocket::UnconnectedState;
+}
+
+// the stream stays unconnected for good, the socket is no longer valid
+void EventDispatcherLibUvTcpStream::detachFromDispatcher()
+{
+    pending.clear();
+    pendingBytes = 0;
+    closeHandle();
+    dispatcher = nullptr;
+}
+
+void EventDispatcherLibUvTcpStream::fail(int error)
+{
+    bool wasConnected = EventDispatcherLibUvTcpSocket::ConnectedState == state || EventDispatcherLibUvTcpSocket::ClosingState == state;
+    lastError = error;
+    socket->setErrorString(QString::fromLatin1(uv_strerror(error)));
+    pending.clear();
+    pendingBytes = 0;
+    closeHandle();
+    QPointer<EventDispatcherLibUvTcpSocket> guard(socket);
+    emit socket->errorOccurred(error);
+    if (guard && wasConnected) {
+        emit socket->disconnected();
+    }
+}
+
+// takes the rest of the current read buffer while there is enough of it
+void EventDispatcherLibUvTcpStream::allocate(uv_buf_t *buf)
+{
+    if (!readBuffer || EventDispatcherLibUvReadBufferPool::bufferSize - readBuffer->used < minimumRead) {
+        if (readBuffer) {
+            EventDispatcherLibUvReadBufferPool::unref(readBuffer);
+        }
+        readBuffer = pool->acquire();
+    }
+    *buf = uv_buf_init(readBuffer->data + readBuffer->used, EventDispatcherLibUvReadBufferPool::bufferSize - readBuffer->used);
+}
+
+void EventDispatcherLibUvTcpStream::received(ssize_t size)
+{
+    if (size > 0) {
+        EventDispatcherLibUvTcpSocket::Chunk chunk;
+        EventDispatcherLibUvReadBufferPool::ref(readBuffer);
+        chunk.buffer = readBuffer;
+        chunk.begin = readBuffer->data + readBuffer->used;
+        chunk.length = size;
+        readBuffer->used += size;
+        chunks.push_back(chunk);
+        receivedBytes += size;
+        updateReading();
+        emit socket->readyRead();
+        return;
+    }
+    if (UV_EOF == size) {
+        closeHandle();
+        QPointer<EventDispatcherLibUvTcpSocket> guard(socket);
+        emit socket->readChannelFinished();
+        if (guard) {
+            emit socket->disconnected();
+        }
+    } else if (size < 0) {
+        fail(size);
+    }
+}
+
+void EventDispatcherLibUvTcpStream::connected(int status)
+{
+    connecting = nullptr;
+    if (status) {
+        fail(status);
+        return;
+    }
+    state = EventDispatcherLibUvTcpSocket::ConnectedState;
+    updateReading();
+    QPointer<EventDispatcherLibUvTcpSocket> guard(socket);
+    emit socket->connected();
+    if (guard) {
+        scheduleFlush();
+    }
+}
+
+// whatever was written meanwhile goes out right away, as the next batch
+void EventDispatcherLibUvTcpStream::written(Write *write, int status)
+{
+    writing = nullptr;
+    if (status) {
+        fail(status);
+        return;
+    }
+    pendingBytes -= write->size;
+    QPointer<EventDispatcherLibUvTcpSocket> guard(socket);
+    emit socket->bytesWritten(write->size);
+    if (!guard) {
+        return;
+    }
+    if (!pending.empty()) {
+        flush();
+    } else if (EventDispatcherLibUvTcpSocket::ClosingState == state) {
+        shutdown();
+    }
+}
+
+void EventDispatcherLibUvTcpStream::shut(int)
+{
+    shuttingDown = nullptr;
+    closeHandle();
+    emit socket->disconnected();
+}
+
+
+void uv_tcp_connected(uv_connect_t* request, int status)
+{
+    EventDispatcherLibUvTcpStream *stream = (EventDispatcherLibUvTcpStream *) request->data;
+    delete request;
+    if (stream) {
+        stream->connected(status);
+    }
+}
+
+void uv_tcp_allocate(uv_handle_t* handle, size_t, uv_buf_t* buf)
+{
+    ((EventDispatcherLibUvTcpStream *) handle->data)->allocate(buf);
+}
+
+void uv_tcp_received(uv_stream_t* handle, ssize_t size, const uv_buf_t*)
+{
+    EventDispatcherLibUvTcpStream *stream = (EventDispatcherLibUvTcpStream *) handle->data;
+    if (stream) {
+        stream->received(size);
+    }
+}
+
+void uv_tcp_written(uv_write_t* request, int status)
+{
+    EventDispatcherLibUvTcpStream::Write *write = (EventDispatcherLibUvTcpStream::Write *) request;
+    if (write->stream) {
+        write->stream->written(write, status);
+    }
+    delete write;
+}
+
+void uv_tcp_shut(uv_shutdown_t* request, int status)
+{
+    EventDispatcherLibUvTcpStream *stream = (EventDispatcherLibUvTcpStream *) request->data;
+    delete request;
+    if (stream) {
+        stream->shut(status);
+    }
+}
+
+void uv_close_tcpHandle(uv_handle_t* handle)
+{
+    delete (uv_tcp_t *) handle;
+}
+
+
+EventDispatcherLibUvTcpSocket::Chunk::Chunk() : buffer(nullptr), begin(nullptr), length(0)
+{
+}
+
+EventDispatcherLibUvTcpSocket::Chunk::Chunk(const Chunk &other) : buffer(other.buffer), begin(other.begin), length(other.length)
+{
+    if (buffer) {
+        EventDispatcherLibUvReadBufferPool::ref((ReadBuffer *) buffer);
+    }
+}
+
+EventDispatcherLibUvTcpSocket::Chunk &EventDispatcherLibUvTcpSocket::Chunk::operator=(const Chunk &other)
+{
+    if (other.buffer) {
+        EventDispatcherLibUvReadBufferPool::ref((ReadBuffer *) other.buffer);
+    }
+    if (buffer) {
+        EventDispatcherLibUvReadBufferPool::unref((ReadBuffer *) buffer);
+    }
+    buffer = other.buffer;
+    begin = other.begin;
+    length = other.length;
+    return *this;
+}
+
+EventDispatcherLibUvTcpSocket::Chunk::~Chunk()
+{
+    if (buffer) {
+        EventDispatcherLibUvReadBufferPool::unref((ReadBuffer *) buffer);
+    }
+}
+
+
+EventDispatcherLibUvTcpSocket::EventDispatcherLibUvTcpSocket(QObject *parent) : QIODevice(parent)
+{
+    EventDispatcherLibUv *dispatcher = qobject_cast<EventDispatcherLibUv *>(QAbstractEventDispatcher::instance());
+    if (dispatcher) {
+        stream.reset(new EventDispatcherLibUvTcpStream(this, dispatcher));
+    } else {
+        setErrorString(QStringLiteral("the thread does not run an EventDispatcherLibUv"));
+    }
+}
+
+EventDispatcherLibUvTcpSocket::~EventDispatcherLibUvTcpSocket()
+{
+}
+
+bool EventDispatcherLibUvTcpSocket::isValid() const
+{
+    return stream && stream->dispatcher;
+}
+
+EventDispatcherLibUvTcpSocket::State EventDispatcherLibUvTcpSocket::state() const
+{
+    return stream ? stream->state : UnconnectedState;
+}
+
+int EventDispatcherLibUvTcpSocket::error() const
+{
+    return stream ? stream->lastError : 0;
+}
+
+void EventDispatcherLibUvTcpSocket::connectToHost(const char *host, quint16 port, OpenMode mode)
+{
+    if (!isValid() || UnconnectedState != stream->state) {
+        return;
+    }
+    stream->clearReceived();
+    stream->connectToHost(host, port);
+    // a connect failing right away leaves the device closed, as a refused one does
+    if (ConnectingState == stream->state) {
+        QIODevice::open(mode | Unbuffered);
+    }
+}
+
+bool EventDispatcherLibUvTcpSocket::setSocketDescriptor(qintptr fd, OpenMode mode)
+{
+    if (!isValid() || UnconnectedState != stream->state) {
+        return false;
+    }
+    stream->clearReceived();
+    if (!stream->adopt(fd)) {
+        return false;
+    }
+    QIODevice::open(mode | Unbuffered);
+    return true;
+}
+
+void EventDispatcherLibUvTcpSocket::disconnectFromHost()
+{
+    if (stream) {
+        stream->disconnectFromHost();
+    }
+}
+
+void EventDispatcherLibUvTcpSocket::abort()
+{
+    if (stream) {
+        stream->abort();
+    }
+}
+
+EventDispatcherLibUvTcpSocket::Chunk EventDispatcherLibUvTcpSocket::readChunk()
+{
+    return stream ? stream->takeChunk() : Chunk();
+}
+
+qint64 EventDispatcherLibUvTcpSocket::readBufferSize() const
+{
+    return stream ? stream->readBufferSize : 0;
+}
+
+void EventDispatcherLibUvTcpSocket::setReadBufferSize(qint64 size)
+{
+    if (stream) {
+        stream->setReadBufferSize(size);
+    }
+}
+
+bool EventDispatcherLibUvTcpSocket::isSequential() const
+{
+    return true;
+}
+
+qint64 EventDispatcherLibUvTcpSocket::bytesAvailable() const
+{
+    return (stream ? stream->receivedBytes : 0) + QIODevice::bytesAvailable();
+}
+
+qint64 EventDispatcherLibUvTcpSocket::bytesToWrite() const
+{
+    return stream ? stream->pendingBytes : 0;
+}
+
+bool EventDispatcherLibUvTcpSocket::canReadLine() const
+{
+    return (stream && stream->hasLine()) || QIODevice::canReadLine();
+}
+
+void EventDispatcherLibUvTcpSocket::close()
+{
+    disconnectFromHost();
+    QIODevice::close();
+    if (stream) {
+        stream->clearReceived();
+    }
+}
+
+qint64 EventDispatcherLibUvTcpSocket::readData(char *data, qint64 maxSize)
+{
+    return stream ? stream->read(data, maxSize) : -1;
+}
+
+qint64 EventDispatcherLibUvTcpSocket::writeData(const char *data, qint64 size)
+{
+    return stream ? stream->write(data, size) : -1;
+}
+
+}
@@ -4,61 +4,93 @@
 namespace qtjs {
 
 
-EventDispatcherLibUvTimerTracker::EventDispatcherLibUvTimerTracker(LibuvApi *api) : api(api)
+EventDispatcherLibUvTimerTracker::EventDispatcherLibUvTimerTracker() : records(indexedTimerIds)
 {
-    if (!this->api) {
-        this->api.reset(new LibuvApi());
-    }
 }
 
 void EventDispatcherLibUvTimerTracker::registerTimer(int timerId, int interval, Qt::TimerType timerType, QObject *object)
 {
-    timers[object].append(QAbstractEventDispatcher::TimerInfo(timerId, interval, timerType));
-    timerInfos[timerId] = {api->uv_hrtime() / 1000000, interval, object};
+    TimerRecord *record = records.find(timerId);
+    if (record) {
+        unlinkFromObject(record);
+    } else {
+        record = recordPool.acquire();
+        record->timerId = timerId;
+        records.insert(timerId, record);
+    }
+    record->interval = interval;
+    record->timerType = timerType;
+    record->object = object;
+    record->nextOfObject = nullptr;
+
+    auto it = objectTimers.find(object);
+    if (objectTimers.end() == it) {
+        record->previousOfObject = nullptr;
+        objectTimers.insert(std::make_pair(object, ObjectTimers{record, record}));
+    } else {
+        record->previousOfObject = it->second.last;
+        it->second.last->nextOfObject = record;
+        it->second.last = record;
+    }
 }
 
-void EventDispatcherLibUvTimerTracker::unregisterTimer(int timerId)
+bool EventDispatcherLibUvTimerTracker::unregisterTimer(int timerId, Qt::TimerType *timerType)
 {
-    void *object = timerInfos[timerId].object;
-    timerInfos.erase(timerId);
-    cleanTimerFromObject(timerId, object);
-    if (timers[object].empty()) {
-        timers.erase(object);
+    TimerRecord *record = records.take(timerId);
+    if (!record) {
+        return false;
     }
+    if (timerType) {
+        *timerType = record->timerType;
+    }
+    unlinkFromObject(record);
+    recordPool.release(record);
+    return true;
 }
 
-void EventDispatcherLibUvTimerTracker::cleanTimerFromObject(int timerId, void *object)
+void EventDispatcherLibUvTimerTracker::unlinkFromObject(TimerRecord *record)
 {
-    QMutableListIterator<QAbstractEventDispatcher::TimerInfo> it(timers[object]);
-    while (it.hasNext()) {
-        if (it.next().timerId == timerId) {
-            it.remove();
-            return;
-        }
+    auto it = objectTimers.find(record->object);
+    if (objectTimers.end() == it) {
+        return;
+    }
+    if (record->previousOfObject) {
+        record->previousOfObject->nextOfObject = record->nextOfObject;
+    } else {
+        it->second.first = record->nextOfObject;
+    }
+    if (record->nextOfObject) {
+        record->nextOfObject->previousOfObject = record->previousOfObject;
+    } else {
+        it->second.last = record->previousOfObject;
+    }
+    if (!it->second.first) {
+        objectTimers.erase(it);
     }
 }
 
 
 QList<QAbstractEventDispatcher::TimerInfo> EventDispatcherLibUvTimerTracker::getTimerInfo(QObject *object)
 {
-    auto it = timers.find(object);
-    if (timers.end() == it) {
-        return QList<QAbstractEventDispatcher::TimerInfo>();
+    QList<QAbstractEventDispatcher::TimerInfo> timerInfos;
+    auto it = objectTimers.find(object);
+    if (objectTimers.end() == it) {
+        return timerInfos;
     }
-    return it->second;
-}
-
-void EventDispatcherLibUvTimerTracker::fireTimer(int timerId)
-{
-    timerInfos[timerId].lastFired = api->uv_hrtime() / 1000000;
+    for (TimerRecord *record = it->second.first; record; record = record->nextOfObject) {
+        timerInfos.append(QAbstractEventDispatcher::TimerInfo(record->timerId, record->interval, record->timerType));
+    }
+    return timerInfos;
 }
 
-int EventDispatcherLibUvTimerTracker::remainingTime(int timerId)
+bool EventDispatcherLibUvTimerTracker::find(int timerId, Qt::TimerType *timerType)
 {
-    const TimerInfo &timerInfo = timerInfos[timerId];
-    return timerInfo.interval
-            + timerInfo.lastFired
-            - api->uv_hrtime() / 1000000;
+    const TimerRecord *record = records.find(timerId);
+    if (!record) {
+        return false;
+    }
+    *timerType = record->timerType;
+    return true;
 }
 
 
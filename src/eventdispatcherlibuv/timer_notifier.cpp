@@ -2,48 +2,81 @@
 
 namespace qtjs {
 
-EventDispatcherLibUvTimerNotifier::EventDispatcherLibUvTimerNotifier(LibuvApi *api) : api(api)
+template <typename Api>
+EventDispatcherLibUvBasicTimerNotifier<Api>::EventDispatcherLibUvBasicTimerNotifier(uv_loop_t *loop, Api *api, EventDispatcherLibUvPool<TimerWatcher> *pool)
+    : loop(loop), api(api), pool(pool), timers(indexedTimerIds), catchUp(EventDispatcherLibUv::SkipMissedPeriods)
 {
-    if (!this->api) {
-        this->api.reset(new LibuvApi());
+    if (!this->pool) {
+        ownedPool.reset(new EventDispatcherLibUvPool<TimerWatcher>());
+        this->pool = ownedPool.get();
     }
 }
 
-EventDispatcherLibUvTimerNotifier::~EventDispatcherLibUvTimerNotifier()
+template <typename Api>
+EventDispatcherLibUvBasicTimerNotifier<Api>::~EventDispatcherLibUvBasicTimerNotifier()
 {
-    for (auto it : timers) {
-        unregisterTimerWatcher(it.second);
-    }
+    // libuv keeps its timers in a binary heap, where the latest started ones are taken out with
+    // the least sifting; timer ids mostly go up with that, and closing a timer stops it
+    timers.forEachReversed([this](int, uv_timer_t *timer) {
+        api->uv_close((uv_handle_t *)timer, &uv_close_timerHandle);
+    });
     timers.clear();
 }
 
 
-void EventDispatcherLibUvTimerNotifier::registerTimer(int timerId, int interval, std::function<void()> callback)
+template <typename Api>
+void EventDispatcherLibUvBasicTimerNotifier<Api>::registerTimer(int timerId, int interval, EventDispatcherLibUvCallback callback)
 {
-    auto it = timers.find(timerId);
-    if (timers.end() == it) {
-        timers.insert(std::make_pair(timerId, new uv_timer_t()));
-        it = timers.find(timerId);
-        Q_ASSERT(timers.end() != it);
-        it->second->data = new TimerData();
-        api->uv_timer_init(uv_default_loop(), it->second);
+    uv_timer_t *timer = timers.find(timerId);
+    if (!timer) {
+        TimerWatcher *watcher = pool->acquire();
+        watcher->pool = pool;
+        watcher->handle.data = &watcher->data;
+        timer = &watcher->handle;
+        timers.insert(timerId, timer);
+        api->uv_timer_init(loop, timer);
     }
-    uv_timer_t *timer = it->second;
-    ((TimerData *)timer->data)->timeout = callback;
-    api->uv_timer_start(timer, &uv_timer_watcher, interval, interval);
+    TimerData *data = (TimerData *)timer->data;
+    data->timeout = callback;
+    data->rearm = [this, timer]{ rearm(timer); };
+    data->interval = interval;
+    data->deadline = api->uv_now(loop) + interval;
+    api->uv_timer_start(timer, &uv_timer_watcher, interval, 0);
 }
 
-bool EventDispatcherLibUvTimerNotifier::unregisterTimer(int timerId) {
-    auto it = timers.find(timerId);
-    if (it == timers.end()) {
+template <typename Api>
+void EventDispatcherLibUvBasicTimerNotifier<Api>::rearm(uv_timer_t *timer)
+{
+    TimerData *data = (TimerData *)timer->data;
+    uint64_t now = api->uv_now(loop);
+    data->deadline = nextTimerDeadline(data->deadline, data->interval, now, catchUp);
+    api->uv_timer_start(timer, &uv_timer_watcher, data->deadline > now ? data->deadline - now : 0, 0);
+}
+
+template <typename Api>
+bool EventDispatcherLibUvBasicTimerNotifier<Api>::unregisterTimer(int timerId) {
+    uv_timer_t *timer = timers.take(timerId);
+    if (!timer) {
         return false;
     }
-    unregisterTimerWatcher(it->second);
-    timers.erase(it);
+    unregisterTimerWatcher(timer);
     return true;
 }
 
-void EventDispatcherLibUvTimerNotifier::unregisterTimerWatcher(uv_timer_t *watcher)
+template <typename Api>
+int EventDispatcherLibUvBasicTimerNotifier<Api>::remainingTime(int timerId)
+{
+    uv_timer_t *timer = timers.find(timerId);
+    if (!timer) {
+        return -1;
+    }
+    uint64_t deadline = ((TimerData *)timer->data)->deadline;
+    uint64_t now = api->uv_now(loop);
+    return deadline > now ? int(deadline - now) : 0;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerNotifier<Api>::unregisterTimerWatcher(uv_timer_t *watcher)
 {
     api->uv_timer_stop(watcher);
     api->uv_close((uv_handle_t *)watcher, &uv_close_timerHandle);
@@ -54,15 +87,20 @@ void uv_timer_watcher(uv_timer_t* handle)
 {
     TimerData *data = (TimerData *) handle->data;
     if (data) {
+        if (data->rearm) {
+            data->rearm();
+        }
         data->timeout();
     }
 }
 
 void uv_close_timerHandle(uv_handle_t* handle)
 {
-    uv_timer_t *timer = (uv_timer_t *)handle;
-    delete ((TimerData *)timer->data);
-    delete timer;
+    TimerWatcher *watcher = (TimerWatcher *)handle;
+    watcher->pool->release(watcher);
 }
 
+template class EventDispatcherLibUvBasicTimerNotifier<LibuvDirectApi>;
+template class EventDispatcherLibUvBasicTimerNotifier<LibuvApi>;
+
 }
@@ -0,0 +1,443 @@
+#include "../eventdispatcherlibuv_p.h"
+
+#include <algorithm>
+#include <iterator>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+const int detachedSlot = -1;
+const int pendingSlot = -2;
+
+inline unsigned int lowestSetBit(uint64_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+inline uint64_t rotateRight(uint64_t bits, unsigned int by)
+{
+    return by ? (bits >> by) | (bits << (64 - by)) : bits;
+}
+
+// Qt's coarse timer rules (see qtimerinfo_unix.cpp): move the deadline within 5% of the
+// interval, preferring round boundaries of the current second so that timers line up
+uint64_t coarseDeadline(uint64_t deadline, int interval)
+{
+    int msec = deadline % 1000;
+    int absMaxRounding = interval / 20;
+    if (interval < 100 && interval != 25 && interval != 50 && interval != 75) {
+        if (interval < 50) {
+            // round to even
+            bool roundUp = (msec % 50) >= 25;
+            msec = ((msec >> 1) | int(roundUp)) << 1;
+        } else {
+            // round to multiple of 4
+            bool roundUp = (msec % 100) >= 50;
+            msec = ((msec >> 2) | int(roundUp)) << 2;
+        }
+    } else {
+        int min = std::max(0, msec - absMaxRounding);
+        int max = std::min(1000, msec + absMaxRounding);
+        if (min == 0) {
+            msec = 0;
+        } else if (max == 1000) {
+            msec = 1000;
+        } else {
+            int wantedBoundaryMultiple;
+            if ((interval % 500) == 0) {
+                if (interval >= 5000) {
+                    return deadline - deadline % 1000 + (msec >= 500 ? max : min);
+                }
+                wantedBoundaryMultiple = 500;
+            } else if ((interval % 50) == 0) {
+                int mult50 = interval / 50;
+                if ((mult50 % 4) == 0) {
+                    wantedBoundaryMultiple = 200;
+                } else if ((mult50 % 2) == 0) {
+                    wantedBoundaryMultiple = 100;
+                } else if ((mult50 % 5) == 0) {
+                    wantedBoundaryMultiple = 250;
+                } else {
+                    wantedBoundaryMultiple = 50;
+                }
+            } else {
+                wantedBoundaryMultiple = 25;
+            }
+            int base = msec / wantedBoundaryMultiple * wantedBoundaryMultiple;
+            int middlepoint = base + wantedBoundaryMultiple / 2;
+            if (msec < middlepoint) {
+                msec = std::max(base, min);
+            } else {
+                msec = std::min(base + wantedBoundaryMultiple, max);
+            }
+        }
+    }
+    return deadline - deadline % 1000 + msec;
+}
+
+}
+
+namespace qtjs {
+
+
+uint64_t coalescedTimerDeadline(uint64_t now, int interval, Qt::TimerType timerType)
+{
+    // as in Qt: below 20ms 5% is less than a tick, above 20s it is more than a second
+    if (timerType == Qt::CoarseTimer && interval >= 20000) {
+        timerType = Qt::VeryCoarseTimer;
+    }
+    if (timerType == Qt::VeryCoarseTimer) {
+        // both now and the interval are rounded to the nearest second, a timer started late in a
+        // second must not lose most of its first one
+        uint64_t seconds = (interval / 500 + 1) / 2;
+        uint64_t deadline = ((now + 500) / 1000 + seconds) * 1000;
+        return deadline > now ? deadline : (now / 1000 + 1) * 1000;
+    }
+    if (timerType == Qt::CoarseTimer && interval > 20) {
+        return coarseDeadline(now + interval, interval);
+    }
+    return now + interval;
+}
+
+uint64_t nextTimerDeadline(uint64_t deadline, uint64_t interval, uint64_t now, EventDispatcherLibUv::TimerCatchUpPolicy catchUp)
+{
+    interval = std::max<uint64_t>(interval, 1);
+    uint64_t next = deadline + interval;
+    if (next > now || catchUp == EventDispatcherLibUv::BurstMissedPeriods) {
+        return next;
+    }
+    if (catchUp == EventDispatcherLibUv::FireOnceAndRestart) {
+        return now + interval;
+    }
+    return next + ((now - next) / interval + 1) * interval;
+}
+
+
+template <typename Api>
+EventDispatcherLibUvBasicTimerWheel<Api>::EventDispatcherLibUvBasicTimerWheel(uv_loop_t *loop, Api *api)
+    : loop(loop), api(api), driver(nullptr), armed(false), armedTick(0), currentTick(0),
+      wakeupCount(0), expirationCount(0), catchUp(EventDispatcherLibUv::SkipMissedPeriods), timers(indexedTimerIds)
+{
+    for (auto &bucket : buckets) {
+        bucket.prev = bucket.next = &bucket;
+    }
+    std::fill(std::begin(occupied), std::end(occupied), 0);
+    driver = new uv_timer_t();
+    driver->data = this;
+    this->api->uv_timer_init(loop, driver);
+}
+
+template <typename Api>
+EventDispatcherLibUvBasicTimerWheel<Api>::~EventDispatcherLibUvBasicTimerWheel()
+{
+    // the records are freed with the blocks of their pool
+    timers.clear();
+    api->uv_timer_stop(driver);
+    driver->data = nullptr;
+    api->uv_close((uv_handle_t *)driver, &uv_close_timerWheelHandle);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerWheel<Api>::registerTimer(int timerId, int interval, Qt::TimerType timerType, EventDispatcherLibUvCallback callback)
+{
+    uint64_t now = api->uv_now(loop);
+    if (!timers.size() && currentTick < now) {
+        currentTick = now;
+    }
+    Timer *timer = timers.find(timerId);
+    if (!timer) {
+        timer = timerPool.acquire();
+        timer->timerId = timerId;
+        timer->slot = detachedSlot;
+        timer->running = 0;
+        timer->cancelled = false;
+        timers.insert(timerId, timer);
+    } else {
+        unlink(timer);
+    }
+    timer->interval = interval;
+    timer->timerType = timerType;
+    timer->due = now + interval;
+    timer->expires = coalescedTimerDeadline(now, interval, timerType);
+    timer->timeout = callback;
+    schedule(timer);
+    rearm();
+}
+
+template <typename Api>
+bool EventDispatcherLibUvBasicTimerWheel<Api>::unregisterTimer(int timerId)
+{
+    Timer *timer = timers.take(timerId);
+    if (!timer) {
+        return false;
+    }
+    unlink(timer);
+    if (timer->running) {
+        timer->cancelled = true;
+    } else {
+        timerPool.release(timer);
+    }
+    rearm();
+    return true;
+}
+
+// a timer scheduled behind the current tick expires with it
+template <typename Api>
+int EventDispatcherLibUvBasicTimerWheel<Api>::remainingTime(int timerId)
+{
+    Timer *timer = timers.find(timerId);
+    if (!timer) {
+        return -1;
+    }
+    uint64_t expires = std::max(timer->expires, currentTick);
+    uint64_t now = api->uv_now(loop);
+    return expires > now ? int(expires - now) : 0;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerWheel<Api>::processTimers()
+{
+    armed = false;
+    ++wakeupCount;
+    expire(api->uv_now(loop));
+    rearm();
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerWheel<Api>::schedule(Timer *timer)
+{
+    uint64_t expires = std::max(timer->expires, currentTick);
+    uint64_t delta = expires - currentTick;
+    int slot;
+    if (delta < rootSize) {
+        slot = expires & (rootSize - 1);
+    } else {
+        const uint64_t range = uint64_t(1) << (rootBits + levels * levelBits);
+        if (delta >= range) {
+            // park it in the top level, it gets re-sorted when that slot cascades
+            expires = currentTick + range - 1;
+            delta = range - 1;
+        }
+        unsigned int level = 0;
+        while (delta >= (uint64_t(1) << (rootBits + (level + 1) * levelBits))) {
+            ++level;
+        }
+        slot = rootSize + level * levelSize + ((expires >> (rootBits + level * levelBits)) & (levelSize - 1));
+    }
+    Link &head = buckets[slot];
+    timer->prev = head.prev;
+    timer->next = &head;
+    head.prev->next = timer;
+    head.prev = timer;
+    timer->slot = slot;
+    markSlot(slot, true);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerWheel<Api>::unlink(Timer *timer)
+{
+    if (timer->slot == detachedSlot) {
+        return;
+    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    if (timer->slot >= 0) {
+        Link &head = buckets[timer->slot];
+        if (head.next == &head) {
+            markSlot(timer->slot, false);
+        }
+    }
+    timer->slot = detachedSlot;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerWheel<Api>::markSlot(int slot, bool used)
+{
+    unsigned int word, bit;
+    if (slot < int(rootSize)) {
+        word = slot / 64;
+        bit = slot % 64;
+    } else {
+        word = rootSize / 64 + (slot - rootSize) / levelSize;
+        bit = (slot - rootSize) % levelSize;
+    }
+    if (used) {
+        occupied[word] |= uint64_t(1) << bit;
+    } else {
+        occupied[word] &= ~(uint64_t(1) << bit);
+    }
+}
+
+template <typename Api>
+int EventDispatcherLibUvBasicTimerWheel<Api>::nextRootSlot(unsigned int from) const
+{
+    for (unsigned int word = from / 64; word < rootSize / 64; ++word) {
+        uint64_t bits = occupied[word];
+        if (word == from / 64) {
+            bits &= ~uint64_t(0) << (from % 64);
+        }
+        if (bits) {
+            return word * 64 + lowestSetBit(bits);
+        }
+    }
+    return -1;
+}
+
+template <typename Api>
+unsigned int EventDispatcherLibUvBasicTimerWheel<Api>::cascade(unsigned int level)
+{
+    unsigned int index = (currentTick >> (rootBits + level * levelBits)) & (levelSize - 1);
+    Link &head = buckets[rootSize + level * levelSize + index];
+    if (head.next == &head) {
+        return index;
+    }
+    Link moved;
+    moved.next = head.next;
+    moved.prev = head.prev;
+    moved.next->prev = moved.prev->next = &moved;
+    head.prev = head.next = &head;
+    markSlot(rootSize + level * levelSize + index, false);
+    while (moved.next != &moved) {
+        Timer *timer = static_cast<Timer *>(moved.next);
+        moved.next = timer->next;
+        timer->slot = detachedSlot;
+        schedule(timer);
+    }
+    return index;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerWheel<Api>::expire(uint64_t now)
+{
+    while (currentTick <= now) {
+        unsigned int index = currentTick & (rootSize - 1);
+        if (!index) {
+            for (unsigned int level = 0; level < levels; ++level) {
+                if (cascade(level)) {
+                    break;
+                }
+            }
+        }
+        int next = nextRootSlot(index);
+        uint64_t tick = currentTick - index + (next < 0 ? rootSize : next);
+        if (tick != currentTick) {
+            currentTick = std::min(tick, now + 1);
+            continue;
+        }
+
+        Link &head = buckets[index];
+        Link pending;
+        pending.next = head.next;
+        pending.prev = head.prev;
+        pending.next->prev = pending.prev->next = &pending;
+        head.prev = head.next = &head;
+        markSlot(index, false);
+        for (Link *link = pending.next; link != &pending; link = link->next) {
+            static_cast<Timer *>(link)->slot = pendingSlot;
+        }
+        ++currentTick;
+
+        while (pending.next != &pending) {
+            Timer *timer = static_cast<Timer *>(pending.next);
+            unlink(timer);
+            int interval = std::max(timer->interval, 1);
+            timer->due = nextTimerDeadline(timer->due, interval, now, catchUp);
+            timer->expires = coalescedTimerDeadline(timer->due - interval, interval, timer->timerType);
+            schedule(timer);
+            fire(timer);
+        }
+    }
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerWheel<Api>::fire(Timer *timer)
+{
+    ++timer->running;
+    ++expirationCount;
+    timer->timeout();
+    if (!--timer->running && timer->cancelled) {
+        timerPool.release(timer);
+    }
+}
+
+template <typename Api>
+bool EventDispatcherLibUvBasicTimerWheel<Api>::nextTick(uint64_t &tick) const
+{
+    if (!timers.size()) {
+        return false;
+    }
+    bool found = false;
+    unsigned int index = currentTick & (rootSize - 1);
+    int next = nextRootSlot(index);
+    if (next >= 0) {
+        tick = currentTick - index + next;
+        found = true;
+    } else if ((next = nextRootSlot(0)) >= 0) {
+        tick = currentTick - index + rootSize + next;
+        found = true;
+    }
+    for (unsigned int level = 0; level < levels; ++level) {
+        uint64_t bits = occupied[rootSize / 64 + level];
+        if (!bits) {
+            continue;
+        }
+        // upper slots only need a wakeup when they cascade, at the start of their span
+        unsigned int shift = rootBits + level * levelBits;
+        uint64_t base = ((currentTick + (uint64_t(1) << shift) - 1) >> shift) << shift;
+        unsigned int position = (base >> shift) & (levelSize - 1);
+        uint64_t cascadeTick = base + (uint64_t(lowestSetBit(rotateRight(bits, position))) << shift);
+        if (!found || cascadeTick < tick) {
+            tick = cascadeTick;
+            found = true;
+        }
+    }
+    return found;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerWheel<Api>::rearm()
+{
+    uint64_t tick;
+    if (!nextTick(tick)) {
+        if (armed) {
+            api->uv_timer_stop(driver);
+            armed = false;
+        }
+        return;
+    }
+    if (armed && armedTick <= tick) {
+        return;
+    }
+    uint64_t now = api->uv_now(loop);
+    api->uv_timer_start(driver, &uv_timer_wheel_watcher<Api>, tick > now ? tick - now : 0, 0);
+    armed = true;
+    armedTick = tick;
+}
+
+
+template <typename Api>
+void uv_timer_wheel_watcher(uv_timer_t* handle)
+{
+    EventDispatcherLibUvBasicTimerWheel<Api> *wheel = (EventDispatcherLibUvBasicTimerWheel<Api> *) handle->data;
+    if (wheel) {
+        wheel->processTimers();
+    }
+}
+
+void uv_close_timerWheelHandle(uv_handle_t* handle)
+{
+    delete (uv_timer_t *)handle;
+}
+
+template class EventDispatcherLibUvBasicTimerWheel<LibuvDirectApi>;
+template class EventDispatcherLibUvBasicTimerWheel<LibuvApi>;
+
+}
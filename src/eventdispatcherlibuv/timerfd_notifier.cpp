@@ -0,0 +1,249 @@
+#include "../eventdispatcherlibuv_p.h"
+
+#ifdef Q_OS_LINUX
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace qtjs {
+
+namespace {
+
+const uint64_t nsPerMs = 1000000;
+const uint64_t nsPerSecond = 1000000000;
+
+}
+
+template <typename Api>
+EventDispatcherLibUvBasicTimerFdNotifier<Api>::EventDispatcherLibUvBasicTimerFdNotifier(uv_loop_t *loop, Api *api)
+    : loop(loop), api(api), fd(-1), watcher(nullptr), polling(false), armedAt(0),
+      wakeupCount(0), expirationCount(0), catchUp(EventDispatcherLibUv::SkipMissedPeriods), timers(indexedTimerIds)
+{
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    watcher = new uv_poll_t();
+    watcher->data = this;
+    this->api->uv_poll_init(loop, watcher, fd);
+}
+
+template <typename Api>
+EventDispatcherLibUvBasicTimerFdNotifier<Api>::~EventDispatcherLibUvBasicTimerFdNotifier()
+{
+    // the records are freed with the blocks of their pool
+    timers.clear();
+    heap.clear();
+    if (fd < 0) {
+        return;
+    }
+    watcher->data = nullptr;
+    // as for the socket watchers, closing stops the handle and takes the descriptor out of the
+    // backend right away, before it is closed below
+    api->uv_close((uv_handle_t *)watcher, &uv_close_timerFdHandle);
+    ::close(fd);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerFdNotifier<Api>::registerTimer(int timerId, int interval, EventDispatcherLibUvCallback callback)
+{
+    Timer *timer = timers.find(timerId);
+    if (!timer) {
+        timer = timerPool.acquire();
+        timer->timerId = timerId;
+        timer->heapIndex = -1;
+        timer->running = 0;
+        timer->cancelled = false;
+        timers.insert(timerId, timer);
+    } else {
+        remove(timer);
+    }
+    timer->interval = uint64_t(interval) * nsPerMs;
+    timer->deadline = api->uv_hrtime() + timer->interval;
+    timer->timeout = callback;
+    push(timer);
+    rearm();
+}
+
+template <typename Api>
+bool EventDispatcherLibUvBasicTimerFdNotifier<Api>::unregisterTimer(int timerId)
+{
+    Timer *timer = timers.take(timerId);
+    if (!timer) {
+        return false;
+    }
+    remove(timer);
+    if (timer->running) {
+        timer->cancelled = true;
+    } else {
+        timerPool.release(timer);
+    }
+    rearm();
+    return true;
+}
+
+template <typename Api>
+int EventDispatcherLibUvBasicTimerFdNotifier<Api>::remainingTime(int timerId)
+{
+    Timer *timer = timers.find(timerId);
+    if (!timer) {
+        return -1;
+    }
+    uint64_t now = api->uv_hrtime();
+    return timer->deadline > now ? int((timer->deadline - now + nsPerMs / 2) / nsPerMs) : 0;
+}
+
+// every timer due now fires, each goes back into the heap at its next period first; periods
+// it missed may be due again right away, depending on the catch-up policy
+template <typename Api>
+void EventDispatcherLibUvBasicTimerFdNotifier<Api>::processTimers()
+{
+    uint64_t elapsed;
+    while (::read(fd, &elapsed, sizeof(elapsed)) > 0) {
+    }
+    ++wakeupCount;
+    uint64_t now = api->uv_hrtime();
+    while (!heap.empty() && heap.front()->deadline <= now) {
+        Timer *timer = heap.front();
+        remove(timer);
+        timer->deadline = nextTimerDeadline(timer->deadline, timer->interval, now, catchUp);
+        push(timer);
+        fire(timer);
+    }
+    rearm();
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerFdNotifier<Api>::push(Timer *timer)
+{
+    heap.push_back(timer);
+    timer->heapIndex = heap.size() - 1;
+    siftUp(timer->heapIndex);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerFdNotifier<Api>::remove(Timer *timer)
+{
+    int index = timer->heapIndex;
+    if (index < 0) {
+        return;
+    }
+    timer->heapIndex = -1;
+    Timer *last = heap.back();
+    heap.pop_back();
+    if (last == timer) {
+        return;
+    }
+    place(last, index);
+    siftUp(index);
+    siftDown(last->heapIndex);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerFdNotifier<Api>::siftUp(int index)
+{
+    Timer *timer = heap[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (heap[parent]->deadline <= timer->deadline) {
+            break;
+        }
+        place(heap[parent], index);
+        index = parent;
+    }
+    place(timer, index);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerFdNotifier<Api>::siftDown(int index)
+{
+    Timer *timer = heap[index];
+    int size = heap.size();
+    for (;;) {
+        int child = 2 * index + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && heap[child + 1]->deadline < heap[child]->deadline) {
+            ++child;
+        }
+        if (timer->deadline <= heap[child]->deadline) {
+            break;
+        }
+        place(heap[child], index);
+        index = child;
+    }
+    place(timer, index);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerFdNotifier<Api>::place(Timer *timer, int index)
+{
+    heap[index] = timer;
+    timer->heapIndex = index;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicTimerFdNotifier<Api>::fire(Timer *timer)
+{
+    ++timer->running;
+    ++expirationCount;
+    timer->timeout();
+    if (!--timer->running && timer->cancelled) {
+        timerPool.release(timer);
+    }
+}
+
+// the watcher is stopped without timers, so that it does not keep the loop alive
+template <typename Api>
+void EventDispatcherLibUvBasicTimerFdNotifier<Api>::rearm()
+{
+    if (heap.empty()) {
+        if (polling) {
+            struct itimerspec disarm = {};
+            timerfd_settime(fd, TFD_TIMER_ABSTIME, &disarm, nullptr);
+            api->uv_poll_stop(watcher);
+            polling = false;
+            armedAt = 0;
+        }
+        return;
+    }
+    uint64_t deadline = heap.front()->deadline;
+    if (deadline != armedAt) {
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = deadline / nsPerSecond;
+        spec.it_value.tv_nsec = deadline % nsPerSecond;
+        // a zero it_value would disarm the timer instead
+        if (!deadline) {
+            spec.it_value.tv_nsec = 1;
+        }
+        timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+        armedAt = deadline;
+    }
+    if (!polling) {
+        api->uv_poll_start(watcher, UV_READABLE, &uv_timerfd_watcher<Api>);
+        polling = true;
+    }
+}
+
+
+template <typename Api>
+void uv_timerfd_watcher(uv_poll_t* handle, int, int)
+{
+    EventDispatcherLibUvBasicTimerFdNotifier<Api> *notifier = (EventDispatcherLibUvBasicTimerFdNotifier<Api> *) handle->data;
+    if (notifier) {
+        notifier->processTimers();
+    }
+}
+
+void uv_close_timerFdHandle(uv_handle_t* handle)
+{
+    delete (uv_poll_t *)handle;
+}
+
+template class EventDispatcherLibUvBasicTimerFdNotifier<LibuvDirectApi>;
+template class EventDispatcherLibUvBasicTimerFdNotifier<LibuvApi>;
+
+}
+
+#endif
@@ -0,0 +1,543 @@
+#include "../eventdispatcherlibuvudpsocket.h"
+#include "../eventdispatcherlibuv_p.h"
+
+#ifndef Q_OS_WIN
+
+#include <QPointer>
+
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+#ifdef Q_OS_LINUX
+typedef mmsghdr MessageHeader;
+#else
+struct MessageHeader {
+    msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
+
+// how many of the datagrams were received, or -1 with errno if none was
+int receiveMessages(int fd, MessageHeader *headers, int count)
+{
+#ifdef Q_OS_LINUX
+    return recvmmsg(fd, headers, count, MSG_DONTWAIT, nullptr);
+#else
+    for (int index = 0; index < count; ++index) {
+        ssize_t size = recvmsg(fd, &headers[index].msg_hdr, MSG_DONTWAIT);
+        if (size < 0) {
+            return index ? index : -1;
+        }
+        headers[index].msg_len = size;
+    }
+    return count;
+#endif
+}
+
+// how many of the datagrams were sent, or -1 with errno if none was
+int sendMessages(int fd, MessageHeader *headers, int count)
+{
+#ifdef Q_OS_LINUX
+    return sendmmsg(fd, headers, count, MSG_DONTWAIT);
+#else
+    for (int index = 0; index < count; ++index) {
+        if (sendmsg(fd, &headers[index].msg_hdr, MSG_DONTWAIT) < 0) {
+            return index ? index : -1;
+        }
+    }
+    return count;
+#endif
+}
+
+// the size of the parsed address, or 0
+socklen_t parseAddress(const char *host, quint16 port, sockaddr_storage *address)
+{
+    if (!uv_ip4_addr(host, port, (sockaddr_in *)address)) {
+        return sizeof(sockaddr_in);
+    }
+    if (!uv_ip6_addr(host, port, (sockaddr_in6 *)address)) {
+        return sizeof(sockaddr_in6);
+    }
+    return 0;
+}
+
+socklen_t addressSize(const sockaddr *address)
+{
+    return AF_INET6 == address->sa_family ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+}
+
+bool wouldBlock(int error)
+{
+    return EAGAIN == error || EWOULDBLOCK == error;
+}
+
+}
+
+namespace qtjs {
+
+// the libuv side of EventDispatcherLibUvUdpSocket
+class EventDispatcherLibUvUdpEndpoint : public EventDispatcherLibUvStream {
+public:
+    // datagram slots from head on, each wired to a message header of its own once
+    struct Ring {
+        Ring(int capacity, int slotSize);
+
+        int capacity;
+        int slotSize;
+        std::vector<char> storage;
+        std::vector<iovec> vectors;
+        std::vector<sockaddr_storage> addresses;
+        std::vector<MessageHeader> headers;
+        int head;
+        int count;
+    };
+
+    EventDispatcherLibUvUdpEndpoint(EventDispatcherLibUvUdpSocket *socket, EventDispatcherLibUv *dispatcher, int batchSize, int maxDatagramSize);
+    ~EventDispatcherLibUvUdpEndpoint();
+
+    bool bind(const char *host, quint16 port);
+    bool connectToHost(const char *host, quint16 port);
+    void close();
+    quint16 localPort() const;
+
+    int read(EventDispatcherLibUvUdpSocket::Datagram *datagrams, int maxCount);
+    bool write(const char *data, int size, const sockaddr *receiver);
+    void flush() override;
+
+    void polled(int status, int events);
+    void detachFromDispatcher() override;
+
+    EventDispatcherLibUvUdpSocket *socket;
+    EventDispatcherLibUv *dispatcher;
+    int fd;
+    uv_poll_t *poll;
+    int watchedEvents;
+    bool connected;
+    bool sendBlocked;
+    Ring received;
+    Ring sending;
+    int lastError;
+
+private:
+    bool open(int family);
+    void receive();
+    void scheduleFlush();
+    void watch();
+    bool fail(int error);
+};
+
+void uv_udp_watcher(uv_poll_t* handle, int status, int events);
+void uv_close_udpHandle(uv_handle_t* handle);
+
+
+EventDispatcherLibUvUdpEndpoint::Ring::Ring(int capacity, int slotSize)
+    : capacity(capacity), slotSize(slotSize), storage(size_t(capacity) * slotSize), vectors(capacity),
+      addresses(capacity), headers(capacity), head(0), count(0)
+{
+    for (int index = 0; index < capacity; ++index) {
+        vectors[index].iov_base = &storage[size_t(index) * slotSize];
+        vectors[index].iov_len = slotSize;
+        memset(&headers[index], 0, sizeof(MessageHeader));
+        headers[index].msg_hdr.msg_name = &addresses[index];
+        headers[index].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        headers[index].msg_hdr.msg_iov = &vectors[index];
+        headers[index].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+EventDispatcherLibUvUdpEndpoint::EventDispatcherLibUvUdpEndpoint(EventDispatcherLibUvUdpSocket *socket, EventDispatcherLibUv *dispatcher, int batchSize, int maxDatagramSize)
+    : socket(socket), dispatcher(dispatcher), fd(-1), poll(nullptr), watchedEvents(0), connected(false), sendBlocked(false),
+      received(batchSize, maxDatagramSize), sending(batchSize, maxDatagramSize), lastError(0)
+{
+    dispatcher->streamRegistry()->attach(this);
+}
+
+EventDispatcherLibUvUdpEndpoint::~EventDispatcherLibUvUdpEndpoint()
+{
+    if (dispatcher) {
+        dispatcher->streamRegistry()->detach(this);
+    }
+    close();
+}
+
+// the datagrams not sent yet are dropped, the socket is no longer valid
+void EventDispatcherLibUvUdpEndpoint::detachFromDispatcher()
+{
+    close();
+    dispatcher = nullptr;
+}
+
+bool EventDispatcherLibUvUdpEndpoint::open(int family)
+{
+    if (fd >= 0) {
+        return true;
+    }
+    fd = ::socket(family, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return fail(errno);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+    poll = new uv_poll_t();
+    int error = uv_poll_init_socket(dispatcher->uvLoop(), poll, fd);
+    if (error) {
+        delete poll;
+        poll = nullptr;
+        ::close(fd);
+        fd = -1;
+        // libuv errors are negated errno values on unix
+        return fail(-error);
+    }
+    poll->data = this;
+    watch();
+    return true;
+}
+
+bool EventDispatcherLibUvUdpEndpoint::bind(const char *host, quint16 port)
+{
+    sockaddr_storage address;
+    socklen_t size = parseAddress(host, port, &address);
+    if (!size) {
+        return fail(EINVAL);
+    }
+    if (!open(address.ss_family)) {
+        return false;
+    }
+    if (::bind(fd, (sockaddr *)&address, size)) {
+        return fail(errno);
+    }
+    return true;
+}
+
+bool EventDispatcherLibUvUdpEndpoint::connectToHost(const char *host, quint16 port)
+{
+    sockaddr_storage address;
+    socklen_t size = parseAddress(host, port, &address);
+    if (!size) {
+        return fail(EINVAL);
+    }
+    if (!open(address.ss_family)) {
+        return false;
+    }
+    if (::connect(fd, (sockaddr *)&address, size)) {
+        return fail(errno);
+    }
+    connected = true;
+    return true;
+}
+
+// the poll handle is closed first, it must not watch a descriptor that is gone
+void EventDispatcherLibUvUdpEndpoint::close()
+{
+    if (fd < 0) {
+        return;
+    }
+    poll->data = nullptr;
+    uv_close((uv_handle_t *)poll, &uv_close_udpHandle);
+    poll = nullptr;
+    ::close(fd);
+    fd = -1;
+    watchedEvents = 0;
+    connected = false;
+    sendBlocked = false;
+    received.head = received.count = 0;
+    sending.head = sending.count = 0;
+}
+
+quint16 EventDispatcherLibUvUdpEndpoint::localPort() const
+{
+    sockaddr_storage address;
+    socklen_t size = sizeof(address);
+    if (fd < 0 || getsockname(fd, (sockaddr *)&address, &size)) {
+        return 0;
+    }
+    if (AF_INET6 == address.ss_family) {
+        return ntohs(((sockaddr_in6 *)&address)->sin6_port);
+    }
+    return ntohs(((sockaddr_in *)&address)->sin_port);
+}
+
+int EventDispatcherLibUvUdpEndpoint::read(EventDispatcherLibUvUdpSocket::Datagram *datagrams, int maxCount)
+{
+    int count = std::min(maxCount, received.count);
+    for (int taken = 0; taken < count; ++taken) {
+        int index = (received.head + taken) % received.capacity;
+        const MessageHeader &header = received.headers[index];
+        datagrams[taken].data = (const char *)received.vectors[index].iov_base;
+        datagrams[taken].size = header.msg_len;
+        datagrams[taken].truncated = header.msg_hdr.msg_flags & MSG_TRUNC;
+        datagrams[taken].sender = (const sockaddr *)&received.addresses[index];
+    }
+    received.head = (received.head + count) % received.capacity;
+    received.count -= count;
+    watch();
+    return count;
+}
+
+bool EventDispatcherLibUvUdpEndpoint::write(const char *data, int size, const sockaddr *receiver)
+{
+    if (!receiver && !connected) {
+        return fail(EDESTADDRREQ);
+    }
+    if (fd < 0 && !open(receiver->sa_family)) {
+        return false;
+    }
+    // a datagram larger than a slot goes out on its own, after the queued ones
+    if (size > sending.slotSize) {
+        flush();
+        if (sendto(fd, data, size, MSG_DONTWAIT, receiver, receiver ? addressSize(receiver) : 0) < 0) {
+            return fail(errno);
+        }
+        return true;
+    }
+    if (sending.count == sending.capacity) {
+        flush();
+        // back pressure rather than a socket error, the caller learns it from the result alone
+        if (sending.count == sending.capacity) {
+            lastError = EAGAIN;
+            return false;
+        }
+    }
+    int index = (sending.head + sending.count) % sending.capacity;
+    MessageHeader &header = sending.headers[index];
+    memcpy(sending.vectors[index].iov_base, data, size);
+    sending.vectors[index].iov_len = size;
+    if (receiver) {
+        memcpy(&sending.addresses[index], receiver, addressSize(receiver));
+        header.msg_hdr.msg_name = &sending.addresses[index];
+        header.msg_hdr.msg_namelen = addressSize(receiver);
+    } else {
+        header.msg_hdr.msg_name = nullptr;
+        header.msg_hdr.msg_namelen = 0;
+    }
+    ++sending.count;
+    scheduleFlush();
+    return true;
+}
+
+// a datagram the socket refuses, other than for a full buffer, is dropped and reported
+void EventDispatcherLibUvUdpEndpoint::flush()
+{
+    int error = 0;
+    while (sending.count && !sendBlocked && fd >= 0) {
+        int span = std::min(sending.count, sending.capacity - sending.head);
+        int sent = sendMessages(fd, &sending.headers[sending.head], span);
+        if (sent < 0) {
+            if (wouldBlock(errno)) {
+                sendBlocked = true;
+                break;
+            }
+            error = errno;
+            sent = 1;
+        }
+        sending.head = (sending.head + sent) % sending.capacity;
+        sending.count -= sent;
+    }
+    watch();
+    if (error) {
+        fail(error);
+    }
+}
+
+// everything written while handling the current events goes out in one go, after the next poll
+void EventDispatcherLibUvUdpEndpoint::scheduleFlush()
+{
+    if (sendBlocked) {
+        return;
+    }
+    dispatcher->streamRegistry()->scheduleFlush(this);
+}
+
+// fills the free slots of the ring, a full ring is not read from until datagrams are taken
+void EventDispatcherLibUvUdpEndpoint::receive()
+{
+    int error = 0;
+    int taken = 0;
+    while (received.count < received.capacity) {
+        int start = (received.head + received.count) % received.capacity;
+        int span = std::min(received.capacity - start, received.capacity - received.count);
+        for (int index = start; index < start + span; ++index) {
+            received.headers[index].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        }
+        int count = receiveMessages(fd, &received.headers[start], span);
+        if (count < 0) {
+            if (!wouldBlock(errno)) {
+                error = errno;
+            }
+            break;
+        }
+        received.count += count;
+        taken += count;
+        if (count < span) {
+            break;
+        }
+    }
+    watch();
+    QPointer<EventDispatcherLibUvUdpSocket> guard(socket);
+    if (taken) {
+        emit socket->readyRead();
+    }
+    if (guard && error) {
+        fail(error);
+    }
+}
+
+void EventDispatcherLibUvUdpEndpoint::watch()
+{
+    if (fd < 0) {
+        return;
+    }
+    int events = (received.count < received.capacity ? UV_READABLE : 0) | (sendBlocked ? UV_WRITABLE : 0);
+    if (events == watchedEvents) {
+        return;
+    }
+    watchedEvents = events;
+    if (events) {
+        uv_poll_start(poll, events, &uv_udp_watcher);
+    } else {
+        uv_poll_stop(poll);
+    }
+}
+
+bool EventDispatcherLibUvUdpEndpoint::fail(int error)
+{
+    lastError = error;
+    emit socket->errorOccurred(error);
+    return false;
+}
+
+void EventDispatcherLibUvUdpEndpoint::polled(int status, int events)
+{
+    // libuv stops the handle on POLLERR, e.g. for an ICMP error on a connected socket, and
+    // reports EBADF; the pending error of the socket is the one to report
+    if (status < 0) {
+        int error = -status;
+        socklen_t size = sizeof(error);
+        if (UV_EBADF == status) {
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size);
+        }
+        watchedEvents = 0;
+        QPointer<EventDispatcherLibUvUdpSocket> guard(socket);
+        fail(error);
+        if (guard) {
+            watch();
+        }
+        return;
+    }
+    if (events & UV_WRITABLE) {
+        sendBlocked = false;
+        QPointer<EventDispatcherLibUvUdpSocket> guard(socket);
+        flush();
+        if (!guard || fd < 0) {
+            return;
+        }
+    }
+    if (events & UV_READABLE) {
+        receive();
+    }
+}
+
+
+void uv_udp_watcher(uv_poll_t* handle, int status, int events)
+{
+    EventDispatcherLibUvUdpEndpoint *endpoint = (EventDispatcherLibUvUdpEndpoint *) handle->data;
+    if (endpoint) {
+        endpoint->polled(status, events);
+    }
+}
+
+void uv_close_udpHandle(uv_handle_t* handle)
+{
+    delete (uv_poll_t *) handle;
+}
+
+
+EventDispatcherLibUvUdpSocket::EventDispatcherLibUvUdpSocket(int batchSize, int maxDatagramSize, QObject *parent) : QObject(parent)
+{
+    EventDispatcherLibUv *dispatcher = qobject_cast<EventDispatcherLibUv *>(QAbstractEventDispatcher::instance());
+    if (dispatcher) {
+        endpoint.reset(new EventDispatcherLibUvUdpEndpoint(this, dispatcher, std::max(batchSize, 1), std::max(maxDatagramSize, 1)));
+    }
+}
+
+EventDispatcherLibUvUdpSocket::~EventDispatcherLibUvUdpSocket()
+{
+}
+
+bool EventDispatcherLibUvUdpSocket::isValid() const
+{
+    return endpoint && endpoint->dispatcher;
+}
+
+bool EventDispatcherLibUvUdpSocket::bind(const char *host, quint16 port)
+{
+    return isValid() && endpoint->bind(host, port);
+}
+
+bool EventDispatcherLibUvUdpSocket::connectToHost(const char *host, quint16 port)
+{
+    return isValid() && endpoint->connectToHost(host, port);
+}
+
+void EventDispatcherLibUvUdpSocket::close()
+{
+    if (endpoint) {
+        endpoint->close();
+    }
+}
+
+quint16 EventDispatcherLibUvUdpSocket::localPort() const
+{
+    return endpoint ? endpoint->localPort() : 0;
+}
+
+int EventDispatcherLibUvUdpSocket::error() const
+{
+    return endpoint ? endpoint->lastError : 0;
+}
+
+QString EventDispatcherLibUvUdpSocket::errorString() const
+{
+    if (!endpoint) {
+        return QStringLiteral("the thread does not run an EventDispatcherLibUv");
+    }
+    return endpoint->lastError ? qt_error_string(endpoint->lastError) : QString();
+}
+
+int EventDispatcherLibUvUdpSocket::pendingDatagramCount() const
+{
+    return endpoint ? endpoint->received.count : 0;
+}
+
+int EventDispatcherLibUvUdpSocket::readDatagrams(Datagram *datagrams, int maxCount)
+{
+    return endpoint ? endpoint->read(datagrams, maxCount) : 0;
+}
+
+bool EventDispatcherLibUvUdpSocket::writeDatagram(const char *data, int size, const sockaddr *receiver)
+{
+    return isValid() && endpoint->write(data, size, receiver);
+}
+
+int EventDispatcherLibUvUdpSocket::datagramsToWrite() const
+{
+    return endpoint ? endpoint->sending.count : 0;
+}
+
+void EventDispatcherLibUvUdpSocket::flush()
+{
+    if (endpoint) {
+        endpoint->flush();
+    }
+}
+
+}
+
+#endif
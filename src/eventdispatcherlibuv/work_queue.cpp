@@ -0,0 +1,96 @@
+#include "../eventdispatcherlibuv_p.h"
+
+namespace qtjs {
+
+template <typename Api>
+EventDispatcherLibUvBasicWorkQueue<Api>::EventDispatcherLibUvBasicWorkQueue(uv_loop_t *loop, Api *api)
+    : loop(loop), api(api), lastWorkId(0), completedCount(0), droppedCount(0)
+{
+}
+
+// work still running finishes on the threadpool, its request is freed from the after-work callback
+template <typename Api>
+EventDispatcherLibUvBasicWorkQueue<Api>::~EventDispatcherLibUvBasicWorkQueue()
+{
+    cancelAll();
+    for (auto &pending : requests) {
+        pending.second->request.data = nullptr;
+    }
+}
+
+template <typename Api>
+int EventDispatcherLibUvBasicWorkQueue<Api>::queueWork(QObject *receiver, std::function<void()> work, std::function<void()> done)
+{
+    WorkRequest *request = new WorkRequest();
+    if (++lastWorkId <= 0) {
+        lastWorkId = 1;
+    }
+    request->request.data = this;
+    request->workId = lastWorkId;
+    request->guarded = receiver != nullptr;
+    request->receiver = receiver;
+    request->work = std::move(work);
+    request->done = std::move(done);
+    if (api->uv_queue_work(loop, &request->request, &uv_work_runner, &uv_work_finisher<Api>)) {
+        delete request;
+        return 0;
+    }
+    requests[request->workId] = request;
+    return request->workId;
+}
+
+template <typename Api>
+bool EventDispatcherLibUvBasicWorkQueue<Api>::cancelWork(int workId)
+{
+    auto it = requests.find(workId);
+    if (requests.end() == it) {
+        return false;
+    }
+    it->second->done = nullptr;
+    // libuv only cancels work no thread picked up yet, the after-work callback comes either way
+    return !api->uv_cancel((uv_req_t *)&it->second->request);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicWorkQueue<Api>::cancelAll()
+{
+    for (auto &pending : requests) {
+        pending.second->done = nullptr;
+        api->uv_cancel((uv_req_t *)&pending.second->request);
+    }
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicWorkQueue<Api>::finishWork(WorkRequest *request, int status)
+{
+    requests.erase(request->workId);
+    if (UV_ECANCELED != status && request->done && (!request->guarded || request->receiver)) {
+        ++completedCount;
+        request->done();
+    } else {
+        ++droppedCount;
+    }
+    delete request;
+}
+
+
+void uv_work_runner(uv_work_t* request)
+{
+    ((WorkRequest *)request)->work();
+}
+
+template <typename Api>
+void uv_work_finisher(uv_work_t* request, int status)
+{
+    EventDispatcherLibUvBasicWorkQueue<Api> *queue = (EventDispatcherLibUvBasicWorkQueue<Api> *) request->data;
+    if (queue) {
+        queue->finishWork((WorkRequest *)request, status);
+    } else {
+        delete (WorkRequest *)request;
+    }
+}
+
+template class EventDispatcherLibUvBasicWorkQueue<LibuvDirectApi>;
+template class EventDispatcherLibUvBasicWorkQueue<LibuvApi>;
+
+}
@@ -0,0 +1,164 @@
+#include "../eventdispatcherlibuv_p.h"
+
+namespace qtjs {
+
+template <typename Api>
+EventDispatcherLibUvBasicZeroTimerQueue<Api>::EventDispatcherLibUvBasicZeroTimerQueue(uv_loop_t *loop, Api *api)
+    : loop(loop), api(api), check(nullptr), idle(nullptr), started(false), expirationCount(0),
+      timers(indexedTimerIds)
+{
+    ready.prev = ready.next = &ready;
+    check = new uv_check_t();
+    check->data = this;
+    this->api->uv_check_init(loop, check);
+    idle = new uv_idle_t();
+    this->api->uv_idle_init(loop, idle);
+}
+
+template <typename Api>
+EventDispatcherLibUvBasicZeroTimerQueue<Api>::~EventDispatcherLibUvBasicZeroTimerQueue()
+{
+    // the records are freed with the blocks of their pool
+    timers.clear();
+    ready.prev = ready.next = &ready;
+    updateHandles();
+    check->data = nullptr;
+    api->uv_close((uv_handle_t *)check, &uv_close_checkHandle);
+    api->uv_close((uv_handle_t *)idle, &uv_close_idleHandle);
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicZeroTimerQueue<Api>::registerTimer(int timerId, EventDispatcherLibUvCallback callback)
+{
+    Timer *timer = timers.find(timerId);
+    if (!timer) {
+        timer = timerPool.acquire();
+        timer->timerId = timerId;
+        timer->running = 0;
+        timer->cancelled = false;
+        timers.insert(timerId, timer);
+        append(ready, timer);
+    }
+    timer->timeout = callback;
+    updateHandles();
+}
+
+template <typename Api>
+bool EventDispatcherLibUvBasicZeroTimerQueue<Api>::unregisterTimer(int timerId)
+{
+    Timer *timer = timers.take(timerId);
+    if (!timer) {
+        return false;
+    }
+    unlink(timer);
+    if (timer->running) {
+        timer->cancelled = true;
+    } else {
+        timerPool.release(timer);
+    }
+    updateHandles();
+    return true;
+}
+
+template <typename Api>
+int EventDispatcherLibUvBasicZeroTimerQueue<Api>::remainingTime(int timerId)
+{
+    return timers.find(timerId) ? 0 : -1;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicZeroTimerQueue<Api>::processTimers()
+{
+    if (ready.next == &ready) {
+        return;
+    }
+    Link pending;
+    pending.next = ready.next;
+    pending.prev = ready.prev;
+    pending.next->prev = pending.prev->next = &pending;
+    ready.prev = ready.next = &ready;
+
+    // every timer goes back to the ready list before it fires, it stays there until unregistered
+    while (pending.next != &pending) {
+        Timer *timer = static_cast<Timer *>(pending.next);
+        unlink(timer);
+        append(ready, timer);
+        fire(timer);
+    }
+    updateHandles();
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicZeroTimerQueue<Api>::append(Link &list, Timer *timer)
+{
+    timer->prev = list.prev;
+    timer->next = &list;
+    list.prev->next = timer;
+    list.prev = timer;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicZeroTimerQueue<Api>::unlink(Timer *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = timer;
+}
+
+template <typename Api>
+void EventDispatcherLibUvBasicZeroTimerQueue<Api>::fire(Timer *timer)
+{
+    ++timer->running;
+    ++expirationCount;
+    timer->timeout();
+    if (!--timer->running && timer->cancelled) {
+        timerPool.release(timer);
+    }
+}
+
+// both handles only stay active while there are timers, an idle loop blocks in the poll as before
+template <typename Api>
+void EventDispatcherLibUvBasicZeroTimerQueue<Api>::updateHandles()
+{
+    bool wanted = timers.size() > 0;
+    if (wanted == started) {
+        return;
+    }
+    if (wanted) {
+        api->uv_check_start(check, &uv_zero_timer_watcher<Api>);
+        api->uv_idle_start(idle, &uv_zero_timer_idler);
+    } else {
+        api->uv_check_stop(check);
+        api->uv_idle_stop(idle);
+    }
+    started = wanted;
+}
+
+
+template <typename Api>
+void uv_zero_timer_watcher(uv_check_t* handle)
+{
+    EventDispatcherLibUvBasicZeroTimerQueue<Api> *queue = (EventDispatcherLibUvBasicZeroTimerQueue<Api> *) handle->data;
+    if (queue) {
+        queue->processTimers();
+    }
+}
+
+void uv_zero_timer_idler(uv_idle_t*)
+{
+}
+
+void uv_close_checkHandle(uv_handle_t* handle)
+{
+    delete (uv_check_t *)handle;
+}
+
+void uv_close_idleHandle(uv_handle_t* handle)
+{
+    delete (uv_idle_t *)handle;
+}
+
+template class EventDispatcherLibUvBasicZeroTimerQueue<LibuvDirectApi>;
+template class EventDispatcherLibUvBasicZeroTimerQueue<LibuvApi>;
+
+}
@@ -1,34 +1,315 @@
 #pragma once
 
 #include <QAbstractEventDispatcher>
+#include <QPointer>
 #include <QSocketNotifier>
 
+#include "eventdispatcherlibuv.h"
 #include "uv.h"
 
 #include <memory>
 #include <map>
+#include <mutex>
+#include <algorithm>
+#include <deque>
+#include <atomic>
 #include <functional>
+#include <new>
+#include <set>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 namespace qtjs {
 
 
+struct PoolCounters {
+    size_t inUse;
+    size_t highWaterMark;
+    size_t capacity;
+};
+
+// Slab allocator: records are carved out of blocks of blockSize and recycled through a free list
+template <typename T>
+class EventDispatcherLibUvPool {
+public:
+    explicit EventDispatcherLibUvPool(size_t blockSize = 64)
+        : freeList(nullptr), blockSize(blockSize), used(0), highWater(0) {}
+    ~EventDispatcherLibUvPool() {
+        // records without a destructor go with their blocks, there is no need to visit the slots
+        if (std::is_trivially_destructible<T>::value) {
+            return;
+        }
+        for (auto &block : blocks) {
+            for (size_t i = 0; i < blockSize; ++i) {
+                if (block[i].live) {
+                    reinterpret_cast<T *>(&block[i].storage)->~T();
+                }
+            }
+        }
+    }
+    T *acquire() {
+        if (!freeList) {
+            grow();
+        }
+        Slot *slot = freeList;
+        freeList = slot->nextFree;
+        T *item = new (&slot->storage) T();
+        slot->live = true;
+        if (++used > highWater) {
+            highWater = used;
+        }
+        return item;
+    }
+    void release(T *item) {
+        Slot *slot = reinterpret_cast<Slot *>(item);
+        item->~T();
+        slot->live = false;
+        slot->nextFree = freeList;
+        freeList = slot;
+        --used;
+    }
+    PoolCounters counters() const {
+        return {used, highWater, blocks.size() * blockSize};
+    }
+private:
+    struct Slot {
+        union {
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+            Slot *nextFree;
+        };
+        bool live;
+    };
+    void grow() {
+        std::unique_ptr<Slot[]> block(new Slot[blockSize]);
+        for (size_t i = blockSize; i-- > 0;) {
+            block[i].live = false;
+            block[i].nextFree = freeList;
+            freeList = &block[i];
+        }
+        blocks.push_back(std::move(block));
+    }
+    std::vector<std::unique_ptr<Slot[]>> blocks;
+    Slot *freeList;
+    size_t blockSize;
+    size_t used;
+    size_t highWater;
+    Q_DISABLE_COPY(EventDispatcherLibUvPool)
+};
+
+
+
+// Direct-indexed table for small, dense integer keys such as descriptors; it grows lazily
+// up to limit, keys outside of that range fall back to a map
+template <typename T>
+class EventDispatcherLibUvIndexTable {
+public:
+    explicit EventDispatcherLibUvIndexTable(size_t limit) : limit(limit), count(0) {}
+    T *find(int key) const {
+        if (key >= 0 && size_t(key) < direct.size()) {
+            return direct[key];
+        }
+        if (key >= 0 && size_t(key) < limit) {
+            return nullptr;
+        }
+        auto it = overflow.find(key);
+        return overflow.end() == it ? nullptr : it->second;
+    }
+    void insert(int key, T *value) {
+        if (key >= 0 && size_t(key) < limit) {
+            if (size_t(key) >= direct.size()) {
+                size_t size = std::max<size_t>(std::max<size_t>(key + 1, direct.size() * 2), 64);
+                direct.resize(std::min(size, limit), nullptr);
+            }
+            count += !direct[key];
+            direct[key] = value;
+        } else {
+            count += !overflow.count(key);
+            overflow[key] = value;
+        }
+    }
+    T *take(int key) {
+        T *value = nullptr;
+        if (key >= 0 && size_t(key) < direct.size()) {
+            std::swap(value, direct[key]);
+        } else {
+            auto it = overflow.find(key);
+            if (overflow.end() != it) {
+                value = it->second;
+                overflow.erase(it);
+            }
+        }
+        count -= !!value;
+        return value;
+    }
+    template <typename Function>
+    void forEach(Function function) const {
+        for (size_t key = 0; key < direct.size(); ++key) {
+            if (direct[key]) {
+                function(int(key), direct[key]);
+            }
+        }
+        for (auto it : overflow) {
+            function(it.first, it.second);
+        }
+    }
+    template <typename Function>
+    void forEachReversed(Function function) const {
+        for (auto it = overflow.rbegin(); it != overflow.rend(); ++it) {
+            function(it->first, it->second);
+        }
+        for (size_t key = direct.size(); key-- > 0;) {
+            if (direct[key]) {
+                function(int(key), direct[key]);
+            }
+        }
+    }
+    size_t size() const {
+        return count;
+    }
+    void clear() {
+        direct.clear();
+        overflow.clear();
+        count = 0;
+    }
+private:
+    std::vector<T *> direct;
+    std::map<int, T *> overflow;
+    size_t limit;
+    size_t count;
+};
+
+
+
+// Qt hands out small, dense timer ids, so they index the timer tables directly
+const size_t indexedTimerIds = 1 << 20;
+
+// Event callback that keeps small, trivially copyable callables (such as lambdas capturing a
+// few pointers) inline, so that registering never allocates and an event is one indirect call
+class EventDispatcherLibUvCallback {
+public:
+    EventDispatcherLibUvCallback() : invoker(nullptr) {}
+    template <typename Function>
+    EventDispatcherLibUvCallback(Function function) : invoker(&invoke<Function>) {
+        static_assert(sizeof(Function) <= sizeof(storage) && alignof(Function) <= alignof(Storage),
+                      "callback does not fit into the inline storage");
+        static_assert(std::is_trivially_copyable<Function>::value && std::is_trivially_destructible<Function>::value,
+                      "callback has to be trivially copyable, capture pointers instead of objects");
+        new (&storage) Function(function);
+    }
+    void operator()() {
+        invoker(&storage);
+    }
+    explicit operator bool() const {
+        return invoker != nullptr;
+    }
+private:
+    typedef std::aligned_storage<3 * sizeof(void *), alignof(void *)>::type Storage;
+    template <typename Function>
+    static void invoke(void *storage) {
+        (*static_cast<Function *>(storage))();
+    }
+    void (*invoker)(void *);
+    Storage storage;
+};
+
+// eventMask is what the notifiers ask for, pollingMask what libuv was last started with
 struct SocketCallbacks {
     int eventMask;
-    std::function<void()> readAvailable;
-    std::function<void()> writeAvailable;
+    EventDispatcherLibUvCallback readAvailable;
+    EventDispatcherLibUvCallback writeAvailable;
+    EventDispatcherLibUvCallback exceptionAvailable;
+    int pollingMask;
+    bool pending;
 };
 
+// the watcher calls rearm, if set, before the timeout, which may unregister the timer
 struct TimerData {
-    std::function<void()> timeout;
+    EventDispatcherLibUvCallback timeout;
+    EventDispatcherLibUvCallback rearm;
+    uint64_t deadline;
+    uint64_t interval;
 };
 
+// handle first, so that close callbacks can get back to the record
+struct PollWatcher {
+    uv_poll_t handle;
+    SocketCallbacks callbacks;
+    EventDispatcherLibUvPool<PollWatcher> *pool;
+    int fd;
+};
+
+struct TimerWatcher {
+    uv_timer_t handle;
+    TimerData data;
+    EventDispatcherLibUvPool<TimerWatcher> *pool;
+};
+
+// owned by the dispatcher, they outlive the notifiers until the last close callback ran
+struct EventDispatcherLibUvHandlePools {
+    EventDispatcherLibUvPool<PollWatcher> pollWatchers;
+    EventDispatcherLibUvPool<TimerWatcher> timerWatchers;
+};
+
+// Reference counted read buffers for the streams of a dispatcher; received chunks refer to them
+// without copying. Single threaded, the pool goes with its dispatcher or its last buffer in use.
+class EventDispatcherLibUvReadBufferPool {
+public:
+    static const size_t bufferSize = 64 * 1024;
+    struct Buffer {
+        EventDispatcherLibUvReadBufferPool *pool;
+        Buffer *nextFree;
+        int refs;
+        size_t used;
+        char data[bufferSize];
+    };
+    EventDispatcherLibUvReadBufferPool() : freeList(nullptr), freeCount(0), used(0), highWater(0), orphaned(false) {}
+    // refs is 1, used 0
+    Buffer *acquire();
+    static void ref(Buffer *buffer) { ++buffer->refs; }
+    static void unref(Buffer *buffer);
+    // the dispatcher is done with the pool, which deletes itself once no buffer is in use
+    void orphan();
+    PoolCounters counters() const {
+        return {used, highWater, used + freeCount};
+    }
+private:
+    // a burst beyond this many idle buffers goes back to the heap
+    static const size_t maxFree = 64;
+    ~EventDispatcherLibUvReadBufferPool();
+    void release(Buffer *buffer);
+    Buffer *freeList;
+    size_t freeCount;
+    size_t used;
+    size_t highWater;
+    bool orphaned;
+    Q_DISABLE_COPY(EventDispatcherLibUvReadBufferPool)
+};
 
 
 void uv_socket_watcher(uv_poll_t* handle, int status, int events);
 void uv_timer_watcher(uv_timer_t* handle);
+template <typename Api>
+void uv_timer_wheel_watcher(uv_timer_t* handle);
 void uv_close_pollHandle(uv_handle_t* handle);
 void uv_close_timerHandle(uv_handle_t* handle);
+void uv_close_timerWheelHandle(uv_handle_t* handle);
+template <typename Api>
+void uv_zero_timer_watcher(uv_check_t* handle);
+void uv_zero_timer_idler(uv_idle_t* handle);
+void uv_close_checkHandle(uv_handle_t* handle);
+void uv_close_idleHandle(uv_handle_t* handle);
+template <typename Api>
+void uv_stream_flusher(uv_check_t* handle);
+void uv_stream_flush_idler(uv_idle_t* handle);
+template <typename Api>
+void uv_timerfd_watcher(uv_poll_t* handle, int status, int events);
+void uv_close_timerFdHandle(uv_handle_t* handle);
+void uv_async_watcher(uv_async_t* handle);
 void uv_close_asyncHandle(uv_handle_t* handle);
+void uv_work_runner(uv_work_t* request);
+template <typename Api>
+void uv_work_finisher(uv_work_t* request, int status);
 
 
 
@@ -42,7 +323,16 @@ struct LibuvApi {
     virtual int uv_timer_start(uv_timer_t* handle, uv_timer_cb cb, uint64_t timeout, uint64_t repeat);
     virtual int uv_timer_stop(uv_timer_t* handle);
 
+    virtual int uv_check_init(uv_loop_t*, uv_check_t* check);
+    virtual int uv_check_start(uv_check_t* check, uv_check_cb cb);
+    virtual int uv_check_stop(uv_check_t* check);
+
+    virtual int uv_idle_init(uv_loop_t*, uv_idle_t* idle);
+    virtual int uv_idle_start(uv_idle_t* idle, uv_idle_cb cb);
+    virtual int uv_idle_stop(uv_idle_t* idle);
+
     virtual uint64_t uv_hrtime(void);
+    virtual uint64_t uv_now(const uv_loop_t* loop);
 
     virtual void uv_close(uv_handle_t* handle, uv_close_cb close_cb);
 
@@ -51,77 +341,697 @@ struct LibuvApi {
 
     virtual void uv_ref(uv_handle_t* handle);
     virtual void uv_unref(uv_handle_t* handle);
+
+    virtual int uv_queue_work(uv_loop_t* loop, uv_work_t* req, uv_work_cb work_cb, uv_after_work_cb after_work_cb);
+    virtual int uv_cancel(uv_req_t* req);
 };
 
+// calls straight into libuv, so that production builds inline them instead of dispatching
+// through LibuvApi, which is only there for the specs to mock
+struct LibuvDirectApi {
+    int uv_poll_init(uv_loop_t* loop, uv_poll_t* handle, int fd) { return ::uv_poll_init(loop, handle, fd); }
+    int uv_poll_start(uv_poll_t* handle, int events, uv_poll_cb cb) { return ::uv_poll_start(handle, events, cb); }
+    int uv_poll_stop(uv_poll_t* handle) { return ::uv_poll_stop(handle); }
 
+    int uv_timer_init(uv_loop_t* loop, uv_timer_t* handle) { return ::uv_timer_init(loop, handle); }
+    int uv_timer_start(uv_timer_t* handle, uv_timer_cb cb, uint64_t timeout, uint64_t repeat) { return ::uv_timer_start(handle, cb, timeout, repeat); }
+    int uv_timer_stop(uv_timer_t* handle) { return ::uv_timer_stop(handle); }
 
+    int uv_check_init(uv_loop_t* loop, uv_check_t* check) { return ::uv_check_init(loop, check); }
+    int uv_check_start(uv_check_t* check, uv_check_cb cb) { return ::uv_check_start(check, cb); }
+    int uv_check_stop(uv_check_t* check) { return ::uv_check_stop(check); }
 
-class EventDispatcherLibUvAsyncChannel {
+    int uv_idle_init(uv_loop_t* loop, uv_idle_t* idle) { return ::uv_idle_init(loop, idle); }
+    int uv_idle_start(uv_idle_t* idle, uv_idle_cb cb) { return ::uv_idle_start(idle, cb); }
+    int uv_idle_stop(uv_idle_t* idle) { return ::uv_idle_stop(idle); }
+
+    uint64_t uv_hrtime(void) { return ::uv_hrtime(); }
+    uint64_t uv_now(const uv_loop_t* loop) { return ::uv_now(loop); }
+
+    void uv_close(uv_handle_t* handle, uv_close_cb close_cb) { ::uv_close(handle, close_cb); }
+
+    int uv_async_init(uv_loop_t* loop, uv_async_t* async, uv_async_cb async_cb) { return ::uv_async_init(loop, async, async_cb); }
+    int uv_async_send(uv_async_t* async) { return ::uv_async_send(async); }
+
+    void uv_ref(uv_handle_t* handle) { ::uv_ref(handle); }
+    void uv_unref(uv_handle_t* handle) { ::uv_unref(handle); }
+
+    int uv_queue_work(uv_loop_t* loop, uv_work_t* req, uv_work_cb work_cb, uv_after_work_cb after_work_cb) { return ::uv_queue_work(loop, req, work_cb, after_work_cb); }
+    int uv_cancel(uv_req_t* req) { return ::uv_cancel(req); }
+};
+
+// the direct API is stateless and lives in the object using it, an injected LibuvApi is owned
+template <typename Api>
+class LibuvApiHolder {
 public:
-    EventDispatcherLibUvAsyncChannel(LibuvApi *api = nullptr);
-    virtual ~EventDispatcherLibUvAsyncChannel();
+    explicit LibuvApiHolder(Api *) {}
+    Api *operator->() const { return &api; }
+private:
+    mutable Api api;
+};
+
+template <>
+class LibuvApiHolder<LibuvApi> {
+public:
+    explicit LibuvApiHolder(LibuvApi *api) : api(api ? api : new LibuvApi()) {}
+    LibuvApi *operator->() const { return api.get(); }
+private:
+    std::unique_ptr<LibuvApi> api;
+};
+
+
+
+
+// Lock-free multi-producer, single-consumer queue of tasks for the loop thread (Vyukov's
+// intrusive MPSC queue). Producers only ask for a wakeup when the consumer has none pending.
+class EventDispatcherLibUvTaskQueue {
+public:
+    EventDispatcherLibUvTaskQueue();
+    ~EventDispatcherLibUvTaskQueue();
+    // any thread, returns true if the consumer has to be woken up
+    bool push(std::function<void()> task);
+    // loop thread only, runs the tasks queued so far
+    void run();
+    // any thread, tasks run since creation
+    uint64_t tasksRun() const { return executed.load(std::memory_order_relaxed); }
+private:
+    struct Node {
+        std::atomic<Node *> next;
+        std::function<void()> task;
+    };
+    std::atomic<Node *> head;
+    Node *tail;
+    Node stub;
+    std::atomic<bool> wakeupPending;
+    std::atomic<uint64_t> executed;
+    void pushNode(Node *node);
+    Node *pop();
+    Q_DISABLE_COPY(EventDispatcherLibUvTaskQueue)
+};
+
+template <typename Api>
+class EventDispatcherLibUvBasicAsyncChannel {
+public:
+    EventDispatcherLibUvBasicAsyncChannel(uv_loop_t *loop, Api *api = nullptr);
+    virtual ~EventDispatcherLibUvBasicAsyncChannel();
+    // the handle keeps the loop alive while anyone holds a reference
     void ref();
     void unref();
     void send();
+    // thread safe, the task runs on the loop thread; returns whether the loop was woken up
+    bool post(std::function<void()> task);
+    uint64_t tasksRun() const { return tasks.tasksRun(); }
 private:
-    std::unique_ptr<LibuvApi> api;
+    LibuvApiHolder<Api> api;
     uv_async_t *handle;
+    int refs;
+    EventDispatcherLibUvTaskQueue tasks;
+};
+
+typedef EventDispatcherLibUvBasicAsyncChannel<LibuvDirectApi> EventDispatcherLibUvAsyncChannel;
+
+
+// the request leads, so that the libuv callbacks get to the rest from it
+struct WorkRequest {
+    uv_work_t request;
+    int workId;
+    // done is only for a receiver still around, if there was one
+    bool guarded;
+    QPointer<QObject> receiver;
+    std::function<void()> work;
+    std::function<void()> done;
+};
+
+// Runs work on libuv's threadpool and hands the completion back to the loop thread from the
+// after-work callback, instead of a posted event
+template <typename Api>
+class EventDispatcherLibUvBasicWorkQueue {
+public:
+    EventDispatcherLibUvBasicWorkQueue(uv_loop_t *loop, Api *api = nullptr);
+    virtual ~EventDispatcherLibUvBasicWorkQueue();
+    // loop thread only; returns 0 if libuv did not take the work
+    int queueWork(QObject *receiver, std::function<void()> work, std::function<void()> done);
+    // drops done either way; true if the work itself was kept from running
+    bool cancelWork(int workId);
+    void cancelAll();
+    void finishWork(WorkRequest *request, int status);
+    size_t size() const { return requests.size(); }
+    uint64_t completed() const { return completedCount; }
+    uint64_t dropped() const { return droppedCount; }
+private:
+    uv_loop_t *loop;
+    LibuvApiHolder<Api> api;
+    int lastWorkId;
+    std::unordered_map<int, WorkRequest *> requests;
+    uint64_t completedCount;
+    uint64_t droppedCount;
+    Q_DISABLE_COPY(EventDispatcherLibUvBasicWorkQueue)
 };
 
 
 
 
-class EventDispatcherLibUvSocketNotifier {
+template <typename Api>
+class EventDispatcherLibUvBasicSocketNotifier {
 public:
-    EventDispatcherLibUvSocketNotifier(LibuvApi *api = nullptr);
-    virtual ~EventDispatcherLibUvSocketNotifier();
-    void registerSocketNotifier(int fd, QSocketNotifier::Type type, std::function<void()> callback);
+    EventDispatcherLibUvBasicSocketNotifier(uv_loop_t *loop, Api *api = nullptr, EventDispatcherLibUvPool<PollWatcher> *pool = nullptr);
+    virtual ~EventDispatcherLibUvBasicSocketNotifier();
+    // both only record the change, libuv learns about it from commitPendingChanges; except that a
+    // descriptor left without notifiers stops being polled right away, before it can be closed
+    void registerSocketNotifier(int fd, QSocketNotifier::Type type, EventDispatcherLibUvCallback callback);
     void unregisterSocketNotifier(int fd, QSocketNotifier::Type type);
+    // hands the net mask change of every touched descriptor to libuv, once per loop iteration;
+    // returns true if a watcher was started, which reaches the backend on the next poll only
+    bool commitPendingChanges();
+    uint64_t pollStarts() const { return startCount; }
+    uint64_t pollStops() const { return stopCount; }
     void wakeup(){}
 private:
-    std::unique_ptr<LibuvApi> api;
-    std::map<int, uv_poll_t*> socketWatchers;
+    uv_loop_t *loop;
+    LibuvApiHolder<Api> api;
+    std::unique_ptr<EventDispatcherLibUvPool<PollWatcher>> ownedPool;
+    EventDispatcherLibUvPool<PollWatcher> *pool;
+    EventDispatcherLibUvIndexTable<uv_poll_t> socketWatchers;
+    std::vector<uv_poll_t *> pendingWatchers;
+    uint64_t startCount;
+    uint64_t stopCount;
     uv_poll_t *findOrCreateWatcher(int fd);
-    bool unregisterPollWatcher(uv_poll_t *fdWatcher, unsigned int eventMask);
+    void markPending(uv_poll_t *fdWatcher);
+    void closePollWatcher(uv_poll_t *fdWatcher);
 };
 
+typedef EventDispatcherLibUvBasicSocketNotifier<LibuvDirectApi> EventDispatcherLibUvSocketNotifier;
 
 
 
-class EventDispatcherLibUvTimerNotifier {
+
+template <typename Api>
+class EventDispatcherLibUvBasicTimerNotifier {
 public:
-    EventDispatcherLibUvTimerNotifier(LibuvApi *api = nullptr);
-    virtual ~EventDispatcherLibUvTimerNotifier();
-    void registerTimer(int timerId, int interval, std::function<void()> callback);
+    EventDispatcherLibUvBasicTimerNotifier(uv_loop_t *loop, Api *api = nullptr, EventDispatcherLibUvPool<TimerWatcher> *pool = nullptr);
+    virtual ~EventDispatcherLibUvBasicTimerNotifier();
+    void registerTimer(int timerId, int interval, EventDispatcherLibUvCallback callback);
     bool unregisterTimer(int timerId);
+    // in loop time, until the deadline the libuv timer was started for; -1 for a timer of another engine
+    int remainingTime(int timerId);
+    void setCatchUpPolicy(EventDispatcherLibUv::TimerCatchUpPolicy policy) { catchUp = policy; }
 private:
-    std::unique_ptr<LibuvApi> api;
-    std::map<int, uv_timer_t*> timers;
+    uv_loop_t *loop;
+    LibuvApiHolder<Api> api;
+    std::unique_ptr<EventDispatcherLibUvPool<TimerWatcher>> ownedPool;
+    EventDispatcherLibUvPool<TimerWatcher> *pool;
+    EventDispatcherLibUvIndexTable<uv_timer_t> timers;
+    EventDispatcherLibUv::TimerCatchUpPolicy catchUp;
+    // libuv's repeat counts from when the callback ran, the timers are re-armed one by one instead
+    void rearm(uv_timer_t *timer);
     void unregisterTimerWatcher(uv_timer_t *watcher);
 };
 
+typedef EventDispatcherLibUvBasicTimerNotifier<LibuvDirectApi> EventDispatcherLibUvTimerNotifier;
+
+
+
+
+// 0 ms timers are due on every iteration, they wait in a ready list instead of taking a libuv
+// timer each. A check handle fires them after the poll, an idle handle keeps the poll from
+// blocking while any are registered.
+template <typename Api>
+class EventDispatcherLibUvBasicZeroTimerQueue {
+public:
+    EventDispatcherLibUvBasicZeroTimerQueue(uv_loop_t *loop, Api *api = nullptr);
+    virtual ~EventDispatcherLibUvBasicZeroTimerQueue();
+    void registerTimer(int timerId, EventDispatcherLibUvCallback callback);
+    bool unregisterTimer(int timerId);
+    // 0 for a registered timer, which is due on every iteration, -1 for any other
+    int remainingTime(int timerId);
+    // fires the timers registered before the pass started once each, later ones wait for the
+    // next iteration so that a timer restarting itself does not keep the loop in here
+    void processTimers();
+    uint64_t expirations() const { return expirationCount; }
+    PoolCounters poolCounters() const { return timerPool.counters(); }
+private:
+    struct Link {
+        Link *prev;
+        Link *next;
+    };
+    struct Timer : Link {
+        int timerId;
+        int running;
+        bool cancelled;
+        EventDispatcherLibUvCallback timeout;
+    };
+    uv_loop_t *loop;
+    LibuvApiHolder<Api> api;
+    uv_check_t *check;
+    uv_idle_t *idle;
+    bool started;
+    uint64_t expirationCount;
+    Link ready;
+    EventDispatcherLibUvPool<Timer> timerPool;
+    EventDispatcherLibUvIndexTable<Timer> timers;
+
+    void append(Link &list, Timer *timer);
+    void unlink(Timer *timer);
+    void fire(Timer *timer);
+    void updateHandles();
+};
+
+typedef EventDispatcherLibUvBasicZeroTimerQueue<LibuvDirectApi> EventDispatcherLibUvZeroTimerQueue;
+
+
+
+
+// The libuv side of a socket with a handle of its own, such as the tcp and udp sockets. It is
+// attached to the dispatcher of its thread for as long as it may use the dispatcher's loop.
+class EventDispatcherLibUvStream {
+public:
+    EventDispatcherLibUvStream();
+    virtual ~EventDispatcherLibUvStream() {}
+    // sends what was written since the flush was scheduled
+    virtual void flush() = 0;
+    // the dispatcher goes first: the handle is to be closed right away, without signals, and
+    // neither the dispatcher nor its loop used again
+    virtual void detachFromDispatcher() = 0;
+private:
+    template <typename Api> friend class EventDispatcherLibUvBasicStreamRegistry;
+    struct Link {
+        Link *prev;
+        Link *next;
+        EventDispatcherLibUvStream *stream;
+    };
+    Link attached;
+    Link flushed;
+    Q_DISABLE_COPY(EventDispatcherLibUvStream)
+};
+
+// The streams attached to a dispatcher, which detaches the ones still open before it drains and
+// closes its loop. Writes are flushed together once per iteration, after the poll, by a check
+// handle; an idle handle keeps the poll from blocking while a flush is scheduled, as for the
+// 0 ms timers.
+template <typename Api>
+class EventDispatcherLibUvBasicStreamRegistry {
+public:
+    EventDispatcherLibUvBasicStreamRegistry(uv_loop_t *loop, Api *api = nullptr);
+    virtual ~EventDispatcherLibUvBasicStreamRegistry();
+    void attach(EventDispatcherLibUvStream *stream);
+    void detach(EventDispatcherLibUvStream *stream);
+    void detachAll();
+    // a stream already scheduled is flushed once still
+    void scheduleFlush(EventDispatcherLibUvStream *stream);
+    // flushes the streams scheduled before the pass started, one scheduled again from its flush
+    // waits for the next iteration
+    void flushStreams();
+private:
+    typedef EventDispatcherLibUvStream::Link Link;
+    LibuvApiHolder<Api> api;
+    uv_check_t *check;
+    uv_idle_t *idle;
+    bool started;
+    Link attached;
+    Link flushing;
+
+    static void append(Link &list, Link *link);
+    static void unlink(Link *link);
+    void updateHandles();
+    Q_DISABLE_COPY(EventDispatcherLibUvBasicStreamRegistry)
+};
+
+typedef EventDispatcherLibUvBasicStreamRegistry<LibuvDirectApi> EventDispatcherLibUvStreamRegistry;
+
+
 
 
+#ifdef Q_OS_LINUX
+// libuv timers are kept in whole milliseconds. Precise timers rather share one timerfd, armed
+// at the earliest absolute CLOCK_MONOTONIC deadline (the clock of uv_hrtime) and polled by the
+// loop; the timers are kept in a min-heap of nanosecond deadlines.
+template <typename Api>
+class EventDispatcherLibUvBasicTimerFdNotifier {
+public:
+    EventDispatcherLibUvBasicTimerFdNotifier(uv_loop_t *loop, Api *api = nullptr);
+    virtual ~EventDispatcherLibUvBasicTimerFdNotifier();
+    // false if the kernel would not give a timerfd, the timers have to go elsewhere then
+    bool isValid() const { return fd >= 0; }
+    void registerTimer(int timerId, int interval, EventDispatcherLibUvCallback callback);
+    bool unregisterTimer(int timerId);
+    // until the timer's deadline in the heap, to the nearest millisecond; -1 for a timer of another engine
+    int remainingTime(int timerId);
+    void processTimers();
+    void setCatchUpPolicy(EventDispatcherLibUv::TimerCatchUpPolicy policy) { catchUp = policy; }
+    // the absolute deadline the timerfd is armed with, 0 while disarmed
+    uint64_t armedDeadline() const { return armedAt; }
+    uint64_t wakeups() const { return wakeupCount; }
+    uint64_t expirations() const { return expirationCount; }
+private:
+    struct Timer {
+        uint64_t deadline;
+        uint64_t interval;
+        int timerId;
+        int heapIndex;
+        int running;
+        bool cancelled;
+        EventDispatcherLibUvCallback timeout;
+    };
+    uv_loop_t *loop;
+    LibuvApiHolder<Api> api;
+    int fd;
+    uv_poll_t *watcher;
+    bool polling;
+    uint64_t armedAt;
+    uint64_t wakeupCount;
+    uint64_t expirationCount;
+    EventDispatcherLibUv::TimerCatchUpPolicy catchUp;
+    std::vector<Timer *> heap;
+    EventDispatcherLibUvPool<Timer> timerPool;
+    EventDispatcherLibUvIndexTable<Timer> timers;
+
+    void push(Timer *timer);
+    void remove(Timer *timer);
+    void siftUp(int index);
+    void siftDown(int index);
+    void place(Timer *timer, int index);
+    void fire(Timer *timer);
+    void rearm();
+};
+
+typedef EventDispatcherLibUvBasicTimerFdNotifier<LibuvDirectApi> EventDispatcherLibUvTimerFdNotifier;
+#endif
 
+
+
+
+// deadline for a timer started at 'now' (ms), slack applied as Qt does for coarse timer types
+uint64_t coalescedTimerDeadline(uint64_t now, int interval, Qt::TimerType timerType);
+
+// the deadline after 'deadline' of a repeating timer that fired at 'now', in any unit of time
+uint64_t nextTimerDeadline(uint64_t deadline, uint64_t interval, uint64_t now, EventDispatcherLibUv::TimerCatchUpPolicy catchUp);
+
+template <typename Api>
+class EventDispatcherLibUvBasicTimerWheel {
+public:
+    EventDispatcherLibUvBasicTimerWheel(uv_loop_t *loop, Api *api = nullptr);
+    virtual ~EventDispatcherLibUvBasicTimerWheel();
+    void registerTimer(int timerId, int interval, Qt::TimerType timerType, EventDispatcherLibUvCallback callback);
+    bool unregisterTimer(int timerId);
+    // in loop time, until the tick the timer was coalesced to; -1 for a timer of another engine
+    int remainingTime(int timerId);
+    void processTimers();
+    void setCatchUpPolicy(EventDispatcherLibUv::TimerCatchUpPolicy policy) { catchUp = policy; }
+    uint64_t wakeups() const { return wakeupCount; }
+    uint64_t expirations() const { return expirationCount; }
+    PoolCounters poolCounters() const { return timerPool.counters(); }
+private:
+    struct Link {
+        Link *prev;
+        Link *next;
+    };
+    // due keeps the period, expires is where coalescing moved it
+    struct Timer : Link {
+        uint64_t due;
+        uint64_t expires;
+        int timerId;
+        int interval;
+        Qt::TimerType timerType;
+        int slot;
+        int running;
+        bool cancelled;
+        EventDispatcherLibUvCallback timeout;
+    };
+    // 256 slots of 1ms at the root, then 4 levels of 64 slots, each 64 times coarser
+    static const unsigned int rootBits = 8;
+    static const unsigned int rootSize = 1 << rootBits;
+    static const unsigned int levelBits = 6;
+    static const unsigned int levelSize = 1 << levelBits;
+    static const unsigned int levels = 4;
+
+    uv_loop_t *loop;
+    LibuvApiHolder<Api> api;
+    uv_timer_t *driver;
+    bool armed;
+    uint64_t armedTick;
+    uint64_t currentTick;
+    uint64_t wakeupCount;
+    uint64_t expirationCount;
+    EventDispatcherLibUv::TimerCatchUpPolicy catchUp;
+    Link buckets[rootSize + levels * levelSize];
+    uint64_t occupied[rootSize / 64 + levels];
+    EventDispatcherLibUvPool<Timer> timerPool;
+    EventDispatcherLibUvIndexTable<Timer> timers;
+
+    void schedule(Timer *timer);
+    void unlink(Timer *timer);
+    void markSlot(int slot, bool used);
+    int nextRootSlot(unsigned int from) const;
+    unsigned int cascade(unsigned int level);
+    void expire(uint64_t now);
+    void fire(Timer *timer);
+    bool nextTick(uint64_t &tick) const;
+    void rearm();
+};
+
+typedef EventDispatcherLibUvBasicTimerWheel<LibuvDirectApi> EventDispatcherLibUvTimerWheel;
+
+
+
+
+// The registered timers by id and by object, for what Qt asks about them; their deadlines are
+// kept by the timer engines alone
 class EventDispatcherLibUvTimerTracker {
 public:
-    EventDispatcherLibUvTimerTracker(LibuvApi *api = nullptr);
+    EventDispatcherLibUvTimerTracker();
     void registerTimer(int timerId, int interval, Qt::TimerType timerType, QObject *object);
-    void unregisterTimer(int timerId);
+    bool unregisterTimer(int timerId, Qt::TimerType *timerType = nullptr);
+    // forgets all timers of the object, unregister(timerId, timerType) is called for each of them
+    template <typename Function>
+    void unregisterTimers(QObject *object, Function unregister);
     QList<QAbstractEventDispatcher::TimerInfo> getTimerInfo(QObject *object);
-    void fireTimer(int timerId);
-    int remainingTime(int timerId);
+    // false if the timer is not registered
+    bool find(int timerId, Qt::TimerType *timerType);
 private:
-    void cleanTimerFromObject(int timerId, void *object);
-    struct TimerInfo {
-        uint64_t lastFired;
+    // one record per timer, chained into the list of timers of its object
+    struct TimerRecord {
+        int timerId;
         int interval;
-        void *object;
+        Qt::TimerType timerType;
+        QObject *object;
+        TimerRecord *previousOfObject;
+        TimerRecord *nextOfObject;
     };
-    std::unique_ptr<LibuvApi> api;
-    std::map<void *, QList<QAbstractEventDispatcher::TimerInfo>> timers;
-    std::map<int, TimerInfo> timerInfos;
+    struct ObjectTimers {
+        TimerRecord *first;
+        TimerRecord *last;
+    };
+    EventDispatcherLibUvPool<TimerRecord> recordPool;
+    EventDispatcherLibUvIndexTable<TimerRecord> records;
+    std::unordered_map<QObject *, ObjectTimers> objectTimers;
+    void unlinkFromObject(TimerRecord *record);
+};
+
+template <typename Function>
+void EventDispatcherLibUvTimerTracker::unregisterTimers(QObject *object, Function unregister)
+{
+    auto it = objectTimers.find(object);
+    if (objectTimers.end() == it) {
+        return;
+    }
+    TimerRecord *record = it->second.first;
+    objectTimers.erase(it);
+    while (record) {
+        TimerRecord *next = record->nextOfObject;
+        records.take(record->timerId);
+        unregister(record->timerId, record->timerType);
+        recordPool.release(record);
+        record = next;
+    }
+}
+
+
+
+
+
+// Counters of one dispatcher loop. Only the loop thread writes them, so they are bumped with a
+// relaxed load and store rather than a locked add, and any thread may read them. Event counts are
+// always kept, phase times and libuv idle time only while enabled, as they need clock reads.
+class EventDispatcherLibUvLoopMetrics {
+public:
+    enum { phaseCount = 4, histogramBuckets = 20 };
+    EventDispatcherLibUvLoopMetrics();
+    // any thread
+    void setEnabled(bool enabled) { timing.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return timing.load(std::memory_order_relaxed); }
+    // loop thread
+    void countSocketEvent() { bump(socketEvents); }
+    void countTimerEvent() { bump(timerEvents); }
+    void recordPhase(int phase, uint64_t ns);
+    void finishIteration(uv_loop_t *loop, bool timed);
+    // bucket 0 holds durations under 1us, bucket n those under 2^n us, the last one all longer ones
+    static int histogramBucket(uint64_t ns);
+
+    std::atomic<uint64_t> iterations;
+    std::atomic<uint64_t> idleNs;
+    std::atomic<uint64_t> socketEvents;
+    std::atomic<uint64_t> timerEvents;
+    std::atomic<uint64_t> phaseSamples[phaseCount];
+    std::atomic<uint64_t> phaseNs[phaseCount];
+    std::atomic<uint64_t> histogram[phaseCount][histogramBuckets];
+private:
+    std::atomic<bool> timing;
+    bool idleTimeConfigured;
+    static void bump(std::atomic<uint64_t> &counter, uint64_t by = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+    Q_DISABLE_COPY(EventDispatcherLibUvLoopMetrics)
+};
+
+// Times the phases of one processEvents call: each mark charges the time since the previous
+// mark to a phase, phases entered more than once are recorded as one sample when it goes away
+class EventDispatcherLibUvPhaseClock {
+public:
+    EventDispatcherLibUvPhaseClock(EventDispatcherLibUvLoopMetrics &metrics, uv_loop_t *loop)
+        : metrics(metrics), loop(loop), timed(metrics.enabled()), last(timed ? uv_hrtime() : 0), spent()
+    {
+    }
+    ~EventDispatcherLibUvPhaseClock()
+    {
+        if (timed) {
+            for (int phase = 0; phase < EventDispatcherLibUvLoopMetrics::phaseCount; ++phase) {
+                if (spent[phase]) {
+                    metrics.recordPhase(phase, spent[phase]);
+                }
+            }
+        }
+        metrics.finishIteration(loop, timed);
+    }
+    void mark(int phase)
+    {
+        if (timed) {
+            uint64_t now = uv_hrtime();
+            // a phase entered at all counts, even if the clock did not move
+            spent[phase] += std::max<uint64_t>(now - last, 1);
+            last = now;
+        }
+    }
+private:
+    EventDispatcherLibUvLoopMetrics &metrics;
+    uv_loop_t *loop;
+    bool timed;
+    uint64_t last;
+    uint64_t spent[EventDispatcherLibUvLoopMetrics::phaseCount];
+    Q_DISABLE_COPY(EventDispatcherLibUvPhaseClock)
+};
+
+
+
+
+
+// Times event delivery to receivers. The dispatcher checks active() and only reads the clock
+// when profiling or the slow threshold is on; everything past that goes through the lock, as
+// the profile is read and configured from other threads.
+class EventDispatcherLibUvDispatchProfiler {
+public:
+    typedef EventDispatcherLibUv::DispatchRecord Record;
+    EventDispatcherLibUvDispatchProfiler();
+    bool active() const { return timing.load(std::memory_order_relaxed); }
+    void setAggregating(bool enabled);
+    void setSlowThreshold(uint64_t thresholdNs, EventDispatcherLibUv::SlowDispatchHandler handler);
+    // the receiver may be gone by now, so its type and name are taken before the dispatch
+    void record(EventDispatcherLibUv::DispatchSource source, int id, const QMetaObject *type, const QString &objectName, uint64_t ns);
+    QList<Record> top(int count) const;
+    void reset();
+private:
+    struct Key {
+        int source;
+        int id;
+        const QMetaObject *type;
+        QString objectName;
+        bool operator<(const Key &other) const;
+    };
+    mutable std::mutex mutex;
+    std::map<Key, Record> records;
+    bool aggregating;
+    uint64_t slowThresholdNs;
+    EventDispatcherLibUv::SlowDispatchHandler slowHandler;
+    std::atomic<bool> timing;
+    void updateTiming();
+    Q_DISABLE_COPY(EventDispatcherLibUvDispatchProfiler)
 };
 
 
+
+
+
+// Bounds the socket and timer events dispatched per loop iteration. Events past the budget are
+// queued and go first on the next iteration, in the order they became ready, so one busy socket
+// or a burst of timers cannot hold up the rest of the loop. libuv polls level triggered, so a
+// socket reported again while it waits is not queued twice. A timer fired again is not either,
+// but its dispatch counts the fires, each of which moved the timer on by a period.
+class EventDispatcherLibUvDispatchBudget {
+public:
+    struct Dispatch {
+        EventDispatcherLibUv::DispatchSource source;
+        QObject *receiver;
+        int id;
+        int fires;
+    };
+    EventDispatcherLibUvDispatchBudget();
+    // any thread, 0 leaves the respective limit out
+    void setLimits(int maxDispatches, uint64_t maxNs);
+    // loop thread
+    void startIteration();
+    // true if the dispatch has to wait for a later iteration, it is queued then
+    bool defer(EventDispatcherLibUv::DispatchSource source, QObject *receiver, int id);
+    // the next queued dispatch, while the budget lasts
+    bool takeDeferred(Dispatch &dispatch);
+    bool hasDeferred() const { return !deferredNotifiers.empty() || !deferredTimers.empty(); }
+    bool defersTimer(int timerId) const { return deferredTimers.count(timerId) > 0; }
+    void forgetNotifier(QObject *notifier);
+    void forgetTimer(int timerId);
+private:
+    std::atomic<int> dispatchLimit;
+    std::atomic<uint64_t> timeLimitNs;
+    int maxDispatches;
+    uint64_t maxNs;
+    int dispatched;
+    uint64_t started;
+    std::deque<Dispatch> deferred;
+    std::set<QObject *> deferredNotifiers;
+    // timer id to the fires its dispatch stands for
+    std::map<int, int> deferredTimers;
+    bool limited() const { return maxDispatches || maxNs; }
+    bool exhausted() const;
+    bool isDeferred(EventDispatcherLibUv::DispatchSource source, QObject *receiver, int id) const;
+    void dropForgotten();
+    Q_DISABLE_COPY(EventDispatcherLibUvDispatchBudget)
+};
+
+
+
+
+
+// Lets the platform dispatcher of the gui thread do its single blocking wait for libuv as well:
+// it watches the libuv backend fd and holds a timer for the next libuv timeout on its behalf
+class EventDispatcherLibUvPlatformBridge {
+public:
+    EventDispatcherLibUvPlatformBridge(uv_loop_t *loop, QAbstractEventDispatcher *platform);
+    ~EventDispatcherLibUvPlatformBridge();
+    // the backend notifier registers through the thread's dispatcher, which has to hand it over,
+    // so it can only be created once the dispatcher knows the bridge
+    void watchBackend();
+    bool owns(QSocketNotifier *notifier) const;
+    // runs libuv once without waiting, so that the backend fd covers every started watcher, and
+    // arms the timeout timer, or none while the loop has no active handles; returns false if
+    // libuv has work pending and the platform must not block
+    bool prepareWait();
+private:
+    uv_loop_t *loop;
+    QAbstractEventDispatcher *platform;
+    QObject timeoutReceiver;
+    QSocketNotifier *backendNotifier;
+    bool creatingNotifier;
+    int timerId;
+    int armedTimeout;
+    Q_DISABLE_COPY(EventDispatcherLibUvPlatformBridge)
+};
+
 }
@@ -0,0 +1,70 @@
+#ifndef EVENTDISPATCHERLIBUVGROUP_H
+#define EVENTDISPATCHERLIBUVGROUP_H
+
+#include <QThread>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace qtjs {
+
+class EventDispatcherLibUv;
+
+// Runs a number of QThreads, each with an EventDispatcherLibUv on a libuv loop of its own, and
+// spreads listening sockets and accepted connections over them. listen(), close() and the
+// destructor block until the threads are done, so they are not for the group's own threads.
+class EventDispatcherLibUvGroup {
+public:
+    enum ListenMode {
+        // a listening socket per thread on the same port, the kernel balances the connections
+        // over them (SO_REUSEPORT, linux 3.9 and later)
+        ReusePortShards,
+        // one listening socket watched from every thread; a connection wakes all of them, each
+        // accepts a few connections at most per wakeup and leaves the rest to the others
+        SharedListener
+    };
+
+    // runs on the thread that accepted the connection, which owns the non-blocking descriptor
+    typedef std::function<void(int index, int fd)> AcceptHandler;
+
+    explicit EventDispatcherLibUvGroup(int threadCount = QThread::idealThreadCount());
+    ~EventDispatcherLibUvGroup();
+
+    int size() const;
+    QThread *thread(int index) const;
+    EventDispatcherLibUv *dispatcher(int index) const;
+    // the threads in turn, for spreading work that comes from elsewhere
+    int nextIndex();
+
+    // host is a numeric IPv4 or IPv6 address, port 0 picks a free one; false if the group
+    // listens already or the socket could not be set up (see the warning)
+    bool listen(const char *host, quint16 port, ListenMode mode, AcceptHandler handler, int backlog = 128);
+    quint16 serverPort() const;
+    // connections accepted by the thread of index since the group started listening
+    quint64 acceptedConnections(int index) const;
+    void close();
+
+    // runs the handler with the descriptor on the thread of index, which takes it over
+    void handOver(int index, int fd, std::function<void(int fd)> handler);
+
+private:
+    struct Worker;
+
+    void watch(Worker *worker, int fd);
+    void acceptConnections(Worker *worker);
+    void runAndWait(Worker *worker, std::function<void()> task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<unsigned int> next;
+    AcceptHandler acceptHandler;
+    int sharedFd;
+    quint16 port;
+
+    Q_DISABLE_COPY(EventDispatcherLibUvGroup)
+};
+
+}
+
+#endif // EVENTDISPATCHERLIBUVGROUP_H
@@ -0,0 +1,91 @@
+#ifndef EVENTDISPATCHERLIBUVTCPSOCKET_H
+#define EVENTDISPATCHERLIBUVTCPSOCKET_H
+
+#include <QIODevice>
+
+#include <memory>
+
+namespace qtjs {
+
+class EventDispatcherLibUvTcpStream;
+
+// A TCP stream on a libuv uv_tcp_t of the thread's EventDispatcherLibUv, in place of a
+// QTcpSocket. Data is received into the dispatcher's read buffers and can be taken from there
+// without copying; writes made while handling an event go out together, as one vectored write.
+class EventDispatcherLibUvTcpSocket : public QIODevice {
+    Q_OBJECT
+public:
+    enum State {
+        UnconnectedState,
+        ConnectingState,
+        ConnectedState,
+        ClosingState
+    };
+
+    // received data, kept in a read buffer of the dispatcher until the last copy of the chunk
+    // is gone; only for the thread of the socket
+    class Chunk {
+    public:
+        Chunk();
+        Chunk(const Chunk &other);
+        Chunk &operator=(const Chunk &other);
+        ~Chunk();
+        const char *data() const { return begin; }
+        qint64 size() const { return length; }
+        bool isEmpty() const { return !length; }
+    private:
+        friend class EventDispatcherLibUvTcpStream;
+        void *buffer;
+        const char *begin;
+        qint64 length;
+    };
+
+    // the thread of the socket has to run an EventDispatcherLibUv, see isValid
+    explicit EventDispatcherLibUvTcpSocket(QObject *parent = nullptr);
+    ~EventDispatcherLibUvTcpSocket();
+
+    // false as well once the dispatcher was destroyed, which closes the connection
+    bool isValid() const;
+    State state() const;
+    // the libuv error code of the last failure, see errorString for its text
+    int error() const;
+
+    // host is a numeric IPv4 or IPv6 address
+    void connectToHost(const char *host, quint16 port, OpenMode mode = ReadWrite);
+    // adopts a connected socket, e.g. one accepted by an EventDispatcherLibUvGroup
+    bool setSocketDescriptor(qintptr fd, OpenMode mode = ReadWrite);
+    // closes the connection once everything written went out
+    void disconnectFromHost();
+    void abort();
+
+    // the next chunk of received data in place of read(), empty if there is none
+    Chunk readChunk();
+
+    // as QAbstractSocket::setReadBufferSize, the socket stops reading once the received data
+    // not taken yet reaches size, which may go over it by a read; 0, the default, is unlimited
+    qint64 readBufferSize() const;
+    void setReadBufferSize(qint64 size);
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override;
+    bool canReadLine() const override;
+    void close() override;
+
+signals:
+    void connected();
+    void disconnected();
+    void errorOccurred(int error);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 size) override;
+
+private:
+    friend class EventDispatcherLibUvTcpStream;
+    std::unique_ptr<EventDispatcherLibUvTcpStream> stream;
+};
+
+}
+
+#endif // EVENTDISPATCHERLIBUVTCPSOCKET_H
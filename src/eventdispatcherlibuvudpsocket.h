@@ -0,0 +1,70 @@
+#ifndef EVENTDISPATCHERLIBUVUDPSOCKET_H
+#define EVENTDISPATCHERLIBUVUDPSOCKET_H
+
+#include <QObject>
+#include <QString>
+
+#include <memory>
+
+struct sockaddr;
+
+namespace qtjs {
+
+class EventDispatcherLibUvUdpEndpoint;
+
+// A UDP socket watched by the thread's EventDispatcherLibUv, in place of a QUdpSocket for high
+// packet rates. Each readiness event drains the socket into a ring of preallocated datagram slots,
+// with recvmmsg on Linux, and is announced with a single readyRead; datagrams written while
+// handling an event are queued and sent together, with sendmmsg on Linux. Not on Windows.
+class EventDispatcherLibUvUdpSocket : public QObject {
+    Q_OBJECT
+public:
+    // a received datagram in its ring slot, valid until control returns to the event loop
+    struct Datagram {
+        const char *data;
+        int size;
+        // the datagram was longer than a slot, the rest of it is lost
+        bool truncated;
+        const sockaddr *sender;
+    };
+
+    // the thread of the socket has to run an EventDispatcherLibUv, see isValid; both rings
+    // have batchSize slots of maxDatagramSize bytes
+    explicit EventDispatcherLibUvUdpSocket(int batchSize = 64, int maxDatagramSize = 2048, QObject *parent = nullptr);
+    ~EventDispatcherLibUvUdpSocket();
+
+    // false as well once the dispatcher was destroyed, which closes the socket
+    bool isValid() const;
+    // host is a numeric IPv4 or IPv6 address
+    bool bind(const char *host, quint16 port);
+    // sets the receiver of datagrams written without one, and takes datagrams from it only
+    bool connectToHost(const char *host, quint16 port);
+    void close();
+    quint16 localPort() const;
+    // the errno of the last failure, see errorString for its text
+    int error() const;
+    QString errorString() const;
+
+    int pendingDatagramCount() const;
+    // takes up to maxCount received datagrams out of the ring, returns how many
+    int readDatagrams(Datagram *datagrams, int maxCount);
+    // queues a copy of the datagram, to receiver or to the connected host; false when the
+    // datagram cannot be sent or the send ring is full and the socket does not take any more,
+    // a full ring is not an errorOccurred, error() is EAGAIN then
+    bool writeDatagram(const char *data, int size, const sockaddr *receiver = nullptr);
+    int datagramsToWrite() const;
+    // sends the queued datagrams now rather than once the current event is handled
+    void flush();
+
+signals:
+    void readyRead();
+    void errorOccurred(int error);
+
+private:
+    friend class EventDispatcherLibUvUdpEndpoint;
+    std::unique_ptr<EventDispatcherLibUvUdpEndpoint> endpoint;
+};
+
+}
+
+#endif // EVENTDISPATCHERLIBUVUDPSOCKET_H